@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+
 /*
  * This file is shared between libc and the kernel, so don't put anything
  * in here that won't work in both contexts.
@@ -40,6 +41,18 @@
 #include <string.h>
 #endif
 
+/* Copies shorter than this aren't worth aligning; do them by bytes. */
+#define SMALLCOPY	(4 * sizeof(long))
+
+/*
+ * A word that may not be aligned. gcc loads these with an lwl/lwr
+ * pair on MIPS, and with whatever the machine does best for unaligned
+ * loads elsewhere.
+ */
+struct unaligned_long {
+	long v;
+} __attribute__((__packed__));
+
 /*
  * C standard function - copy a block of memory.
  */
@@ -47,39 +60,79 @@
 void *
 memcpy(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	long *dw;
+	const long *sw;
+	const struct unaligned_long *su;
+	size_t n;
 
 	/*
 	 * memcpy does not support overlapping buffers, so always do it
 	 * forwards. (Don't change this without adjusting memmove.)
 	 *
-	 * For speedy copying, optimize the common case where both pointers
-	 * and the length are word-aligned, and copy word-at-a-time instead
-	 * of byte-at-a-time. Otherwise, copy by bytes.
+	 * Copy bytes until the destination is word-aligned, then whole
+	 * words, then whatever bytes are left. If the source is then
+	 * aligned too, copy eight words (a MIPS cache line) per trip
+	 * around the loop. If it isn't, load each word unaligned and
+	 * store it aligned, which is still one store per word rather
+	 * than four.
 	 *
-	 * The alignment logic below should be portable. We rely on
-	 * the compiler to be reasonably intelligent about optimizing
-	 * the divides and modulos out. Fortunately, it is.
+	 * Each word is read before it's written, and the words go in
+	 * ascending order, so memmove can rely on this to copy down
+	 * over an overlapping source.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	if (len >= SMALLCOPY) {
+		while ((uintptr_t)d % sizeof(long) != 0) {
+			*d++ = *s++;
+			len--;
+		}
 
-		long *d = dst;
-		const long *s = src;
+		dw = (long *)d;
+		n = len / sizeof(long);
+		len %= sizeof(long);
 
-		for (i=0; i<len/sizeof(long); i++) {
-			d[i] = s[i];
+		if ((uintptr_t)s % sizeof(long) == 0) {
+			sw = (const long *)s;
+			for (; n >= 8; n -= 8) {
+				dw[0] = sw[0];
+				dw[1] = sw[1];
+				dw[2] = sw[2];
+				dw[3] = sw[3];
+				dw[4] = sw[4];
+				dw[5] = sw[5];
+				dw[6] = sw[6];
+				dw[7] = sw[7];
+				dw += 8;
+				sw += 8;
+			}
+			for (; n > 0; n--) {
+				*dw++ = *sw++;
+			}
+			s = (const unsigned char *)sw;
 		}
+		else {
+			su = (const struct unaligned_long *)s;
+			for (; n >= 4; n -= 4) {
+				dw[0] = su[0].v;
+				dw[1] = su[1].v;
+				dw[2] = su[2].v;
+				dw[3] = su[3].v;
+				dw += 4;
+				su += 4;
+			}
+			for (; n > 0; n--) {
+				*dw++ = (su++)->v;
+			}
+			s = (const unsigned char *)su;
+		}
+		d = (unsigned char *)dw;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=0; i<len; i++) {
-			d[i] = s[i];
-		}
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
 	}
 
 	return dst;
@@ -40,6 +40,14 @@
 #include <string.h>
 #endif
 
+/* Copies shorter than this aren't worth aligning; do them by bytes. */
+#define SMALLCOPY	(4 * sizeof(long))
+
+/* A word that may not be aligned; see memcpy.c. */
+struct unaligned_long {
+	long v;
+} __attribute__((__packed__));
+
 /*
  * C standard function - copy a block of memory, handling overlapping
  * regions correctly.
@@ -48,7 +56,12 @@
 void *
 memmove(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d;
+	const unsigned char *s;
+	long *dw;
+	const long *sw;
+	const struct unaligned_long *su;
+	size_t n;
 
 	/*
 	 * If the buffers don't overlap, it doesn't matter what direction
@@ -84,33 +97,68 @@ memmove(void *dst, const void *src, size_t len)
 	}
 
 	/*
-	 * Copy by words in the common case. Look in memcpy.c for more
-	 * information.
+	 * Otherwise go backwards, the mirror image of memcpy: bytes
+	 * until the end of the destination is word-aligned, then whole
+	 * words from the top down, eight at a time if the source is
+	 * aligned too and through unaligned loads if not, then the
+	 * bytes left at the bottom. The destination is above the
+	 * source, so a store can only land on source words we've
+	 * already read.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	d = (unsigned char *)dst + len;
+	s = (const unsigned char *)src + len;
 
-		long *d = dst;
-		const long *s = src;
+	if (len >= SMALLCOPY) {
+		while ((uintptr_t)d % sizeof(long) != 0) {
+			*--d = *--s;
+			len--;
+		}
 
-		/*
-		 * The reason we copy index i-1 and test i>0 is that
-		 * i is unsigned -- so testing i>=0 doesn't work.
-		 */
+		dw = (long *)d;
+		n = len / sizeof(long);
+		len %= sizeof(long);
 
-		for (i=len/sizeof(long); i>0; i--) {
-			d[i-1] = s[i-1];
+		if ((uintptr_t)s % sizeof(long) == 0) {
+			sw = (const long *)s;
+			for (; n >= 8; n -= 8) {
+				dw -= 8;
+				sw -= 8;
+				dw[7] = sw[7];
+				dw[6] = sw[6];
+				dw[5] = sw[5];
+				dw[4] = sw[4];
+				dw[3] = sw[3];
+				dw[2] = sw[2];
+				dw[1] = sw[1];
+				dw[0] = sw[0];
+			}
+			for (; n > 0; n--) {
+				*--dw = *--sw;
+			}
+			s = (const unsigned char *)sw;
+		}
+		else {
+			su = (const struct unaligned_long *)s;
+			for (; n >= 4; n -= 4) {
+				dw -= 4;
+				su -= 4;
+				dw[3] = su[3].v;
+				dw[2] = su[2].v;
+				dw[1] = su[1].v;
+				dw[0] = su[0].v;
+			}
+			for (; n > 0; n--) {
+				*--dw = (--su)->v;
+			}
+			s = (const unsigned char *)su;
 		}
+		d = (unsigned char *)dw;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=len; i>0; i--) {
-			d[i-1] = s[i-1];
-		}
+	while (len > 0) {
+		*--d = *--s;
+		len--;
 	}
 
 	return dst;
@@ -153,7 +153,14 @@ pn_to_addr(unsigned int pn){
  * grows downwards.
  */
 #define USERSTACK	    USERSPACETOP
-#define USERSTACK_SIZE	    16*PAGE_SIZE
+#define USERSTACK_SIZE	    32*PAGE_SIZE	/* > ARG_MAX; see limits.h */
+
+/*
+ * Where the time page (see timepage.h) goes: just below where
+ * programs are linked (0x00400000), out of the way of the heap, which
+ * grows up from the end of the data segment.
+ */
+#define USERTIMEPAGE	    0x003ff000
 
 /*
  * Interface to the low-level module that looks after the amount of
@@ -185,14 +192,21 @@ paddr_t ram_getfirstfree(void);
 /*
  * TLB shootdown bits.
  *
- * We'll take up to 16 invalidations before just flushing the whole TLB.
+ * One request carries up to TLBSHOOTDOWN_BATCH pages of one address
+ * space; bigger jobs are sent as a flush of the whole TLB instead
+ * (ts_npages == 0). A cpu queues up to TLBSHOOTDOWN_MAX requests, and
+ * if more arrive before it gets to them they are all coalesced into
+ * one full flush.
  */
 
+struct addrspace;
+
+#define TLBSHOOTDOWN_BATCH 8
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	struct addrspace *ts_as;	/* Address space, or NULL for any */
+	unsigned ts_npages;		/* Number of pages; 0 means all */
+	vaddr_t ts_pages[TLBSHOOTDOWN_BATCH];
 };
 
 #define TLBSHOOTDOWN_MAX 16
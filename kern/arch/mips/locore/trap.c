@@ -165,6 +165,9 @@ mips_trap(struct trapframe *tf)
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
 
+		cpustat_inc(CS_INTERRUPTS);
+		curcpu->c_intruser = !iskern;	/* for hardclock */
+
 		/*
 		 * The processor has turned interrupts off; if the
 		 * currently recorded interrupt state is interrupts on
@@ -229,6 +232,7 @@ mips_trap(struct trapframe *tf)
 		DEBUG(DB_SYSCALL, "syscall: #%d, args %x %x %x %x\n",
 		      tf->tf_v0, tf->tf_a0, tf->tf_a1, tf->tf_a2, tf->tf_a3);
 
+		cpustat_inc(CS_SYSCALLS);
 		syscall(tf);
 		goto done;
 	}
@@ -425,11 +429,14 @@ mips_usermode(struct trapframe *tf)
  * Unless you implement execve() that passes environments around, just
  * pass NULL for the environment.
  *
+ * TIMEPAGE is the user address of the time page (see timepage.h), or
+ * NULL; it's passed in a3.
+ *
  * Works by creating an ersatz trapframe.
  */
 void
 enter_new_process(int argc, userptr_t argv, userptr_t env,
-		  vaddr_t stack, vaddr_t entry)
+		  userptr_t timepage, vaddr_t stack, vaddr_t entry)
 {
 	struct trapframe tf;
 
@@ -440,6 +447,7 @@ enter_new_process(int argc, userptr_t argv, userptr_t env,
 	tf.tf_a0 = argc;
 	tf.tf_a1 = (vaddr_t)argv;
 	tf.tf_a2 = (vaddr_t)env;
+	tf.tf_a3 = (vaddr_t)timepage;
 	tf.tf_sp = stack;
 
 	mips_usermode(&tf);
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/syscall.h>
+#include <kern/multicall.h>
 #include <endian.h>
 #include <lib.h>
 #include <mips/trapframe.h>
@@ -38,6 +39,9 @@
 #include <copyinout.h>
 #include <syscall.h>
 
+static int syscall_dispatch(struct trapframe *tf, int32_t *retval);
+static int multicall(const struct trapframe *tf, userptr_t calls,
+		     unsigned ncalls, int32_t *retval);
 
 /*
  * System call dispatcher.
@@ -76,11 +80,13 @@
  * values) further arguments must be fetched from the user-level
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
+ *
+ * The dispatching itself is done by syscall_dispatch, which
+ * multicall also uses to run each call in a batch.
  */
 void
 syscall(struct trapframe *tf)
 {
-	int callno;
 	int32_t retval;
 	int err;
 
@@ -88,8 +94,6 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
-	callno = tf->tf_v0;
-
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
 	 * really return a value, just 0 for success and -1 on
@@ -101,6 +105,52 @@ syscall(struct trapframe *tf)
 
 	retval = 0;
 
+	err = syscall_dispatch(tf, &retval);
+
+	if (err) {
+		/*
+		 * Return the error code. This gets converted at
+		 * userlevel to a return value of -1 and the error
+		 * code in errno.
+		 */
+		tf->tf_v0 = err;
+		tf->tf_a3 = 1;      /* signal an error */
+	}
+	else {
+		/* Success. */
+		tf->tf_v0 = retval;
+		tf->tf_a3 = 0;      /* signal no error */
+	}
+
+	/*
+	 * Now, advance the program counter, to avoid restarting
+	 * the syscall over and over again.
+	 */
+
+	tf->tf_epc += 4;
+
+	/* Make sure the syscall code didn't forget to lower spl */
+	KASSERT(curthread->t_curspl == 0);
+	/* ...or leak any spinlocks */
+	KASSERT(curthread->t_iplhigh_count == 0);
+}
+
+/*
+ * Run the system call described by TF (number in v0, arguments in
+ * a0-a3 and on the stack). Returns an error code, or 0 with the
+ * result in *RETVAL (and, for 64-bit results, v1 set directly).
+ */
+static
+int
+syscall_dispatch(struct trapframe *tf, int32_t *retvalp)
+{
+	int callno;
+	int32_t retval;
+	int err;
+
+	callno = tf->tf_v0;
+	retval = *retvalp;
+
 	/* note the casts to userptr_t */
 
 	switch (callno) {
@@ -113,6 +163,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -142,6 +197,10 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* file calls */
 
@@ -160,6 +219,10 @@ syscall(struct trapframe *tf)
 			&retval);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
 	    case SYS_close:
 		err = sys_close(tf->tf_a0);
 		break;
@@ -178,6 +241,84 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+	    case SYS_preadv:
+	    case SYS_pwritev:
+		{
+			/*
+			 * The offset is 64 bits wide and the first
+			 * three arguments use a0-a2, so it goes on the
+			 * stack in the next aligned pair of slots. This
+			 * is the same for all four calls.
+			 */
+			off_t offset;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &offset, sizeof(offset));
+			if (err) {
+				break;
+			}
+
+			switch (callno) {
+			    case SYS_pread:
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, offset, &retval);
+				break;
+			    case SYS_pwrite:
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, offset, &retval);
+				break;
+			    case SYS_preadv:
+				err = sys_preadv(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, offset, &retval);
+				break;
+			    default:
+				err = sys_pwritev(tf->tf_a0,
+						  (userptr_t)tf->tf_a1,
+						  tf->tf_a2, offset, &retval);
+				break;
+			}
+		}
+		break;
+
+	    case SYS_copy_file_range:
+		{
+			/* len and flags are the 5th and 6th arguments */
+			uint32_t stackargs[2];
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     stackargs, sizeof(stackargs));
+			if (err) {
+				break;
+			}
+
+			err = sys_copy_file_range(tf->tf_a0,
+						  (userptr_t)tf->tf_a1,
+						  tf->tf_a2,
+						  (userptr_t)tf->tf_a3,
+						  stackargs[0], stackargs[1],
+						  &retval);
+		}
+		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -211,6 +352,11 @@ syscall(struct trapframe *tf)
 		}
 		break;
 
+	    case SYS_poll:
+		err = sys_poll((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+			       &retval);
+		break;
+
 	    case SYS_chdir:
 		err = sys_chdir((userptr_t)tf->tf_a0);
 		break;
@@ -267,6 +413,32 @@ syscall(struct trapframe *tf)
                 err = sys_sbrk(tf->tf_a0, &retval);
                 break;
 
+	    /* userlevel synchronization */
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    /* asynchronous I/O */
+
+	    case SYS_io_setup:
+		err = sys_io_setup((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_io_enter:
+		err = sys_io_enter(tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    /* batching */
+
+	    case SYS_multicall:
+		err = multicall(tf, (userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
 
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
@@ -274,33 +446,117 @@ syscall(struct trapframe *tf)
 		break;
 	}
 
+	*retvalp = retval;
+	return err;
+}
 
-	if (err) {
-		/*
-		 * Return the error code. This gets converted at
-		 * userlevel to a return value of -1 and the error
-		 * code in errno.
-		 */
-		tf->tf_v0 = err;
-		tf->tf_a3 = 1;      /* signal an error */
-	}
-	else {
-		/* Success. */
-		tf->tf_v0 = retval;
-		tf->tf_a3 = 0;      /* signal no error */
+/*
+ * Check if a call can be run from multicall: it must return to the
+ * caller, take all its arguments in registers, and return at most 32
+ * bits. (See <kern/multicall.h>.)
+ *
+ * This is a list of the calls known to qualify, not of the ones known
+ * not to, so that a call added later that reads arguments from the
+ * user stack (which would find the multicall caller's frame instead)
+ * stays out until someone adds it here on purpose.
+ */
+static
+bool
+multicall_ok(int callno)
+{
+	switch (callno) {
+	    case SYS___time:
+	    case SYS_nanosleep:
+	    case SYS_waitpid:
+	    case SYS_getpid:
+	    case SYS_getrusage:
+	    case SYS_open:
+	    case SYS_dup2:
+	    case SYS_pipe:
+	    case SYS_close:
+	    case SYS_read:
+	    case SYS_write:
+	    case SYS_readv:
+	    case SYS_writev:
+	    case SYS_poll:
+	    case SYS_chdir:
+	    case SYS___getcwd:
+	    case SYS_sync:
+	    case SYS_mkdir:
+	    case SYS_rmdir:
+	    case SYS_remove:
+	    case SYS_link:
+	    case SYS_rename:
+	    case SYS_getdirentry:
+	    case SYS_fstat:
+	    case SYS_fsync:
+	    case SYS_ftruncate:
+	    case SYS_sbrk:
+	    case SYS_futex_wait:
+	    case SYS_futex_wake:
+	    case SYS_io_setup:
+	    case SYS_io_enter:
+		return true;
 	}
+	return false;
+}
 
-	/*
-	 * Now, advance the program counter, to avoid restarting
-	 * the syscall over and over again.
-	 */
+/*
+ * multicall: run NCALLS system calls from the array CALLS in order,
+ * within this one trap, stopping at the first failure. Each call is
+ * dispatched through a copy of the caller's trapframe with v0 and
+ * a0-a3 replaced. Returns the number that succeeded.
+ */
+static
+int
+multicall(const struct trapframe *tf, userptr_t calls, unsigned ncalls,
+	  int32_t *retval)
+{
+	struct mcall *mc;
+	struct trapframe calltf;
+	unsigned i, nout;
+	int err;
 
-	tf->tf_epc += 4;
+	if (ncalls > MULTICALL_MAX) {
+		return EINVAL;
+	}
+	mc = kmalloc(ncalls * sizeof(*mc));
+	if (mc == NULL) {
+		return ENOMEM;
+	}
+	err = copyin(calls, mc, ncalls * sizeof(*mc));
+	if (err) {
+		kfree(mc);
+		return err;
+	}
 
-	/* Make sure the syscall code didn't forget to lower spl */
-	KASSERT(curthread->t_curspl == 0);
-	/* ...or leak any spinlocks */
-	KASSERT(curthread->t_iplhigh_count == 0);
+	calltf = *tf;
+	for (i = 0; i < ncalls; i++) {
+		mc[i].mc_retval = 0;
+		if (!multicall_ok(mc[i].mc_callno)) {
+			mc[i].mc_err = EINVAL;
+			break;
+		}
+		calltf.tf_v0 = mc[i].mc_callno;
+		calltf.tf_a0 = mc[i].mc_args[0];
+		calltf.tf_a1 = mc[i].mc_args[1];
+		calltf.tf_a2 = mc[i].mc_args[2];
+		calltf.tf_a3 = mc[i].mc_args[3];
+		mc[i].mc_err = syscall_dispatch(&calltf, &mc[i].mc_retval);
+		if (mc[i].mc_err) {
+			break;
+		}
+	}
+
+	/* write back what ran, including the call that failed */
+	nout = i < ncalls ? i + 1 : ncalls;
+	err = copyout(mc, calls, nout * sizeof(*mc));
+	kfree(mc);
+	if (err) {
+		return err;
+	}
+	*retval = i;
+	return 0;
 }
 
 /*
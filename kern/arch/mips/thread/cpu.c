@@ -229,6 +229,24 @@ cpu_irqoff(void)
         SET_STATUS(x);
 }
 
+/*
+ * Cycle counter. $9 == c0_count, which counts up once per cycle
+ * (MIPS-II and up; System/161 has it).
+ */
+uint32_t
+cpu_cycles(void)
+{
+	uint32_t x;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (x));
+	return x;
+}
+
 /*
  * Used below.
  */
@@ -62,7 +62,7 @@
 /*
  * Wrap ram_stealmem in a spinlock.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock = SPINLOCK_QUEUED_INITIALIZER;
 
 void
 vm_bootstrap(void)
@@ -374,6 +374,16 @@ as_complete_load(struct addrspace *as)
 	return 0;
 }
 
+int
+as_share_page(struct addrspace *as, vaddr_t vaddr, vaddr_t kpage)
+{
+	/* dumbvm has no way to share frames; the caller copies instead */
+	(void)as;
+	(void)vaddr;
+	(void)kpage;
+	return ENOSYS;
+}
+
 int
 as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Whole-page zero and copy, for fresh frames and copy-on-write.
+ *
+ * Both addresses are page-aligned and the length is fixed, so unlike
+ * memcpy and bzero there's no alignment to sort out and no tail. We
+ * go a 32-byte cache line at a time, loading all eight words of a
+ * line into registers before storing any of them so the loads and
+ * stores aren't interleaved.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <vm.h>
+
+/* Words per cache line. */
+#define LINEWORDS	8
+
+void
+page_zero(vaddr_t page)
+{
+	uint32_t *p = (uint32_t *)page;
+	unsigned i;
+
+	KASSERT(page % PAGE_SIZE == 0);
+
+	for (i=0; i<PAGE_SIZE/sizeof(*p); i+=LINEWORDS) {
+		p[i+0] = 0;
+		p[i+1] = 0;
+		p[i+2] = 0;
+		p[i+3] = 0;
+		p[i+4] = 0;
+		p[i+5] = 0;
+		p[i+6] = 0;
+		p[i+7] = 0;
+	}
+}
+
+void
+page_copy(vaddr_t dst, vaddr_t src)
+{
+	uint32_t *d = (uint32_t *)dst;
+	const uint32_t *s = (const uint32_t *)src;
+	uint32_t t0, t1, t2, t3, t4, t5, t6, t7;
+	unsigned i;
+
+	KASSERT(dst % PAGE_SIZE == 0);
+	KASSERT(src % PAGE_SIZE == 0);
+
+	for (i=0; i<PAGE_SIZE/sizeof(*d); i+=LINEWORDS) {
+		t0 = s[i+0];
+		t1 = s[i+1];
+		t2 = s[i+2];
+		t3 = s[i+3];
+		t4 = s[i+4];
+		t5 = s[i+5];
+		t6 = s[i+6];
+		t7 = s[i+7];
+		d[i+0] = t0;
+		d[i+1] = t1;
+		d[i+2] = t2;
+		d[i+3] = t3;
+		d[i+4] = t4;
+		d[i+5] = t5;
+		d[i+6] = t6;
+		d[i+7] = t7;
+	}
+}
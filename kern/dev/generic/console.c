@@ -51,6 +51,7 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
+#include <spl.h>
 #include <cpu.h>
 #include <thread.h>
 #include <current.h>
@@ -174,6 +175,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollq_wakeup(&cs->cs_readq);
 }
 
 /*
@@ -247,10 +249,17 @@ con_io(struct device *dev, struct uio *uio)
 	int result;
 	char ch;
 	struct lock *lk;
+	int oldpri = PRI_NONE;
 
 	(void)dev;  // unused
 
+	/*
+	 * Interactive input is latency-sensitive: run the reader at
+	 * high priority, which it also lends to anyone holding the
+	 * read lock ahead of it.
+	 */
 	if (uio->uio_rw==UIO_READ) {
+		oldpri = thread_setpriority(PRI_MAX);
 		lk = con_userlock_read;
 	}
 	else {
@@ -260,6 +269,7 @@ con_io(struct device *dev, struct uio *uio)
 	KASSERT(lk != NULL);
 	lock_acquire(lk);
 
+	result = 0;
 	while (uio->uio_resid > 0) {
 		if (uio->uio_rw==UIO_READ) {
 			ch = getch();
@@ -268,8 +278,7 @@ con_io(struct device *dev, struct uio *uio)
 			}
 			result = uiomove(&ch, 1, uio);
 			if (result) {
-				lock_release(lk);
-				return result;
+				break;
 			}
 			if (ch=='\n') {
 				break;
@@ -278,8 +287,7 @@ con_io(struct device *dev, struct uio *uio)
 		else {
 			result = uiomove(&ch, 1, uio);
 			if (result) {
-				lock_release(lk);
-				return result;
+				break;
 			}
 			if (ch=='\n') {
 				putch('\r');
@@ -288,7 +296,11 @@ con_io(struct device *dev, struct uio *uio)
 		}
 	}
 	lock_release(lk);
-	return 0;
+
+	if (oldpri != PRI_NONE) {
+		thread_setpriority(oldpri);
+	}
+	return result;
 }
 
 static
@@ -302,10 +314,58 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Check if a read would complete without waiting. con_io reads up
+ * to the end of a line, so that means a whole line is buffered (or
+ * the buffer is full and no more input can arrive until someone
+ * reads).
+ */
+static
+bool
+con_haveline(struct con_softc *cs)
+{
+	unsigned i, head, tail;
+	bool ret;
+	int spl;
+
+	/* keep con_input out while we look */
+	spl = splhigh();
+	head = cs->cs_gotchars_head;
+	tail = cs->cs_gotchars_tail;
+	ret = (head + 1) % CONSOLE_INPUT_BUFFER_SIZE == tail;
+	for (i = tail; !ret && i != head;
+	     i = (i + 1) % CONSOLE_INPUT_BUFFER_SIZE) {
+		if (cs->cs_gotchars[i] == '\n' || cs->cs_gotchars[i] == '\r') {
+			ret = true;
+		}
+	}
+	splx(spl);
+	return ret;
+}
+
+static
+int
+con_poll(struct device *dev, int events, struct pollset *ps)
+{
+	struct con_softc *cs = dev->d_data;
+	int revents;
+
+	/* output waits only for the hardware, which is always coming */
+	revents = POLLOUT | POLLWRNORM;
+	if (events & (POLLIN | POLLRDNORM)) {
+		pollset_add(ps, &cs->cs_readq);
+	}
+	if (con_haveline(cs)) {
+		revents |= POLLIN | POLLRDNORM;
+	}
+	return revents;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +446,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollq_init(&cs->cs_readq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
@@ -37,6 +37,7 @@
 #include <uio.h>
 #include <membar.h>
 #include <synch.h>
+#include <cpu.h>
 #include <platform/bus.h>
 #include <vfs.h>
 #include <lamebus/lhd.h>
@@ -242,6 +243,8 @@ lhd_io(struct device *d, struct uio *uio)
 
 		/* Get the result value saved by the interrupt handler. */
 		result = lh->lh_result;
+		cpustat_inc(uio->uio_rw == UIO_READ ?
+			    CS_DISKREADS : CS_DISKWRITES);
 
 		/*
 		 * Are we reading? If so, and if we succeeded,
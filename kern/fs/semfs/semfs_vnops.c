@@ -136,7 +136,8 @@ semfs_getsem(struct semfs_vnode *semv)
  * Wakeup helper. We only need to wake up if there are sleepers, which
  * should only be the case if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. Pollers are woken on the same 0 -> nonzero
+ * transition.
  */
 static
 void
@@ -151,6 +152,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollq_wakeup(&sem->sems_pollq);
 }
 
 /*
@@ -291,6 +293,33 @@ semfs_truncate(struct vnode *vn, off_t len)
 	return 0;
 }
 
+/*
+ * Poll. A semaphore is readable (P won't block) when its count is
+ * nonzero, and always writable.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, struct pollset *ps)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+	int revents;
+
+	sem = semfs_getsem(semv);
+
+	revents = POLLOUT | POLLWRNORM;
+	lock_acquire(sem->sems_lock);
+	if (events & (POLLIN | POLLRDNORM)) {
+		pollset_add(ps, &sem->sems_pollq);
+	}
+	if (sem->sems_count > 0) {
+		revents |= POLLIN | POLLRDNORM;
+	}
+	lock_release(sem->sems_lock);
+
+	return revents;
+}
+
 ////////////////////////////////////////////////////////////
 // directory ops
 
@@ -666,6 +695,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
 	.vop_namefile = semfs_namefile,
+	.vop_poll = vopnull_poll,
 
 	.vop_creat = semfs_creat,
 	.vop_symlink = vopfail_symlink_nosys,
@@ -699,6 +729,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = semfs_poll,
 
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
@@ -108,6 +108,11 @@ struct region {
  *    as_complete_load - this is called when loading from an executable
  *                is complete.
  *
+ *    as_share_page - map a (page-aligned, whole-page) kernel buffer
+ *                read-only into the address space at VADDR, sharing
+ *                it with whoever else maps it, instead of copying it.
+ *                Returns ENOSYS if the VM system can't do this.
+ *
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
@@ -129,6 +134,8 @@ int               as_define_region(struct addrspace *as,
                                    int executable);
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
+int               as_share_page(struct addrspace *as, vaddr_t vaddr,
+                                vaddr_t kpage);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
 int               region_type(struct addrspace *as, vaddr_t addr);
@@ -54,6 +54,12 @@
  * addressing error was encountered, or (for the string versions)
  * ENAMETOOLONG if the space available was insufficient.
  *
+ * copyinv and copyoutv do the same as copyin and copyout for each of
+ * NSEGS segments, but check all the addresses first and set up fault
+ * recovery only once. Use them for fetching or returning several
+ * small values in one system call. If any address is bad, nothing is
+ * copied; a fault partway through may leave earlier segments copied.
+ *
  * NOTE that the order of the arguments is the same as bcopy() or
  * cp/mv, that is, source on the left, NOT the same as strcpy().
  * The const qualifiers and types will help protect against mistakes
@@ -64,10 +70,19 @@
  * vm/copyinout.c.
  */
 
+/* One segment of a copyinv/copyoutv. */
+struct copyseg {
+	userptr_t cs_uaddr;	/* user address */
+	void *cs_kaddr;		/* kernel address */
+	size_t cs_len;		/* length in bytes */
+};
+
 int copyin(const_userptr_t usersrc, void *dest, size_t len);
 int copyout(const void *src, userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
+int copyinv(const struct copyseg *segs, unsigned nsegs);
+int copyoutv(const struct copyseg *segs, unsigned nsegs);
 
 
 #endif /* _COPYINOUT_H_ */
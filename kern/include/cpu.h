@@ -35,6 +35,27 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+struct workqueue; /* Opaque; see workqueue.h */
+struct addrspace; /* see addrspace.h */
+struct timerwheel; /* Opaque; see timer.h */
+
+
+/*
+ * Per-cpu statistics counters. Each cpu counts its own events
+ * without locking (see cpustat_inc); readers sum across all cpus.
+ */
+enum cpustat {
+	CS_INTERRUPTS,		/* hardware interrupts taken */
+	CS_SYSCALLS,		/* system calls */
+	CS_VMFAULTS,		/* calls to vm_fault (TLB misses etc.) */
+	CS_ZEROFILLS,		/* pages allocated on first touch */
+	CS_COWCOPIES,		/* pages copied on write */
+	CS_CSWITCHES,		/* context switches */
+	CS_DISKREADS,		/* disk sectors read */
+	CS_DISKWRITES,		/* disk sectors written */
+	CS_SHOOTDOWNS,		/* TLB shootdown requests sent */
+	CS_NSTATS		/* (number of counters) */
+};
 
 /*
  * Per-cpu structure
@@ -60,7 +81,21 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	struct timerwheel *c_timerwheel; /* Pending timers (own lock) */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	bool c_intruser;		/* Interrupt came from user mode */
+	struct threadlist c_threadcache; /* Dead threads kept for reuse */
+	unsigned c_threadcache_count;	/* Number of threads in cache */
+	unsigned c_stats[CS_NSTATS];	/* Event counters (others may read) */
+
+	/*
+	 * The address space whose mappings may be in this cpu's TLB:
+	 * the last one activated, since as_activate flushes the TLB.
+	 * Written only by this cpu; read by others to decide who
+	 * needs a TLB shootdown. It may point to a destroyed address
+	 * space, so it must only ever be compared, never followed.
+	 */
+	struct addrspace *volatile c_tlbas;
 
 	/*
 	 * Accessed by other cpus.
@@ -70,6 +105,19 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * RCU state (see rcu.c). Written only by this cpu; read by
+	 * others waiting for a grace period.
+	 */
+	volatile unsigned c_rcu_qs;	/* Grace period at last quiescent state */
+	volatile bool c_rcu_online;	/* Taking part in grace periods */
+
+	/*
+	 * Deferred work for this cpu (see workqueue.h). Set once at
+	 * startup; the queue has its own lock.
+	 */
+	struct workqueue *c_workqueue;
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -82,12 +130,27 @@ struct cpu {
 	 * The contents of struct tlbshootdown are also machine-
 	 * dependent and might reasonably be either an address space
 	 * and vaddr pair, or a paddr, or something else.
+	 *
+	 * If the queue overflows, c_shootdown_all is set instead and
+	 * the whole TLB is flushed. c_shootdown_gen counts the times
+	 * the queue has been processed; initiators wait for it to
+	 * change (see ipi_tlbshootdown_wait).
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	unsigned c_numshootdown;
+	bool c_shootdown_all;
+	volatile unsigned c_shootdown_gen;
 	struct spinlock c_ipi_lock;
 
+	/*
+	 * Queue nodes for the queued spinlocks this cpu holds or is
+	 * waiting for. Allocated and freed only by this cpu (with
+	 * interrupts off), but the other cpus in line with us write
+	 * qn_next and qn_wait.
+	 */
+	struct spinlock_qnode c_qnodes[SPINLOCK_NQNODES];
+
 	/*
 	 * Accessed by other cpus. Protected inside hangman.c.
 	 */
@@ -112,6 +175,26 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Return cpu number N (in software numbering), or NULL if there
+ * aren't that many. CPUs are only added during boot, so callers
+ * after that need no locking.
+ */
+struct cpu *cpu_get(unsigned n);
+
+/*
+ * Per-cpu statistics.
+ *
+ * cpustat_inc bumps a counter on the current cpu. It is safe to call
+ * from any context, including interrupt handlers.
+ *
+ * cpustat_get returns the sum of a counter across all cpus.
+ * cpustat_print prints all the counters for each cpu, plus totals.
+ */
+void cpustat_inc(enum cpustat which);
+unsigned cpustat_get(enum cpustat which);
+void cpustat_print(void);
+
 /*
  * Produce a string describing the CPU type.
  */
@@ -125,6 +208,12 @@ void cpu_identify(char *buf, size_t max);
 void cpu_irqoff(void);
 void cpu_irqon(void);
 
+/*
+ * Read the current CPU's free-running cycle counter. It wraps, so
+ * only differences between readings are meaningful.
+ */
+uint32_t cpu_cycles(void);
+
 /*
  * Idle or shut down (respectively) the processor.
  *
@@ -155,6 +244,10 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * It returns a ticket; ipi_tlbshootdown_wait(target, ticket) waits
+ * until the target has done the shootdown. It may be called at any
+ * spl; while it waits it does any shootdowns queued for the waiting
+ * CPU, so two cpus shooting at each other don't deadlock.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -168,7 +261,9 @@ void cpu_halt(void);
 
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
-void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown(struct cpu *target,
+			  const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket);
 
 void interprocessor_interrupt(void);
 
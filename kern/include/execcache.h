@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _EXECCACHE_H_
+#define _EXECCACHE_H_
+
+/*
+ * Executable image cache.
+ *
+ * Programs that are exec'd over and over (the shell running the same
+ * testbin in a loop, farm, multiexec, etc.) pay for re-reading and
+ * re-parsing the ELF headers and re-reading every loadable segment
+ * from the filesystem on each exec. The exec image cache keeps the
+ * parsed segment table and the file-backed bytes of each loadable
+ * segment in kernel memory, keyed by vnode, so a repeat exec can set
+ * up the address space and copy the segments straight out of memory.
+ *
+ * The cache does not hold a reference to the vnode. Instead the vnode
+ * carries a flag (vn_execcached) that is set while the cache has an
+ * image of it; writes, truncates, and vnode destruction check the
+ * flag and call execcache_invalidate, so files that aren't cached
+ * never touch the cache lock. Fills that race with a write are
+ * detected with the vnode's write count (vn_writegen) and are simply
+ * not inserted.
+ *
+ * Images are refcounted: the cache holds one reference, and each exec
+ * using the image holds another while it copies out, so eviction or
+ * invalidation never frees an image out from under a loader.
+ *
+ * Each page of segment data is a whole page from kmalloc, i.e. a
+ * frame of its own. Read-only segments are not copied at all: their
+ * cache pages are mapped straight into each process (as_share_page),
+ * so every process running the program shares one copy of its text.
+ * The frames are refcounted by the VM system and outlive the cache
+ * entry if it is evicted while processes still map them.
+ *
+ * The cache holds up to EXECCACHE_BUDGET pages that nothing else can
+ * free, so when the page allocator runs out of frames it calls
+ * execcache_reclaim to empty the cache before giving up.
+ */
+
+struct vnode;
+
+/* Limits on what gets cached. Bigger images are loaded the old way. */
+#define EXECCACHE_MAXSEGS	4	/* loadable segments per image */
+#define EXECCACHE_MAXPAGES	32	/* pages of segment data per image */
+#define EXECCACHE_SLOTS		8	/* images in the cache */
+#define EXECCACHE_BUDGET	96	/* pages of segment data in total */
+
+/* One loadable (PT_LOAD) segment. */
+struct execseg {
+	vaddr_t es_vaddr;		/* where it goes */
+	size_t es_memsz;		/* size in memory */
+	size_t es_filesz;		/* bytes that come from the file */
+	off_t es_offset;		/* where those bytes are in the file */
+	uint32_t es_flags;		/* PF_R/PF_W/PF_X */
+	unsigned es_firstpage;		/* index of first page in ei_pages */
+	bool es_shared;			/* map cache pages, don't copy */
+};
+
+struct execimage {
+	struct vnode *ei_vnode;		/* file it came from (not a ref) */
+	unsigned ei_refcount;		/* cache + loaders using it */
+	unsigned ei_lastuse;		/* LRU stamp */
+	vaddr_t ei_entry;		/* initial PC */
+	unsigned ei_nsegs;
+	struct execseg ei_segs[EXECCACHE_MAXSEGS];
+	unsigned ei_npages;
+	void *ei_pages[EXECCACHE_MAXPAGES];	/* segment bytes, by page */
+};
+
+/* Create an empty image for V with one reference, or NULL. */
+struct execimage *execimage_create(struct vnode *v);
+
+void execcache_bootstrap(void);
+
+/*
+ * Look V up. On a hit, returns the image with a reference added. On a
+ * miss, returns NULL and returns in GEN the write count to pass to
+ * execcache_insert once the image is read.
+ */
+struct execimage *execcache_lookup(struct vnode *v, unsigned *gen);
+
+/*
+ * Offer a freshly read image to the cache. It is inserted (with a new
+ * reference) only if the file hasn't been written since GEN. The
+ * caller's reference is untouched either way.
+ */
+void execcache_insert(struct execimage *img, unsigned gen);
+
+/* Drop a reference; frees the image when the last one goes. */
+void execcache_release(struct execimage *img);
+
+/* Forget anything cached for V. Called when V changes or goes away. */
+void execcache_invalidate(struct vnode *v);
+
+/*
+ * Throw away every cached image, to give memory back. Returns true if
+ * that freed anything. Does nothing (and returns false) if called
+ * where it can't sleep (in an interrupt, holding a spinlock, or with
+ * interrupts off), so the page allocator can call it anywhere.
+ */
+bool execcache_reclaim(void);
+
+#endif /* _EXECCACHE_H_ */
@@ -33,37 +33,106 @@
 /*
  * Simple deadlock detector. Enable with "options hangman" in the
  * kernel config.
+ *
+ * The same hooks also drive the lock profiler (see lockprof.h),
+ * enabled with "options lockprof". With neither option, everything
+ * here compiles to nothing.
  */
 
 #include "opt-hangman.h"
+#include "opt-lockprof.h"
 
-#if OPT_HANGMAN
+#if OPT_HANGMAN || OPT_LOCKPROF
+
+struct lockprof_class;	/* Opaque; in lockprof.c */
 
 struct hangman_actor {
 	const char *a_name;
+#if OPT_HANGMAN
 	const struct hangman_lockable *a_waiting;
+#endif
+#if OPT_LOCKPROF
+	uint32_t a_waitstart;		/* cycle count at HANGMAN_WAIT */
+	bool a_contended;		/* lockable was held at HANGMAN_WAIT */
+#endif
 };
 
 struct hangman_lockable {
 	const char *l_name;
+#if OPT_HANGMAN
 	const struct hangman_actor *l_holding;
+#endif
+#if OPT_LOCKPROF
+	const void *l_site;		/* who initialized it */
+	struct lockprof_class *l_class;	/* stats; looked up on first use */
+	uint32_t l_holdstart;		/* cycle count at HANGMAN_ACQUIRE */
+	bool l_held;
+#endif
 };
 
+#if OPT_HANGMAN
 void hangman_wait(struct hangman_actor *a, struct hangman_lockable *l);
 void hangman_acquire(struct hangman_actor *a, struct hangman_lockable *l);
 void hangman_release(struct hangman_actor *a, struct hangman_lockable *l);
+void hangman_giveup(struct hangman_actor *a, struct hangman_lockable *l);
+#define HANGMAN_HOOK(f, a, l)	f(a, l)
+#else
+#define HANGMAN_HOOK(f, a, l)	((void)0)
+#endif
+
+#if OPT_LOCKPROF
+void lockprof_wait(struct hangman_actor *a, struct hangman_lockable *l);
+void lockprof_acquire(struct hangman_actor *a, struct hangman_lockable *l);
+void lockprof_release(struct hangman_actor *a, struct hangman_lockable *l);
+void lockprof_giveup(struct hangman_actor *a, struct hangman_lockable *l);
+#define LOCKPROF_HOOK(f, a, l)	f(a, l)
+#else
+#define LOCKPROF_HOOK(f, a, l)	((void)0)
+#endif
 
 #define HANGMAN_ACTOR(sym)	struct hangman_actor sym
 #define HANGMAN_LOCKABLE(sym)	struct hangman_lockable sym
 
+#if OPT_HANGMAN
 #define HANGMAN_ACTORINIT(a, n)	    ((a)->a_name = (n), (a)->a_waiting = NULL)
-#define HANGMAN_LOCKABLEINIT(l, n)  ((l)->l_name = (n), (l)->l_holding = NULL)
+#else
+#define HANGMAN_ACTORINIT(a, n)	    ((a)->a_name = (n))
+#endif
+
+/*
+ * The lock profiler keys its statistics on the lockable's name and
+ * on the caller of the function doing the init (lock_create,
+ * spinlock_init, etc.), so this must be used directly in that
+ * function.
+ */
+#if OPT_LOCKPROF
+#define HANGMAN_LOCKABLEINIT(l, n)  \
+	((l)->l_name = (n), HANGMAN_HOOK_LOCKABLEINIT(l), \
+	 (l)->l_site = __builtin_return_address(0), (l)->l_class = NULL, \
+	 (l)->l_holdstart = 0, (l)->l_held = false)
+#else
+#define HANGMAN_LOCKABLEINIT(l, n)  \
+	((l)->l_name = (n), HANGMAN_HOOK_LOCKABLEINIT(l))
+#endif
+#if OPT_HANGMAN
+#define HANGMAN_HOOK_LOCKABLEINIT(l)	((l)->l_holding = NULL)
+#else
+#define HANGMAN_HOOK_LOCKABLEINIT(l)	((void)0)
+#endif
 
-#define HANGMAN_LOCKABLE_INITIALIZER	{ "spinlock", NULL }
+#define HANGMAN_LOCKABLE_INITIALIZER	{ .l_name = "spinlock" }
 
-#define HANGMAN_WAIT(a, l)	hangman_wait(a, l)
-#define HANGMAN_ACQUIRE(a, l)	hangman_acquire(a, l)
-#define HANGMAN_RELEASE(a, l)	hangman_release(a, l)
+#define HANGMAN_WAIT(a, l) \
+	(HANGMAN_HOOK(hangman_wait, a, l), LOCKPROF_HOOK(lockprof_wait, a, l))
+#define HANGMAN_ACQUIRE(a, l) \
+	(LOCKPROF_HOOK(lockprof_acquire, a, l), \
+	 HANGMAN_HOOK(hangman_acquire, a, l))
+#define HANGMAN_RELEASE(a, l) \
+	(LOCKPROF_HOOK(lockprof_release, a, l), \
+	 HANGMAN_HOOK(hangman_release, a, l))
+#define HANGMAN_GIVEUP(a, l) \
+	(LOCKPROF_HOOK(lockprof_giveup, a, l), \
+	 HANGMAN_HOOK(hangman_giveup, a, l))
 
 #else
 
@@ -78,6 +147,7 @@ void hangman_release(struct hangman_actor *a, struct hangman_lockable *l);
 #define HANGMAN_WAIT(a, l)
 #define HANGMAN_ACQUIRE(a, l)
 #define HANGMAN_RELEASE(a, l)
+#define HANGMAN_GIVEUP(a, l)
 
 #endif
 
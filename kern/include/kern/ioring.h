@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_IORING_H_
+#define _KERN_IORING_H_
+
+/*
+ * Asynchronous I/O rings, used with io_setup() and io_enter().
+ *
+ * Userland allocates a struct io_rings and two arrays of entries, a
+ * submission queue (SQ) and a completion queue (CQ), fills in their
+ * sizes and addresses, and registers them with io_setup(). Requests
+ * are queued by filling in SQ entries and advancing ir_sqtail; one
+ * io_enter() call hands any number of them to the kernel and collects
+ * whatever has finished, which shows up as CQ entries between
+ * ir_cqhead and ir_cqtail.
+ *
+ * The four indexes run freely and are reduced modulo the ring sizes,
+ * which must be powers of 2. Userland owns ir_sqtail and ir_cqhead;
+ * the kernel owns ir_sqhead and ir_cqtail, and only changes them (or
+ * looks at the rings at all) during io_enter.
+ */
+
+/* Operations */
+#define IO_OP_NOP	0	/* do nothing; completes at once */
+#define IO_OP_READ	1	/* like pread */
+#define IO_OP_WRITE	2	/* like pwrite */
+#define IO_OP_FSYNC	3	/* like fsync */
+#define IO_OP_OPEN	4	/* like open; result is the new fd */
+
+/* Largest ring, in entries */
+#define IO_MAXENTRIES	256
+
+/* Largest single read or write; longer ones complete short */
+#define IO_MAXIO	(64*1024)
+
+/*
+ * Submission queue entry.
+ *
+ * Reads and writes happen at sqe_offset (which is ignored for objects
+ * that can't seek, like the console) and never use or change the
+ * file's seek position. For IO_OP_OPEN, sqe_buf is the pathname and
+ * sqe_openflags and sqe_mode are as for open().
+ *
+ * As with struct iovec, the kernel sees the buffer as a userptr_t.
+ */
+struct io_sqe {
+	off_t sqe_offset;		/* file position */
+	__u64 sqe_userdata;		/* copied to the completion */
+#ifdef _KERNEL
+	userptr_t sqe_ubuf;		/* buffer or pathname */
+#else
+	void *sqe_buf;			/* buffer or pathname */
+#endif
+	size_t sqe_len;			/* buffer length */
+	int sqe_op;			/* IO_OP_* */
+	int sqe_fd;			/* file handle */
+	int sqe_openflags;		/* IO_OP_OPEN: flags */
+	mode_t sqe_mode;			/* IO_OP_OPEN: mode */
+};
+
+/*
+ * Completion queue entry. cqe_res is what the corresponding system
+ * call would have returned, or a negated errno code if it failed.
+ */
+struct io_cqe {
+	__u64 cqe_userdata;		/* from the submission */
+	int cqe_res;			/* result or -errno */
+	int cqe_pad;
+};
+
+/*
+ * The rings' control block.
+ */
+struct io_rings {
+	unsigned ir_sqhead;		/* next SQ entry the kernel takes */
+	unsigned ir_sqtail;		/* next SQ entry userland fills */
+	unsigned ir_cqhead;		/* next CQ entry userland takes */
+	unsigned ir_cqtail;		/* next CQ entry the kernel fills */
+	unsigned ir_sqentries;		/* SQ size (power of 2) */
+	unsigned ir_cqentries;		/* CQ size (power of 2) */
+#ifdef _KERNEL
+	userptr_t ir_usqes;		/* SQ entries */
+	userptr_t ir_ucqes;		/* CQ entries */
+#else
+	struct io_sqe *ir_sqes;		/* SQ entries */
+	struct io_cqe *ir_cqes;		/* CQ entries */
+#endif
+};
+
+#endif /* _KERN_IORING_H_ */
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_MULTICALL_H_
+#define _KERN_MULTICALL_H_
+
+/*
+ * Batched system calls, used with multicall().
+ *
+ * Each entry names a system call and its first four (register)
+ * arguments, exactly as they'd be passed in a0-a3; a 64-bit argument
+ * takes an aligned pair. multicall() runs the entries in order and
+ * fills in each one's result, stopping at the first that fails. It
+ * returns how many succeeded; if that's less than the number given,
+ * the next entry's mc_err says why it failed.
+ *
+ * Only calls that return to the caller, take all their arguments in
+ * a0-a3, and return at most 32 bits can be batched, and only those
+ * the kernel lists as such; anything else fails with EINVAL. So
+ * fork, execv, _exit, reboot, lseek, pread and friends,
+ * copy_file_range, and multicall itself are out.
+ */
+
+#include <kern/types.h>
+
+struct mcall {
+	int mc_callno;			/* system call number */
+	__i32 mc_args[4];		/* arguments (a0-a3) */
+	__i32 mc_retval;		/* result, if it succeeded */
+	int mc_err;			/* 0, or the error code */
+};
+
+/* Most entries in one multicall() */
+#define MULTICALL_MAX	64
+
+#endif /* _KERN_MULTICALL_H_ */
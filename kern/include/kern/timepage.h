@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_TIMEPAGE_H_
+#define _KERN_TIMEPAGE_H_
+
+/*
+ * The time page: a page the kernel maps read-only into every process
+ * at exec, so the time of day can be read without a system call. Its
+ * user address is passed to the program's entry point in a3 (0 if
+ * there isn't one, in which case use __time).
+ *
+ * The kernel updates the page every hardclock tick, so the time in
+ * it is only good to 1/tp_hz of a second. To read it consistently:
+ *
+ *    do {
+ *        seq = tp_seq;
+ *        (memory barrier)
+ *        ...read the fields you want...
+ *        (memory barrier)
+ *    } while ((seq & 1) || tp_seq != seq);
+ *
+ * tp_seq is odd while an update is in progress and changes with every
+ * update.
+ */
+
+struct timepage {
+	__u32 tp_seq;			/* sequence count */
+	__u32 tp_hz;			/* ticks per second */
+	__u32 tp_ticks;			/* ticks since boot */
+	__u32 tp_nsec;			/* time of day: nanoseconds */
+	__i64 tp_sec;			/* time of day: seconds */
+};
+
+#endif /* _KERN_TIMEPAGE_H_ */
@@ -59,6 +59,9 @@ struct openfile {
 	int of_refcount;
 };
 
+/* wrap an open vnode (takes over the caller's reference to it) */
+struct openfile *openfile_create(struct vnode *vn, int accmode);
+
 /* open a file (args must be kernel pointers; destroys filename) */
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Readiness notification, for poll().
+ *
+ * An object that can make a reader or writer wait (a pipe end, the
+ * console, a semaphore) embeds a struct pollq for each condition it
+ * can become ready on, and calls pollq_wakeup after any change that
+ * might make it ready. Its VOP_POLL attaches the poll call's pollset
+ * to the right queue(s) with pollset_add, *then* looks at its state;
+ * that way a change between the check and poll going to sleep still
+ * wakes poll up.
+ * The pollset passed may be NULL (poll is only rechecking); pollset_add
+ * ignores that, so VOP_POLL need not check.
+ *
+ * An object may attach a pollset to at most POLL_MAXQUEUES queues
+ * per call. Pollsets are only attached while poll holds a reference
+ * to the object, so a queue is always empty when its object is
+ * destroyed.
+ *
+ * pollq_wakeup uses only spinlocks, and may be called from interrupt
+ * handlers.
+ */
+
+#include <kern/poll.h>
+#include <spinlock.h>
+
+/* Most queues one object can attach one pollset to. */
+#define POLL_MAXQUEUES	2
+
+struct pollset;		/* Opaque; one per poll call. */
+struct pollent;		/* Opaque; links a pollset onto a pollq. */
+
+struct pollq {
+	struct spinlock pq_lock;	/* protects pq_head */
+	struct pollent *pq_head;	/* attached pollsets */
+};
+
+void pollq_init(struct pollq *pq);
+void pollq_cleanup(struct pollq *pq);
+void pollq_wakeup(struct pollq *pq);
+
+void pollset_add(struct pollset *ps, struct pollq *pq);
+
+#endif /* _POLL_H_ */
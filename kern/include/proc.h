@@ -38,10 +38,30 @@
 
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
+#include <workqueue.h>
 
 struct addrspace;
+struct ioring;
 struct vnode;
 
+/*
+ * Resource usage counters (see getrusage). Each is updated only by the
+ * process's own thread, or by interrupts on the cpu it's running on,
+ * so they're just incremented in place without locking.
+ */
+struct proc_rusage {
+	unsigned pr_utime;		/* hardclock ticks in user mode */
+	unsigned pr_stime;		/* hardclock ticks in the kernel */
+	unsigned pr_nvcsw;		/* voluntary context switches */
+	unsigned pr_nivcsw;		/* involuntary context switches */
+	unsigned pr_tlbrefills;		/* faults that only reloaded the TLB */
+	unsigned pr_minflt;		/* faults that allocated a zero page */
+	unsigned pr_cowflt;		/* faults that broke copy-on-write */
+	unsigned pr_majflt;		/* faults that had to read from disk */
+	uint64_t pr_inbytes;		/* bytes read by read() */
+	uint64_t pr_outbytes;		/* bytes written by write() */
+};
+
 /*
  * Process structure.
  *
@@ -65,6 +85,16 @@ struct proc {
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
 
+	/* Asynchronous I/O; only our own thread touches this */
+	struct ioring *p_ioring;	/* registered I/O rings, or NULL */
+
+	/* Teardown after exit; see proc_exit */
+	struct work p_reapwork;
+
+	/* Accounting */
+	struct proc_rusage p_ru;	/* our own usage */
+	struct proc_rusage p_cru;	/* usage of reaped children */
+
 	/* add more material here as needed */
 };
 
@@ -77,6 +107,9 @@ void proc_bootstrap(void);
 /* Create a fresh process for use by runprogram(). */
 int proc_create_runprogram(const char *name, struct proc **ret);
 
+/* Create a process for a kernel worker thread. */
+int proc_create_worker(const char *name, struct proc **ret);
+
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
@@ -95,12 +128,18 @@ void proc_destroy(struct proc *proc);
  */
 void proc_exit(int status);
 
+/* Make a worker thread exit and destroy its process. */
+void proc_exitworker(void);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/* Add the counters in FROM to TO. */
+void proc_rusage_add(struct proc_rusage *to, const struct proc_rusage *from);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _RCU_H_
+#define _RCU_H_
+
+/*
+ * Read-copy-update, quiescent-state-based flavor.
+ *
+ * For data that is read all the time and changed rarely. Readers
+ * bracket their accesses with rcu_read_lock/rcu_read_unlock, which
+ * only bump a counter in curthread: no locks, no atomic operations,
+ * no shared cache lines. Writers (which must exclude each other by
+ * some other means, e.g. a lock) never modify anything a reader can
+ * see in place: they build a new copy, publish it with
+ * rcu_assign_pointer, and free the old one only after a grace
+ * period, either by waiting with synchronize_rcu or by handing it to
+ * call_rcu.
+ *
+ * A grace period ends once every cpu has passed a quiescent state,
+ * which is any call to thread_switch (including the one hardclock
+ * makes every tick, and including idling). Hence the rules for
+ * readers:
+ *    - a read-side section may not sleep or yield;
+ *    - while one is open, hardclock will not preempt the thread
+ *      (so keep them short);
+ *    - pointers obtained inside must not be used after
+ *      rcu_read_unlock, unless they are otherwise known to be
+ *      stable.
+ * Read-side sections nest, and may be used in interrupt handlers.
+ *
+ * synchronize_rcu sleeps and may not be called from an interrupt
+ * handler, with a spinlock held, or inside a read-side section.
+ * call_rcu may be called anywhere; FUNC(DATA) is run later, from a
+ * workqueue thread, after a grace period. rcu_barrier waits for all
+ * previously queued callbacks to have run.
+ */
+
+#include <membar.h>
+#include <thread.h>
+#include <current.h>
+
+#define rcu_read_lock()		((void)curthread->t_rcu_nesting++)
+#define rcu_read_unlock() \
+	(KASSERT(curthread->t_rcu_nesting > 0), \
+	 (void)curthread->t_rcu_nesting--)
+
+/*
+ * Publish and fetch an RCU-protected pointer. The barrier orders the
+ * initialization of the new object before the pointer store. (The
+ * reader side needs nothing on MIPS, which doesn't reorder dependent
+ * loads; the volatile read keeps the compiler from refetching.)
+ */
+#define rcu_assign_pointer(p, v)  (membar_store_store(), (p) = (v))
+#define rcu_dereference(p)	  (*(volatile __typeof__(p) *)&(p))
+
+struct rcu_head {
+	void (*rh_func)(void *);
+	void *rh_data;
+	struct rcu_head *rh_next;
+};
+
+void synchronize_rcu(void);
+void call_rcu(struct rcu_head *rh, void (*func)(void *), void *data);
+void rcu_barrier(void);
+
+/*
+ * Hooks for the thread system: rcu_quiescent is called from
+ * thread_switch; rcu_cpu_online is called on each cpu once it is
+ * ready to run threads.
+ */
+void rcu_quiescent(void);
+void rcu_cpu_online(void);
+
+#endif /* _RCU_H_ */
@@ -46,11 +46,47 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+/*
+ * Queue node for queued (MCS) spinlocks. A waiting CPU spins on
+ * qn_wait in its own node, and the CPU ahead of it in line clears
+ * that flag to hand the lock over. Nodes are padded and aligned to
+ * a cache line, so that no two share one and a waiter's spinning
+ * doesn't disturb anyone else.
+ *
+ * Each cpu has a pool of SPINLOCK_NQNODES of them; see cpu.h. A cpu
+ * needs one per queued spinlock it holds or is waiting for. Since
+ * spinlocks block interrupts, these nest only along the lock order,
+ * and the deepest nesting in the kernel is four (a CV's wait channel
+ * lock, its sleep lock's spinlock, pi_lock, and a run queue lock), so
+ * eight leaves room. If the pool does run dry anyway, the acquire
+ * falls back to a plain test-and-set spin on the lock word.
+ */
+#define SPINLOCK_QNODE_SIZE	64
+#define SPINLOCK_NQNODES	8
+
+struct spinlock_qnode {
+	struct spinlock_qnode *volatile qn_next; /* Next CPU in line */
+	volatile bool qn_wait;		/* True until we get the lock */
+	bool qn_inuse;			/* Allocated from the pool */
+	char qn_pad[SPINLOCK_QNODE_SIZE - sizeof(void *) - 2*sizeof(bool)];
+} __ALIGNED(SPINLOCK_QNODE_SIZE);
+
 /*
  * Basic spinlock.
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * An ordinary spinlock is a test-and-test-and-set loop on splk_lock.
+ * A queued spinlock (spinlock_init_queued) is an MCS lock: splk_lock
+ * holds the address of the last queue node in line, or 0 if the lock
+ * is free, and waiters are served in FIFO order, each spinning on its
+ * own node. That costs an extra atomic operation when uncontended but
+ * avoids every waiter hammering the one word, so it's worth it for
+ * locks that all the CPUs fight over (run queues, wait channels, the
+ * page allocator). A CPU with no queue node to spare instead waits
+ * for the word to be 0 and sets it to SPINLOCK_QTAS; if anyone lines
+ * up behind it meanwhile, it passes the lock on through splk_handoff.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
@@ -58,23 +94,37 @@
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	bool splk_queued;		    /* MCS lock? */
+	struct spinlock_qnode *splk_qnode;  /* Holder's node, if queued. */
+	volatile bool splk_handoff;	    /* Passed on from SPINLOCK_QTAS. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
 };
 
+/* Lock word of a queued spinlock held without a queue node. */
+#define SPINLOCK_QTAS		1
+
 /*
- * Initializer for cases where a spinlock needs to be static or global.
+ * Initializers for cases where a spinlock needs to be static or global.
  */
 #ifdef OPT_HANGMAN
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  false, NULL, false, \
+				  HANGMAN_LOCKABLE_INITIALIZER }
+#define SPINLOCK_QUEUED_INITIALIZER { SPINLOCK_DATA_INITIALIZER, NULL, \
+				  true, NULL, false, \
 				  HANGMAN_LOCKABLE_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  false, NULL, false }
+#define SPINLOCK_QUEUED_INITIALIZER { SPINLOCK_DATA_INITIALIZER, NULL, \
+				  true, NULL, false }
 #endif
 
 /*
  * Spinlock functions.
  *
  * init		Initialize the contents of a spinlock.
+ * init_queued	Same, but make it a queued (MCS) spinlock.
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
@@ -84,6 +134,7 @@ struct spinlock {
  */
 
 void spinlock_init(struct spinlock *lk);
+void spinlock_init_queued(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -58,9 +58,14 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ * P_timeout is P with a time limit: it gives up and returns ETIMEDOUT
+ * if the count hasn't become nonzero within TICKS hardclock ticks,
+ * and returns 0 once it has decremented the count.
  */
 void P(struct semaphore *);
 void V(struct semaphore *);
+int P_timeout(struct semaphore *, unsigned ticks);
 
 
 /*
@@ -78,6 +83,8 @@ struct lock {
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        int lk_waitpri;                 /* Most urgent waiter's priority */
+        struct lock *lk_nextheld;       /* Holder's t_heldlocks list */
 };
 
 struct lock *lock_create(const char *name);
@@ -91,12 +98,16 @@ void lock_destroy(struct lock *);
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
+ *    lock_acquire_timeout - Like lock_acquire, but give up and return
+ *                   ETIMEDOUT if the lock can't be had within TICKS
+ *                   hardclock ticks. Returns 0 on success.
  *
  * These operations must be atomic. You get to write them.
  */
 void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
+int lock_acquire_timeout(struct lock *, unsigned ticks);
 
 
 /*
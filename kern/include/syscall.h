@@ -49,11 +49,15 @@ void enter_forked_process(struct trapframe *tf);
 
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
+		       userptr_t timepage,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for futexes. */
+void futex_bootstrap(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,19 +68,32 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys_getrusage(int who, userptr_t ru);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t fds);
 int sys_close(int fd);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t offset, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t offset, int *retval);
+int sys_copy_file_range(int infd, userptr_t inoff, int outfd,
+			userptr_t outoff, size_t len, unsigned flags,
+			int *retval);
+int sys_readv(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, userptr_t iov, int iovcnt, off_t offset, int *retval);
+int sys_pwritev(int fd, userptr_t iov, int iovcnt, off_t offset, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
 
 int sys_chdir(const_userptr_t path);
 int sys___getcwd(userptr_t buf, size_t buflen, int *retval);
@@ -94,4 +111,10 @@ int sys_ftruncate(int fd, off_t len);
 
 int sys_sbrk(intptr_t amount, int32_t *retval);
 
+int sys_futex_wait(userptr_t uaddr, int32_t val);
+int sys_futex_wake(userptr_t uaddr, int count, int *retval);
+
+int sys_io_setup(userptr_t urings);
+int sys_io_enter(unsigned to_submit, unsigned min_complete, int *retval);
+
 #endif /* _SYSCALL_H_ */
@@ -53,10 +53,18 @@ int threadlisttest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int forkbench(int, char **);
+int spinbench(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int cvbench(int, char **);
+int pitest(int, char **);
+int workqueuetest(int, char **);
+int timertest(int, char **);
+int rcutest(int, char **);
+int futextest(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -96,6 +104,7 @@ int kmalloctest(int, char **);
 int kmallocstress(int, char **);
 int kmalloctest3(int, char **);
 int kmalloctest4(int, char **);
+int pagebench(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
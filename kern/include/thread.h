@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;	/* from <synch.h> */
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -64,6 +65,22 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Thread priorities. Larger numbers are more urgent; the run queues
+ * and wait channels serve the most urgent thread first. PRI_NONE is
+ * below every real priority.
+ */
+#define PRI_NONE	(-1)
+#define PRI_MIN		0
+#define PRI_DEFAULT	10
+#define PRI_MAX		20
+
+/*
+ * Thread names that fit in THREAD_NAMESIZE are stored in the thread
+ * itself (t_name points at t_namebuf); longer ones are kstrdup'd.
+ */
+#define THREAD_NAMESIZE 32
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -71,6 +88,7 @@ struct thread {
 	 * debugger is messed up.
 	 */
 	char *t_name;			/* Name of this thread */
+	char t_namebuf[THREAD_NAMESIZE]; /* Storage for short names */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
@@ -84,6 +102,19 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
+	unsigned t_rcu_nesting;		/* Depth of RCU read-side sections */
+
+	/*
+	 * Priority fields. t_pri is t_basepri, raised as needed by
+	 * priority inheritance from threads waiting on locks we hold.
+	 * Protected by the priority-inheritance lock in synch.c
+	 * (and t_pri also by the run queue lock while S_READY).
+	 */
+	int t_basepri;			/* Priority as set */
+	int t_pri;			/* Effective priority */
+	struct lock *t_waitlock;	/* Lock we are blocked on */
+	struct lock *t_heldlocks;	/* Sleep locks we hold */
+	int t_age;			/* Run queue aging; see schedule() */
 
 	/*
 	 * Interrupt state fields.
@@ -169,5 +200,18 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Set the effective priority of thread T to PRI, moving it within its
+ * run queue if necessary. For use by the priority-inheritance code.
+ */
+void thread_reprioritize(struct thread *t, int pri);
+
+/*
+ * Set the current thread's base priority; returns the old one. The
+ * effective priority may stay higher while we hold locks that
+ * higher-priority threads are waiting for. Implemented in synch.c.
+ */
+int thread_setpriority(int pri);
+
 
 #endif /* _THREAD_H_ */
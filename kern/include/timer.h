@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timers.
+ *
+ * A timer calls a function once, a given number of hardclock ticks
+ * in the future (see HZ in clock.h). Each CPU has its own timer
+ * wheel; timers are added to the wheel of the CPU that adds them and
+ * fire on that CPU. Adding and cancelling are O(1).
+ *
+ * Timer functions are called from hardclock(), that is, in
+ * interrupt context, with the wheel's spinlock held. They must not
+ * sleep, and must not call timer_add or timer_cancel. They may take
+ * other spinlocks (e.g. to wake up a wait channel); consequently,
+ * timer_add and timer_cancel must not be called while holding a
+ * spinlock that any timer function takes.
+ *
+ * timer_cancel guarantees that, once it returns, the function is
+ * neither pending nor running, so the struct timer may be freed. It
+ * returns true if the timer was still pending. Call it before
+ * freeing a timer even if the timer has (or might have) fired, to
+ * make sure the function has finished.
+ *
+ * A struct timer may be reused (with timer_add) once it has fired
+ * or been cancelled.
+ *
+ * timer_sleep suspends the current thread for at least TICKS ticks.
+ */
+
+struct timerwheel; /* Opaque */
+
+struct timer {
+	void (*tm_func)(void *);	/* function to call */
+	void *tm_data;			/* argument for it */
+	unsigned tm_expires;		/* tick to fire on */
+	struct timerwheel *tm_wheel;	/* wheel we're on, or NULL */
+	struct timer *tm_next;		/* wheel slot links */
+	struct timer **tm_prevp;
+};
+
+void timer_init(struct timer *tm, void (*func)(void *), void *data);
+void timer_add(struct timer *tm, unsigned ticks);
+bool timer_cancel(struct timer *tm);
+
+void timer_sleep(unsigned ticks);
+
+/* Create a wheel for a new CPU. Called from cpu_create. */
+struct timerwheel *timerwheel_create(void);
+
+/* Set up timer_sleep. Called once from boot(). */
+void timer_bootstrap(void);
+
+/* Called from hardclock(), on each CPU, once per tick. */
+void timer_tick(void);
+
+
+#endif /* _TIMER_H_ */
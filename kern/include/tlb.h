@@ -1,6 +1,8 @@
 #ifndef _TLB_H_
 #define _TLB_H_
 
+struct addrspace;
+
 /* insert a tlb entry */
 void insert_tlb(int vaddr, int ppn);
 
@@ -10,5 +12,11 @@ void flush_tlb(void);
 /* replace a tlb entry */
 void replace_tlb(int vaddr, int ppn);
 
+/* invalidate one page in this cpu's tlb */
+void invalidate_tlb(vaddr_t vaddr);
+
+/* invalidate pages of an addrspace in every cpu's tlb (0 pages = all) */
+void shootdown_tlb(struct addrspace *as, const vaddr_t *pages, unsigned npages);
+
 #endif /* _TLB_H_ */
 
@@ -89,10 +89,23 @@ int vm_fault(int faulttype, vaddr_t faultaddress);
 /* purge hpt and ft for frames belonging to an as */
 void purge_hpt(struct addrspace *as);
 
+/* remove an as's pages in [start, end) from the hpt and free them */
+void release_hpt(struct addrspace *as, vaddr_t start, vaddr_t end);
+
+/* map a kernel page read-only into an as, sharing its frame */
+int share_hpt(struct addrspace *as, vaddr_t vaddr, vaddr_t kpage);
+
 /* Allocate/free kernel heap pages (called by kmalloc/kfree) */
 vaddr_t alloc_kpages(unsigned npages);
 void free_kpages(vaddr_t addr);
 
+/* take an extra reference to a frame; free_kpages drops one */
+void frame_incref(vaddr_t addr);
+
+/* zero a page, or copy one page to another (page-aligned kvaddrs) */
+void page_zero(vaddr_t page);
+void page_copy(vaddr_t dst, vaddr_t src);
+
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
 
@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct lock; /* in synch.h */
 struct wchan; /* Opaque */
 
 /*
@@ -70,11 +71,37 @@ void wchan_sleep(struct wchan *wc, struct spinlock *lk);
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
  *
- * The current implementation is FIFO but this is not promised by the
- * interface.
+ * wchan_wakeone picks the highest-priority sleeper, FIFO among
+ * equals; this is not promised by the interface.
  */
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Return the highest priority (t_pri) among threads sleeping on the
+ * channel, or PRI_NONE if there are none. The associated spinlock
+ * must be locked.
+ */
+int wchan_maxpri(struct wchan *wc, struct spinlock *lk);
+
+/*
+ * Record that every thread sleeping on the channel is blocked on
+ * LOCK (t_waitlock), for priority inheritance. The associated
+ * spinlock must be locked, as must synch.c's priority-inheritance
+ * lock.
+ */
+void wchan_setwaitlock(struct wchan *wc, struct spinlock *lk,
+		       struct lock *lock);
+
+/*
+ * Move one thread (or all threads, if ALL is true) sleeping on FROM
+ * over to sleep on TO instead, without waking them. Both associated
+ * spinlocks must be locked. A moved thread, when eventually woken
+ * from TO, returns from its wchan_sleep on FROM as usual (relocking
+ * FROM's spinlock).
+ */
+void wchan_requeue(struct wchan *from, struct spinlock *fromlk,
+		   struct wchan *to, struct spinlock *tolk, bool all);
+
 
 #endif /* _WCHAN_H_ */
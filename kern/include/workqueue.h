@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Deferred work.
+ *
+ * Each CPU has a workqueue served by a small, fixed pool of kernel
+ * worker threads. Code that has work that need not be done right
+ * now (typically teardown) can fill in a struct work and hand it to
+ * workqueue_schedule(); it will be run later, in thread context, by
+ * one of the current CPU's workers.
+ *
+ * The struct work is owned by the workqueue from the time it is
+ * scheduled until its function starts running; it must not be
+ * freed or rescheduled before then. Once the function is called,
+ * the workqueue doesn't touch the struct work again, so the
+ * function itself may free it (or the object it is embedded in).
+ *
+ * Work functions run in a kernel thread of kproc and may sleep, but
+ * should not block for long: other work queued on the same CPU waits
+ * behind them once all the workers are busy.
+ *
+ * workqueue_schedule_delayed() holds the work back for at least
+ * TICKS hardclocks before queueing it, using a timer (see timer.h).
+ *
+ * workqueue_flush() waits until every queue (on any CPU) is empty and
+ * idle, including work queued by other work while it waits. Delayed
+ * work whose delay has not yet expired is not waited for.
+ *
+ * Before the current CPU's workqueue has been started, work is run
+ * synchronously by workqueue_schedule and delayed work is run
+ * without delay.
+ */
+
+#include <timer.h>
+
+struct work {
+	void (*w_func)(void *);		/* function to call */
+	void *w_data;			/* argument for it */
+	struct workqueue *w_wq;		/* queue, while delayed */
+	struct timer w_timer;		/* delay timer */
+	struct work *w_next;		/* queue link */
+};
+
+/* Set up a work item. */
+void work_init(struct work *w, void (*func)(void *), void *data);
+
+/* Queue work on the current CPU. */
+void workqueue_schedule(struct work *w);
+void workqueue_schedule_delayed(struct work *w, unsigned ticks);
+
+/* Wait for all previously queued work to complete. */
+void workqueue_flush(void);
+
+/*
+ * Start the current CPU's workqueue and its worker threads. Called
+ * once on each CPU during startup.
+ */
+void workqueue_cpu_bootstrap(void);
+
+
+#endif /* _WORKQUEUE_H_ */
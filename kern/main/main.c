@@ -47,7 +47,10 @@
 #include <vfs.h>
 #include <device.h>
 #include <pid.h>
+#include <workqueue.h>
 #include <syscall.h>
+#include <execcache.h>
+#include <timepage.h>
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
@@ -128,8 +131,12 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	timepage_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	execcache_bootstrap();
+	futex_bootstrap();
+	workqueue_cpu_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -154,6 +161,9 @@ shutdown(void)
 
 	kprintf("Shutting down.\n");
 
+	/* Let deferred teardown drop its vnode references first. */
+	workqueue_flush();
+
 	vfs_clearbootfs();
 	vfs_clearcurdir();
 	vfs_unmountall();
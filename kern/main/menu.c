@@ -37,6 +37,7 @@
 #include <uio.h>
 #include <clock.h>
 #include <mainbus.h>
+#include <cpu.h>
 #include <synch.h>
 #include <thread.h>
 #include <proc.h>
@@ -45,8 +46,10 @@
 #include <pid.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockprof.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockprof.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -471,6 +474,57 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKPROF
+/*
+ * Command for printing lock contention statistics.
+ */
+static
+int
+cmd_lockprof(int nargs, char **args)
+{
+	unsigned n = 10;
+
+	if (nargs > 2) {
+		kprintf("Usage: lp [count]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		n = atoi(args[1]);
+	}
+
+	lockprof_printstats(n);
+
+	return 0;
+}
+
+static
+int
+cmd_lockprofreset(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lockprof_reset();
+
+	return 0;
+}
+#endif
+
+/*
+ * Command for printing the per-cpu event counters.
+ */
+static
+int
+cmd_vmstat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	cpustat_print();
+
+	return 0;
+}
+
 static
 int
 cmd_kheapgeneration(int nargs, char **args)
@@ -566,9 +620,12 @@ static const char *testmenu[] = {
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
 	"[km4] Multipage kmalloc test        ",
+	"[pgb] Page zero/copy benchmark      ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tfb] Thread fork benchmark         ",
+	"[spb] Spinlock contention benchmark ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -576,6 +633,12 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] CV broadcast benchmark        ",
+	"[sy6] Priority inheritance test     ",
+	"[wq1] Workqueue test                ",
+	"[tm1] Timer test                    ",
+	"[rcu1] RCU torture test             ",
+	"[fx1] Futex test                    ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -606,6 +669,11 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[vmstat] Per-cpu event counters     ",
+#if OPT_LOCKPROF
+	"[lp] Lock contention stats          ",
+	"[lpreset] Reset lock stats          ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +725,11 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "vmstat",	cmd_vmstat },
+#if OPT_LOCKPROF
+	{ "lp",		cmd_lockprof },
+	{ "lpreset",	cmd_lockprofreset },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -667,18 +740,27 @@ static struct {
 	{ "km2",	kmallocstress },
 	{ "km3",	kmalloctest3 },
 	{ "km4",	kmalloctest4 },
+	{ "pgb",	pagebench },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tfb",	forkbench },
+	{ "spb",	spinbench },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	cvbench },
+	{ "sy6",	pitest },
+	{ "wq1",	workqueuetest },
+	{ "tm1",	timertest },
+	{ "rcu1",	rcutest },
+	{ "fx1",	futextest },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -57,6 +57,7 @@ struct pidinfo {
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
 	struct cv *pi_cv;		// use to wait for thread exit
+	struct proc_rusage pi_rusage;	// usage incl. children (if exited)
 };
 
 
@@ -101,6 +102,7 @@ pidinfo_create(pid_t pid, pid_t ppid)
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	bzero(&pi->pi_rusage, sizeof(pi->pi_rusage));
 
 	return pi;
 }
@@ -369,6 +371,10 @@ pid_setexitstatus(int status)
 	us->pi_exitstatus = status;
 	us->pi_exited = true;
 
+	/* Leave our usage, and our children's, for the parent */
+	us->pi_rusage = curproc->p_ru;
+	proc_rusage_add(&us->pi_rusage, &curproc->p_cru);
+
 	if (us->pi_ppid == INVALID_PID) {
 		/* no parent */
 		pi_drop(curproc->p_pid);
@@ -457,6 +463,9 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		*ret = theirpid;
 	}
 
+	/* Reaping the child collects its resource usage. */
+	proc_rusage_add(&curproc->p_cru, &them->pi_rusage);
+
 	them->pi_ppid = 0;
 	pi_drop(them->pi_pid);
 
@@ -52,6 +52,7 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <ioring.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -95,35 +96,24 @@ proc_create(const char *name)
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
 
+	/* Asynchronous I/O */
+	proc->p_ioring = NULL;
+
+	/* Accounting */
+	bzero(&proc->p_ru, sizeof(proc->p_ru));
+	bzero(&proc->p_cru, sizeof(proc->p_cru));
+
 	return proc;
 }
 
 /*
- * Destroy a proc structure.
- *
- * Note: nothing currently calls this. Your wait/exit code will
- * probably want to do so.
+ * Release a process's current directory, open files, and I/O rings.
+ * (The rings go too because their queued requests hold files open.)
  */
+static
 void
-proc_destroy(struct proc *proc)
+proc_release(struct proc *proc)
 {
-	/*
-	 * You probably want to destroy and null out much of the
-	 * process (particularly the address space) at exit time if
-	 * your wait/exit design calls for the process structure to
-	 * hang around beyond process exit. Some wait/exit designs
-	 * do, some don't.
-	 */
-
-	KASSERT(proc != NULL);
-	KASSERT(proc != kproc);
-
-	/*
-	 * We don't take p_lock in here because we must have the only
-	 * reference to this structure. (Otherwise it would be
-	 * incorrect to destroy it.)
-	 */
-
 	/* VFS fields */
 	if (proc->p_cwd) {
 		VOP_DECREF(proc->p_cwd);
@@ -134,7 +124,23 @@ proc_destroy(struct proc *proc)
 		proc->p_filetable = NULL;
 	}
 
-	/* VM fields */
+	/* Asynchronous I/O; queued requests are cancelled */
+	if (proc->p_ioring) {
+		ioring_destroy(proc->p_ioring);
+		proc->p_ioring = NULL;
+	}
+}
+
+/*
+ * Take a process's address space away from it, so it can be destroyed.
+ * Returns NULL if it had none.
+ */
+static
+struct addrspace *
+proc_unlinkas(struct proc *proc)
+{
+	struct addrspace *as;
+
 	if (proc->p_addrspace) {
 		/*
 		 * If p is the current process, remove it safely from
@@ -169,8 +175,6 @@ proc_destroy(struct proc *proc)
 		 * incorrect to destroy the proc structure of some
 		 * random other process while it's still running...
 		 */
-		struct addrspace *as;
-
 		if (proc == curproc) {
 			as = proc_setas(NULL);
 			as_deactivate();
@@ -179,6 +183,42 @@ proc_destroy(struct proc *proc)
 			as = proc->p_addrspace;
 			proc->p_addrspace = NULL;
 		}
+		return as;
+	}
+	return NULL;
+}
+
+/*
+ * Destroy a proc structure.
+ */
+void
+proc_destroy(struct proc *proc)
+{
+	struct addrspace *as;
+
+	/*
+	 * You probably want to destroy and null out much of the
+	 * process (particularly the address space) at exit time if
+	 * your wait/exit design calls for the process structure to
+	 * hang around beyond process exit. Some wait/exit designs
+	 * do, some don't.
+	 */
+
+	KASSERT(proc != NULL);
+	KASSERT(proc != kproc);
+
+	/*
+	 * We don't take p_lock in here because we must have the only
+	 * reference to this structure. (Otherwise it would be
+	 * incorrect to destroy it.)
+	 */
+
+	/* Anything proc_exit hasn't already released */
+	proc_release(proc);
+
+	/* VM fields */
+	as = proc_unlinkas(proc);
+	if (as != NULL) {
 		as_destroy(as);
 	}
 
@@ -191,6 +231,16 @@ proc_destroy(struct proc *proc)
 	kfree(proc);
 }
 
+/*
+ * Workqueue function for destroying an exited process.
+ */
+static
+void
+proc_reap(void *data)
+{
+	proc_destroy(data);
+}
+
 /*
  * Create the process structure for the kernel.
  */
@@ -252,6 +302,26 @@ proc_create_runprogram(const char *name, struct proc **ret)
 	return 0;
 }
 
+/*
+ * Create a process for a kernel worker thread.
+ *
+ * It has no process ID, no address space, no file table, and no
+ * current directory; the worker sets one up if it needs it. The
+ * worker gets rid of it again with proc_exitworker.
+ */
+int
+proc_create_worker(const char *name, struct proc **ret)
+{
+	struct proc *newproc;
+
+	newproc = proc_create(name);
+	if (newproc == NULL) {
+		return ENOMEM;
+	}
+	*ret = newproc;
+	return 0;
+}
+
 /*
  * Clone the current process.
  *
@@ -295,6 +365,11 @@ proc_fork(struct proc **ret)
 	as = proc_getas();
 	if (as != NULL) {
 		result = as_copy(as, &newproc->p_addrspace);
+		if (result == ENOMEM) {
+			/* exited processes' memory may still be in the reaper */
+			workqueue_flush();
+			result = as_copy(as, &newproc->p_addrspace);
+		}
 		if (result) {
 			pid_unalloc(newproc->p_pid);
 			newproc->p_pid = INVALID_PID;
@@ -344,6 +419,24 @@ proc_unfork(struct proc *newproc)
 	proc_destroy(newproc);
 }
 
+/*
+ * Accumulate resource usage, e.g. of a reaped child into its parent.
+ */
+void
+proc_rusage_add(struct proc_rusage *to, const struct proc_rusage *from)
+{
+	to->pr_utime += from->pr_utime;
+	to->pr_stime += from->pr_stime;
+	to->pr_nvcsw += from->pr_nvcsw;
+	to->pr_nivcsw += from->pr_nivcsw;
+	to->pr_tlbrefills += from->pr_tlbrefills;
+	to->pr_minflt += from->pr_minflt;
+	to->pr_cowflt += from->pr_cowflt;
+	to->pr_majflt += from->pr_majflt;
+	to->pr_inbytes += from->pr_inbytes;
+	to->pr_outbytes += from->pr_outbytes;
+}
+
 /*
  * Make the current process exit.
  */
@@ -351,6 +444,7 @@ void
 proc_exit(int status)
 {
 	struct proc *proc = curproc;
+	struct addrspace *as;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
@@ -358,6 +452,15 @@ proc_exit(int status)
 	/* Set exit status and wake up anyone waiting for us. */
 	pid_setexitstatus(status);
 
+	/*
+	 * Closing files and dropping the cwd are cheap, and someone
+	 * else may be waiting on them (e.g. for EOF on a pipe), so do
+	 * them now. Tearing down the address space walks the whole
+	 * page table, so just unlink it here and leave it for later.
+	 */
+	proc_release(proc);
+	as = proc_unlinkas(proc);
+
 	/* Detach from the process and attach to the kernel process. */
 	KASSERT(curthread->t_proc == proc);
 	proc_remthread(curthread);
@@ -366,9 +469,44 @@ proc_exit(int status)
 	/* There should be no threads left in the target process. */
 	KASSERT(threadarray_num(&proc->p_threads) == 0);
 
-	/* Now we can destroy the process. */
-	proc_destroy(proc);
+	/*
+	 * With no threads left nothing can activate the address space
+	 * again, so hand it back for proc_destroy to get rid of.
+	 */
+	proc->p_addrspace = as;
+
+	/*
+	 * Now we can destroy the process. Our parent may already be
+	 * waking up in waitpid, so leave that, and the frames it
+	 * frees, to a worker thread and get out of the way. Anyone
+	 * who runs out of memory in the meantime can workqueue_flush
+	 * and try again.
+	 */
+	work_init(&proc->p_reapwork, proc_reap, proc);
+	workqueue_schedule(&proc->p_reapwork);
+
+	thread_exit();
+}
+
+/*
+ * Make the current thread, a worker in a process from
+ * proc_create_worker, exit and take its process with it. Nobody
+ * waits for a worker, so unlike proc_exit there's no status to post
+ * and the process can go at once.
+ */
+void
+proc_exitworker(void)
+{
+	struct proc *proc = curproc;
 
+	KASSERT(proc != kproc);
+	KASSERT(proc->p_pid == INVALID_PID);
+
+	proc_remthread(curthread);
+	proc_addthread(kproc, curthread);
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
+
+	proc_destroy(proc);
 	thread_exit();
 }
 
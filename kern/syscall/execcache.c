@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Executable image cache. See execcache.h for the overview.
+ *
+ * The table is tiny and lookups are one per exec, so it is a plain
+ * array searched linearly under one lock. Replacement is LRU among
+ * the slots, subject to a total page budget. Nothing here calls into
+ * the filesystem or allocates memory with the lock held, so the
+ * cache lock is a leaf: it is safe to invalidate from the write,
+ * truncate, and vnode reclaim paths, and to empty the cache from the
+ * page allocator when it runs dry.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <membar.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <vnode.h>
+#include <execcache.h>
+
+static struct lock *execcache_lock;
+static struct execimage *execcache_slots[EXECCACHE_SLOTS];
+static unsigned execcache_pages;	/* pages held by cached images */
+static unsigned execcache_clock;	/* LRU stamps */
+
+struct execimage *
+execimage_create(struct vnode *v)
+{
+	struct execimage *img;
+
+	img = kmalloc(sizeof(*img));
+	if (img == NULL) {
+		return NULL;
+	}
+	img->ei_vnode = v;
+	img->ei_refcount = 1;
+	img->ei_lastuse = 0;
+	img->ei_entry = 0;
+	img->ei_nsegs = 0;
+	img->ei_npages = 0;
+	return img;
+}
+
+static
+void
+execimage_destroy(struct execimage *img)
+{
+	unsigned i;
+
+	KASSERT(img->ei_refcount == 0);
+	for (i=0; i<img->ei_npages; i++) {
+		kfree(img->ei_pages[i]);
+	}
+	kfree(img);
+}
+
+void
+execcache_bootstrap(void)
+{
+	execcache_lock = lock_create("execcache");
+	if (execcache_lock == NULL) {
+		panic("execcache_bootstrap: Out of memory\n");
+	}
+}
+
+/*
+ * Take slot SLOT out of the table. Returns the image if the table's
+ * reference was the last one, in which case the caller must destroy
+ * it after dropping the lock.
+ */
+static
+struct execimage *
+execcache_remove(unsigned slot)
+{
+	struct execimage *img;
+
+	KASSERT(lock_do_i_hold(execcache_lock));
+
+	img = execcache_slots[slot];
+	KASSERT(img != NULL);
+	execcache_slots[slot] = NULL;
+	KASSERT(execcache_pages >= img->ei_npages);
+	execcache_pages -= img->ei_npages;
+
+	KASSERT(img->ei_refcount > 0);
+	img->ei_refcount--;
+	return img->ei_refcount == 0 ? img : NULL;
+}
+
+struct execimage *
+execcache_lookup(struct vnode *v, unsigned *gen)
+{
+	struct execimage *img;
+	unsigned i;
+
+	lock_acquire(execcache_lock);
+	for (i=0; i<EXECCACHE_SLOTS; i++) {
+		img = execcache_slots[i];
+		if (img != NULL && img->ei_vnode == v) {
+			img->ei_refcount++;
+			img->ei_lastuse = ++execcache_clock;
+			lock_release(execcache_lock);
+			return img;
+		}
+	}
+
+	/* Any write from here on changes this, and stops the insert. */
+	*gen = v->vn_writegen;
+	lock_release(execcache_lock);
+	return NULL;
+}
+
+void
+execcache_insert(struct execimage *img, unsigned gen)
+{
+	struct execimage *dead[EXECCACHE_SLOTS];
+	unsigned ndead = 0;
+	unsigned i, slot, lru;
+
+	if (img->ei_npages > EXECCACHE_BUDGET) {
+		return;
+	}
+
+	lock_acquire(execcache_lock);
+	for (i=0; i<EXECCACHE_SLOTS; i++) {
+		if (execcache_slots[i] != NULL &&
+		    execcache_slots[i]->ei_vnode == img->ei_vnode) {
+			/* Someone else beat us to it. */
+			lock_release(execcache_lock);
+			return;
+		}
+	}
+
+	/*
+	 * Set the flag first and then check the write count; a write
+	 * bumps the count first and then checks the flag (see
+	 * vnode_write). So either we see its count, or it sees the
+	 * flag and invalidates what we're about to insert.
+	 */
+	img->ei_vnode->vn_execcached = true;
+	membar_any_any();
+	if (img->ei_vnode->vn_writegen != gen) {
+		/* The file changed while we read it. */
+		img->ei_vnode->vn_execcached = false;
+		lock_release(execcache_lock);
+		return;
+	}
+
+	/* Evict least recently used images until there's room. */
+	while (1) {
+		slot = lru = EXECCACHE_SLOTS;
+		for (i=0; i<EXECCACHE_SLOTS; i++) {
+			if (execcache_slots[i] == NULL) {
+				if (slot == EXECCACHE_SLOTS) {
+					slot = i;
+				}
+			}
+			else if (lru == EXECCACHE_SLOTS ||
+				 execcache_slots[i]->ei_lastuse <
+				 execcache_slots[lru]->ei_lastuse) {
+				lru = i;
+			}
+		}
+		if (slot < EXECCACHE_SLOTS &&
+		    execcache_pages + img->ei_npages <= EXECCACHE_BUDGET) {
+			break;
+		}
+		/* An empty cache always has room, so this can't fail. */
+		KASSERT(lru < EXECCACHE_SLOTS);
+		dead[ndead] = execcache_remove(lru);
+		if (dead[ndead] != NULL) {
+			ndead++;
+		}
+	}
+
+	img->ei_refcount++;
+	img->ei_lastuse = ++execcache_clock;
+	execcache_slots[slot] = img;
+	execcache_pages += img->ei_npages;
+	lock_release(execcache_lock);
+
+	for (i=0; i<ndead; i++) {
+		execimage_destroy(dead[i]);
+	}
+}
+
+void
+execcache_release(struct execimage *img)
+{
+	bool destroy;
+
+	lock_acquire(execcache_lock);
+	KASSERT(img->ei_refcount > 0);
+	img->ei_refcount--;
+	destroy = (img->ei_refcount == 0);
+	lock_release(execcache_lock);
+
+	if (destroy) {
+		execimage_destroy(img);
+	}
+}
+
+void
+execcache_invalidate(struct vnode *v)
+{
+	struct execimage *dead = NULL;
+	unsigned i;
+
+	lock_acquire(execcache_lock);
+	for (i=0; i<EXECCACHE_SLOTS; i++) {
+		if (execcache_slots[i] != NULL &&
+		    execcache_slots[i]->ei_vnode == v) {
+			KASSERT(dead == NULL);
+			dead = execcache_remove(i);
+		}
+	}
+	v->vn_execcached = false;
+	lock_release(execcache_lock);
+
+	if (dead != NULL) {
+		execimage_destroy(dead);
+	}
+}
+
+bool
+execcache_reclaim(void)
+{
+	struct execimage *dead[EXECCACHE_SLOTS];
+	unsigned ndead = 0;
+	unsigned i;
+	bool freed;
+
+	/*
+	 * The VM system allocates under splhigh, and that's what
+	 * protects the page table it's in the middle of changing, so
+	 * we mustn't sleep then either.
+	 */
+	if (execcache_lock == NULL || !CURCPU_EXISTS() ||
+	    curthread->t_in_interrupt || curcpu->c_spinlocks > 0 ||
+	    curthread->t_curspl > 0 || curthread->t_iplhigh_count > 0 ||
+	    lock_do_i_hold(execcache_lock)) {
+		return false;
+	}
+
+	lock_acquire(execcache_lock);
+	freed = execcache_pages > 0;
+	for (i=0; i<EXECCACHE_SLOTS; i++) {
+		if (execcache_slots[i] != NULL) {
+			execcache_slots[i]->ei_vnode->vn_execcached = false;
+			dead[ndead] = execcache_remove(i);
+			if (dead[ndead] != NULL) {
+				ndead++;
+			}
+		}
+	}
+	lock_release(execcache_lock);
+
+	for (i=0; i<ndead; i++) {
+		execimage_destroy(dead[i]);
+	}
+	return freed;
+}
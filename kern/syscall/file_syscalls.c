@@ -39,6 +39,7 @@
 #include <kern/stat.h>
 #include <lib.h>
 #include <uio.h>
+#include <vm.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
@@ -47,6 +48,7 @@
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
 #include <syscall.h>
 
 /*
@@ -105,20 +107,117 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Largest total transfer for one call; the result has to fit in a
+ * ssize_t.
+ */
+#define RW_MAXBYTES	(~(size_t)0 >> 1)
+
+/*
+ * iovecs handled per uio. A few live on the stack, which covers the
+ * usual header+payload+trailer kind of call; longer vectors go through
+ * a page-sized kernel array, a page's worth at a time, since we can't
+ * allocate more than a page and IOV_MAX iovecs don't fit in one.
+ */
+#define RW_STACKIOVS	8
+#define RW_IOVBATCH	(PAGE_SIZE / sizeof(struct iovec))
+
+/*
+ * Run one uio's worth of I/O: transfer LEN bytes described by the
+ * IOVCNT (user) iovecs in IOV, at *POS, and advance *POS. The amount
+ * actually moved is returned in *MOVED even if there's an error.
+ */
+static
+int
+sys_doio(struct openfile *file, struct iovec *iov, unsigned iovcnt,
+	 size_t len, off_t *pos, enum uio_rw rw, size_t *moved)
+{
+	struct uio useruio;
+	int result;
+
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_offset = *pos;
+	useruio.uio_resid = len;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
+
+	/* do the read or write */
+	result = (rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, &useruio) :
+		VOP_WRITE(file->of_vnode, &useruio);
+
+	/*
+	 * The amount read (or written) is the original buffer size,
+	 * minus how much is left in it.
+	 */
+	*moved = len - useruio.uio_resid;
+	*pos = useruio.uio_offset;
+	return result;
+}
+
+/*
+ * Copy in and check the next batch of up to MAX iovecs from UIOV,
+ * returning the number of bytes they cover in *LEN. RUNNING is the
+ * total so far, so we can refuse vectors that add up to too much.
+ */
+static
+int
+sys_iovcopyin(userptr_t uiov, struct iovec *iov, unsigned n,
+	      size_t running, size_t *len)
+{
+	unsigned i;
+	size_t total;
+	int result;
+
+	/* userland's iovec has the same layout, with iov_base */
+	result = copyin(uiov, iov, n * sizeof(struct iovec));
+	if (result) {
+		return result;
+	}
+
+	total = 0;
+	for (i=0; i<n; i++) {
+		if (iov[i].iov_len > RW_MAXBYTES - running - total) {
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
+	}
+	*len = total;
+	return 0;
+}
+
+/*
+ * Common logic for read and write and their vectored and positional
+ * variants.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE. The data is given
+ * either as one buffer (BUF, SIZE) or, if VECTORED is true, as IOVCNT
+ * iovecs at user address UIOV. A bad (e.g. NULL) address in either
+ * form is left to the copy to catch, so it fails with EFAULT like any
+ * other. If OFFSET is NULL the I/O happens
+ * at, and updates, the file's seek position; otherwise it happens at
+ * *OFFSET and the seek position is left alone.
+ *
+ * A long vector takes more than one VOP call. We stop at the first
+ * one that comes up short, and if a later batch fails we report what
+ * was moved up to the failure (including by the failing batch, since
+ * the seek position has already moved past that), as for any other
+ * short transfer.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite(int fd, userptr_t buf, size_t size,
+	      bool vectored, userptr_t uiov, int iovcnt, const off_t *offset,
+	      enum uio_rw rw, int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
 	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	struct iovec stackiov[RW_STACKIOVS];
+	struct iovec *iov;
+	unsigned n, done, batch;
+	size_t len, moved, total;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -127,9 +226,35 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
-	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
+	if (vectored) {
+		if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return EINVAL;
+		}
+		batch = (iovcnt <= RW_STACKIOVS) ? RW_STACKIOVS : RW_IOVBATCH;
+	}
+	else {
+		batch = 1;
+	}
+	if (offset != NULL && *offset < 0) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return EINVAL;
+	}
+
+	/*
+	 * Only lock the seek position if we're really using it.
+	 * Positional I/O needs a seekable object.
+	 */
+	locked = false;
+	if (offset != NULL) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return ESPIPE;
+		}
+		pos = *offset;
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		locked = true;
 		lock_acquire(file->of_offsetlock);
 		pos = file->of_offset;
 	}
@@ -142,30 +267,79 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	if (batch <= RW_STACKIOVS) {
+		iov = stackiov;
+	}
+	else {
+		iov = kmalloc(batch * sizeof(struct iovec));
+		if (iov == NULL) {
+			result = ENOMEM;
+			goto fail;
+		}
+	}
 
-	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
+	total = 0;
+	done = 0;
+	result = 0;
+	do {
+		if (!vectored) {
+			/* set up a uio with the buffer and its size */
+			iov->iov_ubase = buf;
+			iov->iov_len = size;
+			n = 1;
+			len = size;
+		}
+		else {
+			n = iovcnt - done;
+			if (n > batch) {
+				n = batch;
+			}
+			result = sys_iovcopyin(uiov, iov, n, total, &len);
+			if (result) {
+				break;
+			}
+			uiov += n * sizeof(struct iovec);
+		}
+
+		/* pos moves past whatever gets through, even on error */
+		result = sys_doio(file, iov, n, len, &pos, rw, &moved);
+		total += moved;
+		if (result) {
+			break;
+		}
+		done += n;
+		if (moved < len) {
+			break;
+		}
+	} while (vectored && done < (unsigned)iovcnt);
+
+	if (iov != stackiov) {
+		kfree(iov);
+	}
 	if (result) {
-		goto fail;
+		if (done == 0) {
+			goto fail;
+		}
+		/* report what got through before the error */
+		result = 0;
 	}
 
 	if (locked) {
 		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		file->of_offset = pos;
 		lock_release(file->of_offsetlock);
 	}
 
 	filetable_put(curproc->p_filetable, fd, file);
 
-	/*
-	 * The amount read (or written) is the original buffer size,
-	 * minus how much is left in it.
-	 */
-	*retval = size - useruio.uio_resid;
+	*retval = total;
+
+	if (rw == UIO_READ) {
+		curproc->p_ru.pr_inbytes += total;
+	}
+	else {
+		curproc->p_ru.pr_outbytes += total;
+	}
 
 	return 0;
 
@@ -183,7 +357,13 @@ fail:
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, buf, size, false, NULL, 0, NULL,
+			       UIO_READ, O_WRONLY, &ret);
+	*retval = ret;
+	return result;
 }
 
 /*
@@ -192,7 +372,384 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, buf, size, false, NULL, 0, NULL,
+			       UIO_WRITE, O_RDONLY, &ret);
+	*retval = ret;
+	return result;
+}
+
+/*
+ * pread() - use sys_readwrite
+ *
+ * Like the other positional calls this never touches the file's seek
+ * position or its lock, so processes sharing an open file can do
+ * positional I/O on it in parallel.
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t offset, int *retval)
+{
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, buf, size, false, NULL, 0, &offset,
+			       UIO_READ, O_WRONLY, &ret);
+	*retval = ret;
+	return result;
+}
+
+/*
+ * pwrite() - use sys_readwrite
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t offset, int *retval)
+{
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, buf, size, false, NULL, 0, &offset,
+			       UIO_WRITE, O_RDONLY, &ret);
+	*retval = ret;
+	return result;
+}
+
+/*
+ * readv() - use sys_readwrite
+ */
+int
+sys_readv(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, NULL, 0, true, iov, iovcnt, NULL,
+			       UIO_READ, O_WRONLY, &ret);
+	*retval = ret;
+	return result;
+}
+
+/*
+ * writev() - use sys_readwrite
+ */
+int
+sys_writev(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, NULL, 0, true, iov, iovcnt, NULL,
+			       UIO_WRITE, O_RDONLY, &ret);
+	*retval = ret;
+	return result;
+}
+
+/*
+ * preadv() - use sys_readwrite
+ */
+int
+sys_preadv(int fd, userptr_t iov, int iovcnt, off_t offset, int *retval)
+{
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, NULL, 0, true, iov, iovcnt, &offset,
+			       UIO_READ, O_WRONLY, &ret);
+	*retval = ret;
+	return result;
+}
+
+/*
+ * pwritev() - use sys_readwrite
+ */
+int
+sys_pwritev(int fd, userptr_t iov, int iovcnt, off_t offset, int *retval)
+{
+	ssize_t ret;
+	int result;
+
+	result = sys_readwrite(fd, NULL, 0, true, iov, iovcnt, &offset,
+			       UIO_WRITE, O_RDONLY, &ret);
+	*retval = ret;
+	return result;
+}
+
+/*
+ * Get the position to use for one side of copy_file_range: *UOFF if
+ * UOFF isn't NULL (positional, so the object must be seekable), else
+ * the file's seek position, which the caller must lock.
+ */
+static
+int
+cfr_getpos(struct openfile *file, userptr_t uoff, bool *uselock,
+	   off_t *pos)
+{
+	int result;
+
+	*uselock = false;
+	if (uoff != NULL) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			return ESPIPE;
+		}
+		result = copyin(uoff, pos, sizeof(*pos));
+		if (result) {
+			return result;
+		}
+		if (*pos < 0) {
+			return EINVAL;
+		}
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		*uselock = true;
+	}
+	else {
+		*pos = 0;
+	}
+	return 0;
+}
+
+/*
+ * copy_file_range() - copy data from one file to another without
+ * taking it through user space.
+ *
+ * Each side's position is either the file's seek position (when the
+ * offset pointer is NULL), which is updated, or the value at the
+ * offset pointer, which is updated instead. The data goes through a
+ * one-page kernel bounce buffer: there's no buffer cache to copy
+ * between, and this already saves the copyout/copyin and the second
+ * trap of read+write. A copy within one file may not overlap itself.
+ *
+ * Returns the number of bytes copied, which is short at end of file.
+ */
+int
+sys_copy_file_range(int infd, userptr_t uinoff, int outfd, userptr_t uoutoff,
+		    size_t len, unsigned flags, int *retval)
+{
+	struct filetable *ft;
+	struct openfile *in, *out;
+	struct lock *lock1, *lock2;
+	bool lockin, lockout;
+	off_t inpos, outpos;
+	struct copyseg segs[2];
+	unsigned nsegs;
+	struct iovec iov;
+	struct uio ku;
+	char *kbuf;
+	size_t total, chunk, got;
+	int result;
+
+	if (flags != 0) {
+		return EINVAL;
+	}
+	if (len > RW_MAXBYTES) {
+		len = RW_MAXBYTES;
+	}
+
+	ft = curproc->p_filetable;
+	result = filetable_get(ft, infd, &in);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, outfd, &out);
+	if (result) {
+		filetable_put(ft, infd, in);
+		return result;
+	}
+
+	lock1 = lock2 = NULL;
+	kbuf = NULL;
+
+	if (in->of_accmode == O_WRONLY || out->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+	result = cfr_getpos(in, uinoff, &lockin, &inpos);
+	if (result) {
+		goto out;
+	}
+	result = cfr_getpos(out, uoutoff, &lockout, &outpos);
+	if (result) {
+		goto out;
+	}
+
+	/*
+	 * Lock the seek positions we're using. If there are two, take
+	 * them in address order so two copies going opposite ways
+	 * can't deadlock; if it's the same open file, take it once.
+	 */
+	lock1 = lockin ? in->of_offsetlock : NULL;
+	lock2 = lockout ? out->of_offsetlock : NULL;
+	if (lock1 == lock2) {
+		lock2 = NULL;
+	}
+	else if (lock1 != NULL && lock2 != NULL && lock2 < lock1) {
+		lock1 = out->of_offsetlock;
+		lock2 = in->of_offsetlock;
+	}
+	if (lock1 != NULL) {
+		lock_acquire(lock1);
+	}
+	if (lock2 != NULL) {
+		lock_acquire(lock2);
+	}
+	if (lockin) {
+		inpos = in->of_offset;
+	}
+	if (lockout) {
+		outpos = out->of_offset;
+	}
+
+	if (in->of_vnode == out->of_vnode &&
+	    inpos < outpos + (off_t)len && outpos < inpos + (off_t)len) {
+		result = EINVAL;
+		goto out;
+	}
+
+	kbuf = kmalloc(PAGE_SIZE);
+	if (kbuf == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+
+	total = 0;
+	while (total < len) {
+		chunk = len - total;
+		if (chunk > PAGE_SIZE) {
+			chunk = PAGE_SIZE;
+		}
+
+		uio_kinit(&iov, &ku, kbuf, chunk, inpos, UIO_READ);
+		result = VOP_READ(in->of_vnode, &ku);
+		if (result) {
+			break;
+		}
+		got = chunk - ku.uio_resid;
+		inpos = ku.uio_offset;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+
+		uio_kinit(&iov, &ku, kbuf, got, outpos, UIO_WRITE);
+		result = VOP_WRITE(out->of_vnode, &ku);
+		outpos = ku.uio_offset;
+		total += got - ku.uio_resid;
+		/*
+		 * On a short write, back the input up to match, so the
+		 * positions say what was really copied.
+		 */
+		inpos -= ku.uio_resid;
+		if (result || ku.uio_resid > 0) {
+			break;
+		}
+	}
+	if (result && total > 0) {
+		/* report the partial copy */
+		result = 0;
+	}
+	if (result) {
+		goto out;
+	}
+
+	/* Hand back the new positions. */
+	nsegs = 0;
+	if (uinoff != NULL) {
+		segs[nsegs].cs_uaddr = uinoff;
+		segs[nsegs].cs_kaddr = &inpos;
+		segs[nsegs].cs_len = sizeof(inpos);
+		nsegs++;
+	}
+	else if (lockin) {
+		in->of_offset = inpos;
+	}
+	if (uoutoff != NULL) {
+		segs[nsegs].cs_uaddr = uoutoff;
+		segs[nsegs].cs_kaddr = &outpos;
+		segs[nsegs].cs_len = sizeof(outpos);
+		nsegs++;
+	}
+	else if (lockout) {
+		out->of_offset = outpos;
+	}
+	result = copyoutv(segs, nsegs);
+	if (result) {
+		goto out;
+	}
+
+	curproc->p_ru.pr_inbytes += total;
+	curproc->p_ru.pr_outbytes += total;
+	*retval = total;
+
+out:
+	if (kbuf != NULL) {
+		kfree(kbuf);
+	}
+	if (lock2 != NULL) {
+		lock_release(lock2);
+	}
+	if (lock1 != NULL) {
+		lock_release(lock1);
+	}
+	filetable_put(ft, outfd, out);
+	filetable_put(ft, infd, in);
+	return result;
+}
+
+/*
+ * pipe() - make a pipe and put its read and write ends in the file
+ * table.
+ */
+int
+sys_pipe(userptr_t ufds)
+{
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile, *junk;
+	int fds[2];
+	int result;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	readfile = openfile_create(readvn, O_RDONLY);
+	if (readfile == NULL) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+	writefile = openfile_create(writevn, O_WRONLY);
+	if (writefile == NULL) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+
+	result = filetable_place(curproc->p_filetable, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(curproc->p_filetable, writefile, &fds[1]);
+	if (result) {
+		filetable_placeat(curproc->p_filetable, NULL, fds[0], &junk);
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	result = copyout(fds, ufds, sizeof(fds));
+	if (result) {
+		filetable_placeat(curproc->p_filetable, NULL, fds[0], &junk);
+		filetable_placeat(curproc->p_filetable, NULL, fds[1], &junk);
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	return 0;
 }
 
 /*
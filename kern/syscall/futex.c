@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: kernel-assisted sleeping for userlevel synchronization.
+ *
+ * A futex is an aligned 32-bit word in user memory. Userlevel code
+ * manipulates the word with atomic instructions and enters the kernel
+ * only when it actually needs to sleep (futex_wait) or when there may
+ * be sleepers to wake (futex_wake); an uncontended mutex never makes
+ * a system call at all.
+ *
+ * Sleepers are identified by the pair (address space, user address)
+ * and hashed into a fixed table of wait queues. Each bucket has a
+ * lock, a CV, and a list of waiter records that live on the sleeping
+ * threads' stacks. Waking marks the chosen records and broadcasts on
+ * the bucket's CV; everyone else in the bucket goes back to sleep.
+ *
+ * The futex word is read with the bucket lock held, and futex_wake
+ * takes the same lock before looking for sleepers, so a wakeup that
+ * follows a userlevel update of the word cannot be lost.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* Number of wait queues. Must be a power of 2. */
+#define FUTEX_HASHSIZE	64
+
+struct futex_waiter {
+	struct addrspace *fw_as;	/* key: address space */
+	vaddr_t fw_uaddr;		/* key: user address */
+	bool fw_woken;			/* set by futex_wake */
+	struct futex_waiter *fw_next;	/* next in bucket */
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct cv *fb_cv;
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_HASHSIZE];
+
+/*
+ * Set up the wait queues. Called once from boot().
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		futex_table[i].fb_lock = lock_create("futex");
+		futex_table[i].fb_cv = cv_create("futex");
+		if (futex_table[i].fb_lock == NULL ||
+		    futex_table[i].fb_cv == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+/*
+ * Pick the wait queue for a key.
+ */
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t uaddr)
+{
+	uintptr_t h;
+
+	h = ((uintptr_t)as >> 4) ^ (uaddr >> 2);
+	h ^= h >> 7;
+	return &futex_table[h & (FUTEX_HASHSIZE - 1)];
+}
+
+/*
+ * futex_wait: sleep until woken by futex_wake, provided the word at
+ * UADDR still holds VAL. Fails with EAGAIN if it doesn't.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int32_t val)
+{
+	struct futex_waiter self;
+	struct futex_bucket *fb;
+	int32_t cur;
+	int result;
+
+	if ((vaddr_t)uaddr % sizeof(int32_t) != 0) {
+		return EINVAL;
+	}
+
+	self.fw_as = proc_getas();
+	self.fw_uaddr = (vaddr_t)uaddr;
+	self.fw_woken = false;
+
+	fb = futex_hash(self.fw_as, self.fw_uaddr);
+
+	lock_acquire(fb->fb_lock);
+
+	result = copyin(uaddr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	self.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &self;
+
+	while (!self.fw_woken) {
+		cv_wait(fb->fb_cv, fb->fb_lock);
+	}
+
+	/* futex_wake already unlinked us */
+	lock_release(fb->fb_lock);
+	return 0;
+}
+
+/*
+ * futex_wake: wake up to COUNT threads sleeping on UADDR. Returns the
+ * number actually woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int count, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **pp, *fw;
+	struct addrspace *as;
+	int woken;
+
+	if ((vaddr_t)uaddr % sizeof(int32_t) != 0) {
+		return EINVAL;
+	}
+	if (count < 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_hash(as, (vaddr_t)uaddr);
+	woken = 0;
+
+	lock_acquire(fb->fb_lock);
+	pp = &fb->fb_waiters;
+	while (*pp != NULL && woken < count) {
+		fw = *pp;
+		if (fw->fw_as == as && fw->fw_uaddr == (vaddr_t)uaddr) {
+			*pp = fw->fw_next;
+			fw->fw_next = NULL;
+			fw->fw_woken = true;
+			woken++;
+		}
+		else {
+			pp = &fw->fw_next;
+		}
+	}
+	if (woken > 0) {
+		cv_broadcast(fb->fb_cv, fb->fb_lock);
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
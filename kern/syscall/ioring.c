@@ -0,0 +1,955 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous I/O rings.
+ *
+ * A process registers a submission queue and a completion queue in
+ * its own memory (io_setup), queues requests there, and calls
+ * io_enter to submit any number of them and collect any number of
+ * results in one system call. The requests are carried out by the
+ * ring's own kernel worker threads, so a process can keep many reads
+ * and writes outstanding at once, and the disk queue gets to see them
+ * together instead of one blocking call at a time.
+ *
+ * Unlike a real io_uring, the rings are not shared memory: they are
+ * ordinary arrays in the process's address space, and the kernel
+ * only reads and writes them inside io_enter, with copyin and
+ * copyout. as_share_page can give a process a read-only view of a
+ * kernel page (that's how the time page works), but userland has to
+ * write the SQ and its tail index, and a page both sides write would
+ * need a writable shared mapping that fork's copy-on-write leaves
+ * alone, which the VM system doesn't have. The cost is the copying
+ * in io_enter, which is small next to the I/O; what's lost is only
+ * the ability to submit without a system call at all.
+ *
+ * The workers don't run in the submitter's address space either, so
+ * they move data through kernel bounce pages: write data is copied
+ * in when the request is submitted, and read data is copied out when
+ * its completion is posted. A request is therefore submitted, carried
+ * out, and reaped in three steps; only the middle one can block, and
+ * it happens in the background.
+ *
+ * Each ring starts workers as it needs them, up to IORING_NWORKERS,
+ * so a process that ties its workers up in reads that don't finish
+ * (from the console, say, or an idle pipe) only holds up its own
+ * ring. Each worker gets a process of its own (with no address space
+ * or pid) so that it can take on the submitter's current directory
+ * while it opens a relative pathname.
+ *
+ * The ring is owned by the process; its requests hold references to
+ * the open files they use, so closing an fd while I/O on it is in
+ * flight is harmless. When the process exits or execs, the ring is
+ * marked dead: requests not yet started are cancelled, idle workers
+ * exit at once, and busy ones exit when their request finishes and
+ * throw it away; the last worker out frees the ring.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/limits.h>
+#include <kern/ioring.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <uio.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <ioring.h>
+#include <syscall.h>
+
+/* Most worker threads one ring may have. */
+#define IORING_NWORKERS		4
+
+/* Bounce pages for one request, and for all of one ring's requests. */
+#define IOREQ_MAXPAGES		(IO_MAXIO / PAGE_SIZE)
+#define IORING_MAXPAGES		64
+
+/* Address of field F of the user's struct io_rings. */
+#define IORING_UFIELD(ring, f) \
+	((userptr_t)&((struct io_rings *)(ring)->ir_urings)->f)
+
+struct ioreq {
+	struct ioring *rq_ring;		/* ring we came from */
+	struct io_sqe rq_sqe;		/* the submission */
+	struct openfile *rq_file;	/* file to use, or the opened file */
+	struct vnode *rq_cwd;		/* IO_OP_OPEN: submitter's cwd */
+	char *rq_path;			/* IO_OP_OPEN: pathname */
+	size_t rq_len;			/* bytes to move */
+	unsigned rq_npages;		/* bounce pages in rq_pages */
+	void *rq_pages[IOREQ_MAXPAGES];
+	int rq_result;			/* errno code, or 0 */
+	size_t rq_moved;		/* bytes actually moved */
+	struct ioreq *rq_next;		/* queue link */
+};
+
+struct ioring {
+	struct lock *ir_lock;		/* protects everything below */
+	struct cv *ir_cv;		/* io_enter waits for completions */
+	userptr_t ir_urings;		/* user's struct io_rings */
+	userptr_t ir_usqes;		/* user's SQ entries */
+	userptr_t ir_ucqes;		/* user's CQ entries */
+	unsigned ir_sqentries;		/* SQ size (power of 2) */
+	unsigned ir_cqentries;		/* CQ size (power of 2) */
+	unsigned ir_sqhead;		/* our copy of ir_sqhead */
+	unsigned ir_cqtail;		/* our copy of ir_cqtail */
+	unsigned ir_pending;		/* submitted but not yet reaped */
+	unsigned ir_inflight;		/* of those, still with the workers */
+	unsigned ir_npages;		/* bounce pages held by requests */
+	struct ioreq *ir_queuehead;	/* waiting for a worker */
+	struct ioreq *ir_queuetail;
+	unsigned ir_nqueued;		/* requests on that queue */
+	struct cv *ir_workcv;		/* idle workers wait here */
+	unsigned ir_nworkers;		/* worker threads */
+	unsigned ir_idle;		/* of those, not running a request */
+	struct ioreq *ir_donehead;	/* finished, waiting to be reaped */
+	struct ioreq *ir_donetail;
+	bool ir_dead;			/* owner has gone away */
+};
+
+////////////////////////////////////////////////////////////
+// requests
+
+/*
+ * How many bytes a submission moves, and so how many bounce pages
+ * it needs.
+ */
+static
+size_t
+ioreq_len(const struct io_sqe *sqe)
+{
+	if (sqe->sqe_op != IO_OP_READ && sqe->sqe_op != IO_OP_WRITE) {
+		return 0;
+	}
+	return sqe->sqe_len > IO_MAXIO ? IO_MAXIO : sqe->sqe_len;
+}
+
+static
+struct ioreq *
+ioreq_create(struct ioring *ring, const struct io_sqe *sqe)
+{
+	struct ioreq *rq;
+
+	rq = kmalloc(sizeof(*rq));
+	if (rq == NULL) {
+		return NULL;
+	}
+	rq->rq_ring = ring;
+	rq->rq_sqe = *sqe;
+	rq->rq_file = NULL;
+	rq->rq_cwd = NULL;
+	rq->rq_path = NULL;
+	rq->rq_len = ioreq_len(sqe);
+	rq->rq_npages = 0;
+	rq->rq_result = 0;
+	rq->rq_moved = 0;
+	rq->rq_next = NULL;
+	return rq;
+}
+
+/*
+ * Free a request and drop whatever it holds. The caller takes care
+ * of the ring's page count.
+ */
+static
+void
+ioreq_destroy(struct ioreq *rq)
+{
+	unsigned i;
+
+	for (i=0; i<rq->rq_npages; i++) {
+		kfree(rq->rq_pages[i]);
+	}
+	if (rq->rq_file != NULL) {
+		openfile_decref(rq->rq_file);
+	}
+	if (rq->rq_cwd != NULL) {
+		VOP_DECREF(rq->rq_cwd);
+	}
+	kfree(rq->rq_path);
+	kfree(rq);
+}
+
+/*
+ * Look up the file for a read, write, or fsync and take a reference
+ * to it, so it stays open until the request is done with it.
+ */
+static
+int
+ioreq_getfile(struct ioreq *rq, int badaccmode, bool positional)
+{
+	struct openfile *file;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, rq->rq_sqe.sqe_fd, &file);
+	if (result) {
+		return result;
+	}
+	if (file->of_accmode == badaccmode) {
+		filetable_put(curproc->p_filetable, rq->rq_sqe.sqe_fd, file);
+		return EBADF;
+	}
+	if (positional && rq->rq_sqe.sqe_offset < 0 &&
+	    VOP_ISSEEKABLE(file->of_vnode)) {
+		filetable_put(curproc->p_filetable, rq->rq_sqe.sqe_fd, file);
+		return EINVAL;
+	}
+	openfile_incref(file);
+	rq->rq_file = file;
+	filetable_put(curproc->p_filetable, rq->rq_sqe.sqe_fd, file);
+	return 0;
+}
+
+/*
+ * Get the bounce pages for a read or write, and for a write, fill
+ * them from the user's buffer.
+ */
+static
+int
+ioreq_getpages(struct ioreq *rq)
+{
+	size_t done, len;
+	int result;
+
+	for (done = 0; done < rq->rq_len; done += len) {
+		len = rq->rq_len - done;
+		if (len > PAGE_SIZE) {
+			len = PAGE_SIZE;
+		}
+		rq->rq_pages[rq->rq_npages] = kmalloc(PAGE_SIZE);
+		if (rq->rq_pages[rq->rq_npages] == NULL) {
+			return ENOMEM;
+		}
+		rq->rq_npages++;
+
+		if (rq->rq_sqe.sqe_op == IO_OP_WRITE) {
+			result = copyin(rq->rq_sqe.sqe_ubuf + done,
+					rq->rq_pages[rq->rq_npages - 1], len);
+			if (result) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Do the process-context half of submitting a request: check it and
+ * collect everything the worker will need. Returns true if the
+ * request should go to the workers; otherwise it's finished already,
+ * successfully or with an error in rq_result.
+ *
+ * Called with the ring locked.
+ */
+static
+bool
+ioreq_prepare(struct ioring *ring, struct ioreq *rq)
+{
+	const int allflags =
+		O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND | O_NOCTTY;
+	int result;
+
+	switch (rq->rq_sqe.sqe_op) {
+	    case IO_OP_NOP:
+		return false;
+	    case IO_OP_READ:
+		result = ioreq_getfile(rq, O_WRONLY, true);
+		if (result == 0) {
+			result = ioreq_getpages(rq);
+		}
+		break;
+	    case IO_OP_WRITE:
+		result = ioreq_getfile(rq, O_RDONLY, true);
+		if (result == 0) {
+			result = ioreq_getpages(rq);
+		}
+		break;
+	    case IO_OP_FSYNC:
+		result = ioreq_getfile(rq, -1, false);
+		break;
+	    case IO_OP_OPEN:
+		if ((rq->rq_sqe.sqe_openflags & allflags) !=
+		    rq->rq_sqe.sqe_openflags) {
+			result = EINVAL;
+			break;
+		}
+		rq->rq_path = kmalloc(PATH_MAX);
+		if (rq->rq_path == NULL) {
+			result = ENOMEM;
+			break;
+		}
+		result = copyinstr(rq->rq_sqe.sqe_ubuf, rq->rq_path,
+				   PATH_MAX, NULL);
+		if (result) {
+			break;
+		}
+		/* if we have no cwd, relative paths fail as they would here */
+		if (vfs_getcurdir(&rq->rq_cwd)) {
+			rq->rq_cwd = NULL;
+		}
+		break;
+	    default:
+		result = EINVAL;
+		break;
+	}
+
+	ring->ir_npages += rq->rq_npages;
+	rq->rq_result = result;
+	return result == 0;
+}
+
+/*
+ * Do a read or write between the file and the bounce pages.
+ */
+static
+void
+ioreq_rw(struct ioreq *rq)
+{
+	struct iovec iov[IOREQ_MAXPAGES];
+	struct vnode *vn = rq->rq_file->of_vnode;
+	struct uio ku;
+	size_t left;
+	unsigned i;
+
+	left = rq->rq_len;
+	for (i=0; i<rq->rq_npages; i++) {
+		iov[i].iov_kbase = rq->rq_pages[i];
+		iov[i].iov_len = left > PAGE_SIZE ? PAGE_SIZE : left;
+		left -= iov[i].iov_len;
+	}
+
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = rq->rq_npages;
+	ku.uio_offset = VOP_ISSEEKABLE(vn) ? rq->rq_sqe.sqe_offset : 0;
+	ku.uio_resid = rq->rq_len;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_space = NULL;
+
+	if (rq->rq_sqe.sqe_op == IO_OP_READ) {
+		ku.uio_rw = UIO_READ;
+		rq->rq_result = VOP_READ(vn, &ku);
+	}
+	else {
+		ku.uio_rw = UIO_WRITE;
+		rq->rq_result = VOP_WRITE(vn, &ku);
+	}
+	rq->rq_moved = rq->rq_len - ku.uio_resid;
+}
+
+/*
+ * Open a file, from the submitter's current directory.
+ */
+static
+void
+ioreq_open(struct ioreq *rq)
+{
+	int result;
+
+	if (rq->rq_cwd != NULL) {
+		result = vfs_setcurdir(rq->rq_cwd);
+		if (result) {
+			rq->rq_result = result;
+			return;
+		}
+	}
+	rq->rq_result = openfile_open(rq->rq_path, rq->rq_sqe.sqe_openflags,
+				      rq->rq_sqe.sqe_mode, &rq->rq_file);
+	vfs_clearcurdir();
+}
+
+/*
+ * Do the part of a request that can block. Runs on a worker.
+ */
+static
+void
+ioreq_run(struct ioreq *rq)
+{
+	switch (rq->rq_sqe.sqe_op) {
+	    case IO_OP_READ:
+	    case IO_OP_WRITE:
+		ioreq_rw(rq);
+		break;
+	    case IO_OP_FSYNC:
+		rq->rq_result = VOP_FSYNC(rq->rq_file->of_vnode);
+		break;
+	    case IO_OP_OPEN:
+		ioreq_open(rq);
+		break;
+	    default:
+		panic("ioreq_run: bad op %d\n", rq->rq_sqe.sqe_op);
+	}
+}
+
+/*
+ * Do the process-context half of finishing a request and fill in its
+ * completion: copy out read data and install an opened file.
+ */
+static
+void
+ioreq_complete(struct ioreq *rq, struct io_cqe *cqe)
+{
+	size_t done, len;
+	unsigned i;
+	int fd, result, res;
+
+	result = rq->rq_result;
+
+	/*
+	 * As for read and write, a partial transfer is reported as a
+	 * short count, not as an error.
+	 */
+	switch (rq->rq_sqe.sqe_op) {
+	    case IO_OP_READ:
+		for (i=0, done=0; done < rq->rq_moved; i++, done += len) {
+			len = rq->rq_moved - done;
+			if (len > PAGE_SIZE) {
+				len = PAGE_SIZE;
+			}
+			if (copyout(rq->rq_pages[i],
+				    rq->rq_sqe.sqe_ubuf + done, len)) {
+				result = EFAULT;
+				break;
+			}
+		}
+		curproc->p_ru.pr_inbytes += done;
+		res = (done > 0 || result == 0) ? (int)done : -result;
+		break;
+	    case IO_OP_WRITE:
+		curproc->p_ru.pr_outbytes += rq->rq_moved;
+		res = (rq->rq_moved > 0 || result == 0) ?
+			(int)rq->rq_moved : -result;
+		break;
+	    case IO_OP_OPEN:
+		if (result == 0) {
+			result = filetable_place(curproc->p_filetable,
+						 rq->rq_file, &fd);
+		}
+		if (result == 0) {
+			/* the file table has our reference now */
+			rq->rq_file = NULL;
+		}
+		res = result ? -result : fd;
+		break;
+	    default:
+		res = -result;
+		break;
+	}
+
+	cqe->cqe_userdata = rq->rq_sqe.sqe_userdata;
+	cqe->cqe_res = res;
+	cqe->cqe_pad = 0;
+}
+
+////////////////////////////////////////////////////////////
+// workers
+
+/*
+ * Append a request to one of a ring's lists.
+ */
+static
+void
+ioreq_append(struct ioreq **head, struct ioreq **tail, struct ioreq *rq)
+{
+	rq->rq_next = NULL;
+	if (*tail == NULL) {
+		*head = rq;
+	}
+	else {
+		(*tail)->rq_next = rq;
+	}
+	*tail = rq;
+}
+
+/*
+ * Throw away a list of requests.
+ */
+static
+void
+ioreq_destroylist(struct ioreq *rq)
+{
+	struct ioreq *next;
+
+	for (; rq != NULL; rq = next) {
+		next = rq->rq_next;
+		ioreq_destroy(rq);
+	}
+}
+
+static
+void
+ioring_free(struct ioring *ring)
+{
+	KASSERT(ring->ir_nworkers == 0);
+	KASSERT(ring->ir_inflight == 0);
+	KASSERT(ring->ir_queuehead == NULL);
+	KASSERT(ring->ir_donehead == NULL);
+	cv_destroy(ring->ir_workcv);
+	cv_destroy(ring->ir_cv);
+	lock_destroy(ring->ir_lock);
+	kfree(ring);
+}
+
+/*
+ * Worker thread: carry out the ring's requests until the ring dies,
+ * then leave, freeing the ring if we're the last worker out.
+ */
+static
+void
+ioworker(void *data1, unsigned long data2)
+{
+	struct ioring *ring = data1;
+	struct ioreq *rq;
+	bool last;
+
+	(void)data2;
+
+	lock_acquire(ring->ir_lock);
+	while (1) {
+		while (ring->ir_queuehead == NULL && !ring->ir_dead) {
+			cv_wait(ring->ir_workcv, ring->ir_lock);
+		}
+		if (ring->ir_dead) {
+			/* ioring_destroy has cancelled what was queued */
+			KASSERT(ring->ir_queuehead == NULL);
+			break;
+		}
+		rq = ring->ir_queuehead;
+		ring->ir_queuehead = rq->rq_next;
+		if (ring->ir_queuehead == NULL) {
+			ring->ir_queuetail = NULL;
+		}
+		ring->ir_nqueued--;
+		ring->ir_idle--;
+		lock_release(ring->ir_lock);
+
+		ioreq_run(rq);
+
+		lock_acquire(ring->ir_lock);
+		ring->ir_idle++;
+		KASSERT(ring->ir_inflight > 0);
+		ring->ir_inflight--;
+		if (ring->ir_dead) {
+			/* the owner is gone; nobody wants the result */
+			ioreq_destroy(rq);
+		}
+		else {
+			ioreq_append(&ring->ir_donehead, &ring->ir_donetail,
+				     rq);
+			cv_signal(ring->ir_cv, ring->ir_lock);
+		}
+	}
+	ring->ir_idle--;
+	ring->ir_nworkers--;
+	last = ring->ir_nworkers == 0;
+	lock_release(ring->ir_lock);
+
+	if (last) {
+		ioring_free(ring);
+	}
+	proc_exitworker();
+}
+
+/*
+ * Start another worker for a ring. Called with the ring locked.
+ */
+static
+int
+ioworker_start(struct ioring *ring)
+{
+	struct proc *proc;
+	char name[32];
+	int result;
+
+	snprintf(name, sizeof(name), "ioworker %u", ring->ir_nworkers);
+	result = proc_create_worker(name, &proc);
+	if (result) {
+		return result;
+	}
+	result = thread_fork(name, proc, ioworker, ring, 0);
+	if (result) {
+		proc_destroy(proc);
+		return result;
+	}
+	/* it counts as idle until it picks up a request */
+	ring->ir_nworkers++;
+	ring->ir_idle++;
+	return 0;
+}
+
+/*
+ * Hand a list of requests to the ring's workers, starting more of
+ * them if there's more work than idle workers and the ring has room
+ * for them. If the ring has no workers and can't get one, fail the
+ * requests instead. Called with the ring locked.
+ */
+static
+void
+ioworker_queue(struct ioring *ring, struct ioreq *head)
+{
+	struct ioreq *rq, *next;
+	int result = 0;
+
+	for (rq = head; rq != NULL; rq = next) {
+		next = rq->rq_next;
+		ioreq_append(&ring->ir_queuehead, &ring->ir_queuetail, rq);
+		ring->ir_nqueued++;
+		cv_signal(ring->ir_workcv, ring->ir_lock);
+	}
+
+	while (ring->ir_idle < ring->ir_nqueued &&
+	       ring->ir_nworkers < IORING_NWORKERS) {
+		result = ioworker_start(ring);
+		if (result) {
+			break;
+		}
+	}
+
+	if (ring->ir_nworkers == 0) {
+		while (ring->ir_queuehead != NULL) {
+			rq = ring->ir_queuehead;
+			ring->ir_queuehead = rq->rq_next;
+			rq->rq_result = result;
+			ioreq_append(&ring->ir_donehead, &ring->ir_donetail,
+				     rq);
+			ring->ir_inflight--;
+		}
+		ring->ir_queuetail = NULL;
+		ring->ir_nqueued = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////
+// rings
+
+/*
+ * Unregister a ring. Requests no worker has started yet are
+ * cancelled and finished requests are thrown away now; idle workers
+ * are woken up to exit. Requests still running are thrown away as
+ * they finish, and the last worker to exit frees the ring.
+ */
+void
+ioring_destroy(struct ioring *ring)
+{
+	struct ioreq *queued, *done;
+	bool idle;
+
+	lock_acquire(ring->ir_lock);
+	KASSERT(!ring->ir_dead);
+	ring->ir_dead = true;
+
+	queued = ring->ir_queuehead;
+	ring->ir_queuehead = ring->ir_queuetail = NULL;
+	KASSERT(ring->ir_inflight >= ring->ir_nqueued);
+	ring->ir_inflight -= ring->ir_nqueued;
+	ring->ir_nqueued = 0;
+
+	done = ring->ir_donehead;
+	ring->ir_donehead = ring->ir_donetail = NULL;
+
+	cv_broadcast(ring->ir_workcv, ring->ir_lock);
+	idle = ring->ir_nworkers == 0;
+	lock_release(ring->ir_lock);
+
+	ioreq_destroylist(queued);
+	ioreq_destroylist(done);
+	if (idle) {
+		ioring_free(ring);
+	}
+}
+
+/*
+ * Take up to TO_SUBMIT entries off the submission queue and start
+ * them. Stops early if the completion queue could overflow or the
+ * ring has too much data in flight. Called with the ring locked.
+ */
+static
+int
+ioring_submit(struct ioring *ring, unsigned to_submit, unsigned *submitted)
+{
+	struct ioreq *rq, *head, *tail;
+	struct io_sqe sqe;
+	userptr_t usqe;
+	unsigned sqtail, n, npages;
+	int result, result2;
+
+	result = copyin(IORING_UFIELD(ring, ir_sqtail), &sqtail, sizeof(sqtail));
+	if (result) {
+		return result;
+	}
+	if (sqtail - ring->ir_sqhead > ring->ir_sqentries) {
+		/* userland has scribbled on its indexes */
+		return EINVAL;
+	}
+	if (to_submit > sqtail - ring->ir_sqhead) {
+		to_submit = sqtail - ring->ir_sqhead;
+	}
+
+	head = tail = NULL;
+	for (n=0; n<to_submit; n++) {
+		if (ring->ir_pending >= ring->ir_cqentries) {
+			break;
+		}
+
+		usqe = ring->ir_usqes + (ring->ir_sqhead &
+			(ring->ir_sqentries - 1)) * sizeof(struct io_sqe);
+		result = copyin(usqe, &sqe, sizeof(sqe));
+		if (result) {
+			break;
+		}
+
+		npages = DIVROUNDUP(ioreq_len(&sqe), PAGE_SIZE);
+		if (ring->ir_npages + npages > IORING_MAXPAGES) {
+			break;
+		}
+
+		rq = ioreq_create(ring, &sqe);
+		if (rq == NULL) {
+			result = ENOMEM;
+			break;
+		}
+		ring->ir_sqhead++;
+		ring->ir_pending++;
+
+		if (ioreq_prepare(ring, rq)) {
+			ioreq_append(&head, &tail, rq);
+			ring->ir_inflight++;
+		}
+		else {
+			ioreq_append(&ring->ir_donehead, &ring->ir_donetail,
+				     rq);
+		}
+	}
+
+	ioworker_queue(ring, head);
+
+	result2 = copyout(&ring->ir_sqhead, IORING_UFIELD(ring, ir_sqhead),
+			  sizeof(ring->ir_sqhead));
+	*submitted = n;
+	return result ? result : result2;
+}
+
+/*
+ * Post finished requests to the completion queue, as far as there's
+ * room, and return how many completions userland has waiting in
+ * *READY. Called with the ring locked.
+ */
+static
+int
+ioring_reap(struct ioring *ring, unsigned *ready)
+{
+	struct ioreq *rq;
+	struct io_cqe cqe;
+	userptr_t ucqe;
+	unsigned cqhead;
+	int result, result2;
+
+	result = copyin(IORING_UFIELD(ring, ir_cqhead), &cqhead, sizeof(cqhead));
+	if (result) {
+		return result;
+	}
+	if (ring->ir_cqtail - cqhead > ring->ir_cqentries) {
+		return EINVAL;
+	}
+
+	while (ring->ir_donehead != NULL &&
+	       ring->ir_cqtail - cqhead < ring->ir_cqentries) {
+		rq = ring->ir_donehead;
+		ring->ir_donehead = rq->rq_next;
+		if (ring->ir_donehead == NULL) {
+			ring->ir_donetail = NULL;
+		}
+
+		ioreq_complete(rq, &cqe);
+		ucqe = ring->ir_ucqes + (ring->ir_cqtail &
+			(ring->ir_cqentries - 1)) * sizeof(struct io_cqe);
+		result = copyout(&cqe, ucqe, sizeof(cqe));
+
+		KASSERT(ring->ir_pending > 0);
+		ring->ir_pending--;
+		ring->ir_npages -= rq->rq_npages;
+		ioreq_destroy(rq);
+
+		if (result) {
+			/* the completion is lost; nothing else we can do */
+			break;
+		}
+		ring->ir_cqtail++;
+	}
+
+	result2 = copyout(&ring->ir_cqtail, IORING_UFIELD(ring, ir_cqtail),
+			  sizeof(ring->ir_cqtail));
+	*ready = ring->ir_cqtail - cqhead;
+	return result ? result : result2;
+}
+
+/*
+ * io_setup: register the rings described by the struct io_rings at
+ * URINGS, resetting their indexes to 0. Passing NULL unregisters the
+ * current rings. A process has at most one set.
+ */
+int
+sys_io_setup(userptr_t urings)
+{
+	struct io_rings kr;
+	struct ioring *ring;
+	int result;
+
+	if (urings == NULL) {
+		if (curproc->p_ioring == NULL) {
+			return EINVAL;
+		}
+		ioring_destroy(curproc->p_ioring);
+		curproc->p_ioring = NULL;
+		return 0;
+	}
+	if (curproc->p_ioring != NULL) {
+		return EBUSY;
+	}
+
+	result = copyin(urings, &kr, sizeof(kr));
+	if (result) {
+		return result;
+	}
+	if (kr.ir_sqentries == 0 || kr.ir_sqentries > IO_MAXENTRIES ||
+	    (kr.ir_sqentries & (kr.ir_sqentries - 1)) != 0 ||
+	    kr.ir_cqentries == 0 || kr.ir_cqentries > IO_MAXENTRIES ||
+	    (kr.ir_cqentries & (kr.ir_cqentries - 1)) != 0) {
+		return EINVAL;
+	}
+	if (kr.ir_usqes == NULL || kr.ir_ucqes == NULL) {
+		return EFAULT;
+	}
+
+	kr.ir_sqhead = kr.ir_sqtail = 0;
+	kr.ir_cqhead = kr.ir_cqtail = 0;
+	result = copyout(&kr, urings, sizeof(kr));
+	if (result) {
+		return result;
+	}
+
+	ring = kmalloc(sizeof(*ring));
+	if (ring == NULL) {
+		return ENOMEM;
+	}
+	ring->ir_lock = lock_create("ioring");
+	if (ring->ir_lock == NULL) {
+		kfree(ring);
+		return ENOMEM;
+	}
+	ring->ir_cv = cv_create("ioring");
+	if (ring->ir_cv == NULL) {
+		lock_destroy(ring->ir_lock);
+		kfree(ring);
+		return ENOMEM;
+	}
+	ring->ir_workcv = cv_create("ioworker");
+	if (ring->ir_workcv == NULL) {
+		cv_destroy(ring->ir_cv);
+		lock_destroy(ring->ir_lock);
+		kfree(ring);
+		return ENOMEM;
+	}
+	ring->ir_urings = urings;
+	ring->ir_usqes = kr.ir_usqes;
+	ring->ir_ucqes = kr.ir_ucqes;
+	ring->ir_sqentries = kr.ir_sqentries;
+	ring->ir_cqentries = kr.ir_cqentries;
+	ring->ir_sqhead = 0;
+	ring->ir_cqtail = 0;
+	ring->ir_pending = 0;
+	ring->ir_inflight = 0;
+	ring->ir_npages = 0;
+	ring->ir_queuehead = ring->ir_queuetail = NULL;
+	ring->ir_nqueued = 0;
+	ring->ir_nworkers = 0;
+	ring->ir_idle = 0;
+	ring->ir_donehead = ring->ir_donetail = NULL;
+	ring->ir_dead = false;
+
+	curproc->p_ioring = ring;
+	return 0;
+}
+
+/*
+ * io_enter: submit up to TO_SUBMIT queued requests, then post
+ * completions, waiting until at least MIN_COMPLETE of them are in
+ * the completion queue (or nothing more is coming). Returns the
+ * number of requests submitted.
+ *
+ * Requests that fail do so through their completions; io_enter
+ * itself fails only if the rings are unusable, or if it couldn't
+ * submit anything at all. (After a partial submission, ir_sqhead
+ * shows where it stopped.)
+ */
+int
+sys_io_enter(unsigned to_submit, unsigned min_complete, int *retval)
+{
+	struct ioring *ring = curproc->p_ioring;
+	unsigned submitted, ready;
+	int result;
+
+	if (ring == NULL) {
+		return EINVAL;
+	}
+
+	lock_acquire(ring->ir_lock);
+
+	result = ioring_submit(ring, to_submit, &submitted);
+	if (result && submitted == 0) {
+		lock_release(ring->ir_lock);
+		return result;
+	}
+
+	if (min_complete > ring->ir_cqentries) {
+		min_complete = ring->ir_cqentries;
+	}
+	while (1) {
+		result = ioring_reap(ring, &ready);
+		if (result) {
+			lock_release(ring->ir_lock);
+			return result;
+		}
+		if (ready >= min_complete || ring->ir_inflight == 0) {
+			break;
+		}
+		cv_wait(ring->ir_cv, ring->ir_lock);
+	}
+
+	lock_release(ring->ir_lock);
+
+	*retval = submitted;
+	return 0;
+}
@@ -42,6 +42,13 @@
  * circumstances, as_prepare_load and as_complete_load probably don't
  * need to do anything.
  *
+ * Repeat execs of the same file are served from the exec image cache
+ * (see execcache.h): the first exec reads the headers and the segment
+ * contents into kernel memory, and later ones copy from there without
+ * touching the filesystem. Read-only segments aren't even copied; the
+ * cached pages are mapped into the new process and shared. Files too
+ * large or odd to cache are loaded directly, the original way.
+ *
  * If you wanted to support memory-mapped executables you would need
  * to rearrange this to map each segment.
  *
@@ -59,6 +66,7 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include <execcache.h>
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -146,27 +154,17 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Read and check the executable header from offset 0 in the file.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elf_readhdr(struct vnode *v, Elf_Ehdr *eh)
 {
-	Elf_Ehdr eh;   /* Executable header */
-	Elf_Phdr ph;   /* "Program header" = segment header */
-	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
-
-	as = proc_getas();
-
-	/*
-	 * Read the executable header from offset 0 in the file.
-	 */
+	int result;
 
-	uio_kinit(&iov, &ku, &eh, sizeof(eh), 0, UIO_READ);
+	uio_kinit(&iov, &ku, eh, sizeof(*eh), 0, UIO_READ);
 	result = VOP_READ(v, &ku);
 	if (result) {
 		return result;
@@ -189,18 +187,93 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * which were not in the original elf spec.)
 	 */
 
-	if (eh.e_ident[EI_MAG0] != ELFMAG0 ||
-	    eh.e_ident[EI_MAG1] != ELFMAG1 ||
-	    eh.e_ident[EI_MAG2] != ELFMAG2 ||
-	    eh.e_ident[EI_MAG3] != ELFMAG3 ||
-	    eh.e_ident[EI_CLASS] != ELFCLASS32 ||
-	    eh.e_ident[EI_DATA] != ELFDATA2MSB ||
-	    eh.e_ident[EI_VERSION] != EV_CURRENT ||
-	    eh.e_version != EV_CURRENT ||
-	    eh.e_type!=ET_EXEC ||
-	    eh.e_machine!=EM_MACHINE) {
+	if (eh->e_ident[EI_MAG0] != ELFMAG0 ||
+	    eh->e_ident[EI_MAG1] != ELFMAG1 ||
+	    eh->e_ident[EI_MAG2] != ELFMAG2 ||
+	    eh->e_ident[EI_MAG3] != ELFMAG3 ||
+	    eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+	    eh->e_ident[EI_DATA] != ELFDATA2MSB ||
+	    eh->e_ident[EI_VERSION] != EV_CURRENT ||
+	    eh->e_version != EV_CURRENT ||
+	    eh->e_type!=ET_EXEC ||
+	    eh->e_machine!=EM_MACHINE) {
+		return ENOEXEC;
+	}
+
+	return 0;
+}
+
+/*
+ * Read program header I, and check that it's a type we understand.
+ * Sets *LOADABLE to say whether it's a PT_LOAD segment or something
+ * that should be skipped.
+ *
+ * Note that the expression eh.e_phoff + i*eh.e_phentsize is
+ * mandated by the ELF standard - we use sizeof(ph) to load,
+ * because that's the structure we know, but the file on disk
+ * might have a larger structure, so we must use e_phentsize
+ * to find where the phdr starts.
+ */
+static
+int
+elf_readphdr(struct vnode *v, const Elf_Ehdr *eh, int i, Elf_Phdr *ph,
+	     bool *loadable)
+{
+	struct iovec iov;
+	struct uio ku;
+	off_t offset;
+	int result;
+
+	offset = eh->e_phoff + i*eh->e_phentsize;
+	uio_kinit(&iov, &ku, ph, sizeof(*ph), offset, UIO_READ);
+
+	result = VOP_READ(v, &ku);
+	if (result) {
+		return result;
+	}
+
+	if (ku.uio_resid != 0) {
+		/* short read; problem with executable? */
+		kprintf("ELF: short read on phdr - file truncated?\n");
+		return ENOEXEC;
+	}
+
+	switch (ph->p_type) {
+	    case PT_NULL: /* skip */ break;
+	    case PT_PHDR: /* skip */ break;
+	    case PT_MIPS_REGINFO: /* skip */ break;
+	    case PT_LOAD:
+		*loadable = true;
+		return 0;
+	    default:
+		kprintf("loadelf: unknown segment type %d\n",
+			ph->p_type);
 		return ENOEXEC;
 	}
+	*loadable = false;
+	return 0;
+}
+
+/*
+ * Load an ELF executable straight from the file into the current
+ * address space, without going through the exec image cache.
+ */
+static
+int
+load_elf_direct(struct vnode *v, vaddr_t *entrypoint)
+{
+	Elf_Ehdr eh;   /* Executable header */
+	Elf_Phdr ph;   /* "Program header" = segment header */
+	int result, i;
+	bool loadable;
+	struct addrspace *as;
+
+	as = proc_getas();
+
+	result = elf_readhdr(v, &eh);
+	if (result) {
+		return result;
+	}
 
 	/*
 	 * Go through the list of segments and set up the address space.
@@ -209,38 +282,15 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * data segment, and one data/bss segment, but there might
 	 * conceivably be more. You don't need to support such files
 	 * if it's unduly awkward to do so.
-	 *
-	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is
-	 * mandated by the ELF standard - we use sizeof(ph) to load,
-	 * because that's the structure we know, but the file on disk
-	 * might have a larger structure, so we must use e_phentsize
-	 * to find where the phdr starts.
 	 */
 
 	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
+		result = elf_readphdr(v, &eh, i, &ph, &loadable);
 		if (result) {
 			return result;
 		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
+		if (!loadable) {
+			continue;
 		}
 
 		result = as_define_region(as,
@@ -263,29 +313,12 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 */
 
 	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
+		result = elf_readphdr(v, &eh, i, &ph, &loadable);
 		if (result) {
 			return result;
 		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
+		if (!loadable) {
+			continue;
 		}
 
 		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
@@ -305,3 +338,306 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 
 	return 0;
 }
+
+/*
+ * Decide whether segment I of IMG can be shared rather than copied.
+ * It must be read-only, start on a page boundary (so cache page J is
+ * exactly user page J), and not share any page with another segment.
+ */
+static
+void
+elf_checkshared(struct execimage *img, int i)
+{
+	struct execseg *seg, *other;
+	vaddr_t start, end, ostart, oend;
+	int k;
+
+	seg = &img->ei_segs[i];
+	if ((seg->es_flags & PF_W) || (seg->es_vaddr & ~PAGE_FRAME) != 0 ||
+	    seg->es_filesz == 0) {
+		return;
+	}
+
+	start = seg->es_vaddr;
+	end = ROUNDUP(seg->es_vaddr + seg->es_filesz, PAGE_SIZE);
+	for (k=0; k<(int)img->ei_nsegs; k++) {
+		if (k == i) {
+			continue;
+		}
+		other = &img->ei_segs[k];
+		ostart = other->es_vaddr & PAGE_FRAME;
+		oend = ROUNDUP(other->es_vaddr + other->es_memsz, PAGE_SIZE);
+		if (ostart < end && start < oend) {
+			return;
+		}
+	}
+	seg->es_shared = true;
+}
+
+/*
+ * Map the pages of a shared segment into AS. This doesn't go through
+ * uiomove, so check by hand that the segment is in user space.
+ */
+static
+int
+share_segment(struct addrspace *as, struct execimage *img,
+	      struct execseg *seg)
+{
+	unsigned j, npages;
+	int result;
+
+	DEBUG(DB_EXEC, "ELF: Sharing %lu cached bytes at 0x%lx\n",
+	      (unsigned long) seg->es_filesz,
+	      (unsigned long) seg->es_vaddr);
+
+	npages = DIVROUNDUP(seg->es_filesz, PAGE_SIZE);
+	if (seg->es_vaddr >= USERSPACETOP ||
+	    npages > (USERSPACETOP - seg->es_vaddr) / PAGE_SIZE) {
+		return EFAULT;
+	}
+	for (j=0; j<npages; j++) {
+		result = as_share_page(as, seg->es_vaddr + j*PAGE_SIZE,
+			(vaddr_t)img->ei_pages[seg->es_firstpage + j]);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Read an executable into a new exec image: the segment table from
+ * the program headers, and the file-backed part of each segment into
+ * kernel pages. If the executable is too big (or has too many
+ * segments) to be worth caching, returns 0 with *RET set to NULL.
+ */
+static
+int
+elf_readimage(struct vnode *v, struct execimage **ret)
+{
+	Elf_Ehdr eh;
+	Elf_Phdr ph;
+	struct execimage *img;
+	struct execseg *seg;
+	struct iovec iov;
+	struct uio ku;
+	unsigned npages, j;
+	size_t len;
+	bool loadable;
+	int result, i;
+
+	*ret = NULL;
+
+	result = elf_readhdr(v, &eh);
+	if (result) {
+		return result;
+	}
+
+	img = execimage_create(v);
+	if (img == NULL) {
+		return ENOMEM;
+	}
+	img->ei_entry = eh.e_entry;
+
+	for (i=0; i<eh.e_phnum; i++) {
+		result = elf_readphdr(v, &eh, i, &ph, &loadable);
+		if (result) {
+			execcache_release(img);
+			return result;
+		}
+		if (!loadable) {
+			continue;
+		}
+
+		if (ph.p_filesz > ph.p_memsz) {
+			kprintf("ELF: warning: segment filesize > "
+				"segment memsize\n");
+			ph.p_filesz = ph.p_memsz;
+		}
+
+		npages = DIVROUNDUP(ph.p_filesz, PAGE_SIZE);
+		if (img->ei_nsegs == EXECCACHE_MAXSEGS ||
+		    img->ei_npages + npages > EXECCACHE_MAXPAGES) {
+			/* Not cacheable; load it the old way. */
+			execcache_release(img);
+			return 0;
+		}
+
+		seg = &img->ei_segs[img->ei_nsegs++];
+		seg->es_vaddr = ph.p_vaddr;
+		seg->es_memsz = ph.p_memsz;
+		seg->es_filesz = ph.p_filesz;
+		seg->es_offset = ph.p_offset;
+		seg->es_flags = ph.p_flags;
+		seg->es_firstpage = img->ei_npages;
+		seg->es_shared = false;
+		img->ei_npages += npages;
+	}
+
+	for (i=0; i<(int)img->ei_nsegs; i++) {
+		elf_checkshared(img, i);
+	}
+
+	/*
+	 * Now read the segment contents. ei_npages is rebuilt as the
+	 * pages are allocated so a failure part way frees only those.
+	 */
+	npages = img->ei_npages;
+	img->ei_npages = 0;
+	for (i=0; i<(int)img->ei_nsegs; i++) {
+		seg = &img->ei_segs[i];
+		KASSERT(seg->es_firstpage == img->ei_npages);
+		for (j=0; j*PAGE_SIZE < seg->es_filesz; j++) {
+			len = seg->es_filesz - j*PAGE_SIZE;
+			if (len > PAGE_SIZE) {
+				len = PAGE_SIZE;
+			}
+
+			img->ei_pages[img->ei_npages] = kmalloc(PAGE_SIZE);
+			if (img->ei_pages[img->ei_npages] == NULL) {
+				execcache_release(img);
+				return ENOMEM;
+			}
+			img->ei_npages++;
+			if (len < PAGE_SIZE) {
+				/* the tail must read as zeros if shared */
+				bzero((char *)img->ei_pages[img->ei_npages-1]
+				      + len, PAGE_SIZE - len);
+			}
+
+			uio_kinit(&iov, &ku, img->ei_pages[img->ei_npages-1],
+				  len, seg->es_offset + j*PAGE_SIZE,
+				  UIO_READ);
+			result = VOP_READ(v, &ku);
+			if (result) {
+				execcache_release(img);
+				return result;
+			}
+			if (ku.uio_resid != 0) {
+				/* short read; problem with executable? */
+				kprintf("ELF: short read on segment - "
+					"file truncated?\n");
+				execcache_release(img);
+				return ENOEXEC;
+			}
+		}
+	}
+	KASSERT(img->ei_npages == npages);
+
+	*ret = img;
+	return 0;
+}
+
+/*
+ * Set up the current address space from an exec image and copy the
+ * segments into it. As with load_segment, uiomove checks that the
+ * segments are really in user space, and the VM system hands us
+ * zero-filled pages for the rest of each segment.
+ */
+static
+int
+load_image(struct execimage *img, vaddr_t *entrypoint)
+{
+	struct addrspace *as;
+	struct execseg *seg;
+	struct iovec iov;
+	struct uio u;
+	unsigned i, j;
+	size_t len;
+	int result;
+
+	as = proc_getas();
+
+	for (i=0; i<img->ei_nsegs; i++) {
+		seg = &img->ei_segs[i];
+		result = as_define_region(as,
+					  seg->es_vaddr, seg->es_memsz,
+					  seg->es_flags & PF_R,
+					  seg->es_flags & PF_W,
+					  seg->es_flags & PF_X);
+		if (result) {
+			return result;
+		}
+	}
+
+	result = as_prepare_load(as);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<img->ei_nsegs; i++) {
+		seg = &img->ei_segs[i];
+
+		if (seg->es_shared) {
+			result = share_segment(as, img, seg);
+			if (result != ENOSYS) {
+				if (result) {
+					return result;
+				}
+				continue;
+			}
+			/* VM can't share pages; copy instead */
+		}
+
+		DEBUG(DB_EXEC, "ELF: Copying %lu cached bytes to 0x%lx\n",
+		      (unsigned long) seg->es_filesz,
+		      (unsigned long) seg->es_vaddr);
+
+		iov.iov_ubase = (userptr_t)seg->es_vaddr;
+		iov.iov_len = seg->es_memsz;
+		u.uio_iov = &iov;
+		u.uio_iovcnt = 1;
+		u.uio_resid = seg->es_filesz;
+		u.uio_offset = 0;
+		u.uio_segflg = (seg->es_flags & PF_X) ?
+			UIO_USERISPACE : UIO_USERSPACE;
+		u.uio_rw = UIO_READ;
+		u.uio_space = as;
+
+		for (j=0; u.uio_resid > 0; j++) {
+			len = u.uio_resid < PAGE_SIZE ? u.uio_resid : PAGE_SIZE;
+			result = uiomove(img->ei_pages[seg->es_firstpage + j],
+					 len, &u);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
+	result = as_complete_load(as);
+	if (result) {
+		return result;
+	}
+
+	*entrypoint = img->ei_entry;
+	return 0;
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct execimage *img;
+	unsigned gen;
+	int result;
+
+	img = execcache_lookup(v, &gen);
+	if (img == NULL) {
+		result = elf_readimage(v, &img);
+		if (result) {
+			return result;
+		}
+		if (img == NULL) {
+			return load_elf_direct(v, entrypoint);
+		}
+		execcache_insert(img, gen);
+	}
+
+	result = load_image(img, entrypoint);
+	execcache_release(img);
+	return result;
+}
@@ -42,7 +42,6 @@
 /*
  * Constructor for struct openfile.
  */
-static
 struct openfile *
 openfile_create(struct vnode *vn, int accmode)
 {
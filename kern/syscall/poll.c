@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll(), and the readiness wait queues that support it.
+ *
+ * A poll call builds a pollset: a wait channel, a "woken" flag, a
+ * timeout timer, and one pollent per queue it might be attached to.
+ * The first pass over the file handles calls VOP_POLL with the
+ * pollset, which attaches it to each object's queue(s); later passes
+ * only look. Between passes poll sleeps until some queue it's on is
+ * woken or the timer goes off. The woken flag is cleared before each
+ * pass, so a wakeup that happens during a pass isn't lost.
+ *
+ * Lock order: pq_lock, then ps_lock. The timer function takes only
+ * ps_lock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <timer.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <poll.h>
+#include <syscall.h>
+
+struct pollent {
+	struct pollset *pe_set;		/* owner */
+	struct pollq *pe_q;		/* queue we're on */
+	struct pollent *pe_next;	/* next on that queue */
+};
+
+struct pollset {
+	struct spinlock ps_lock;	/* protects ps_woken, ps_timedout */
+	struct wchan *ps_wchan;		/* poll sleeps here */
+	bool ps_woken;			/* a queue was woken */
+	bool ps_timedout;		/* the timer went off */
+	struct timer ps_timer;		/* timeout */
+	unsigned ps_nents;		/* entries in use */
+	unsigned ps_maxents;		/* entries allocated */
+	struct pollent ps_ents[];	/* one per attachment */
+};
+
+////////////////////////////////////////////////////////////
+// queues
+
+void
+pollq_init(struct pollq *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_head = NULL;
+}
+
+void
+pollq_cleanup(struct pollq *pq)
+{
+	KASSERT(pq->pq_head == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+/*
+ * Wake up every poll call attached to PQ.
+ */
+void
+pollq_wakeup(struct pollq *pq)
+{
+	struct pollent *pe;
+	struct pollset *ps;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_head; pe != NULL; pe = pe->pe_next) {
+		ps = pe->pe_set;
+		spinlock_acquire(&ps->ps_lock);
+		ps->ps_woken = true;
+		wchan_wakeall(ps->ps_wchan, &ps->ps_lock);
+		spinlock_release(&ps->ps_lock);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+/*
+ * Attach PS to PQ. Called from VOP_POLL; does nothing if PS is NULL,
+ * as it is on every pass but the first.
+ */
+void
+pollset_add(struct pollset *ps, struct pollq *pq)
+{
+	struct pollent *pe;
+
+	if (ps == NULL) {
+		return;
+	}
+	KASSERT(ps->ps_nents < ps->ps_maxents);
+	pe = &ps->ps_ents[ps->ps_nents++];
+	pe->pe_set = ps;
+	pe->pe_q = pq;
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_next = pq->pq_head;
+	pq->pq_head = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// pollsets
+
+static
+void
+pollset_timeout(void *data)
+{
+	struct pollset *ps = data;
+
+	spinlock_acquire(&ps->ps_lock);
+	ps->ps_timedout = true;
+	wchan_wakeall(ps->ps_wchan, &ps->ps_lock);
+	spinlock_release(&ps->ps_lock);
+}
+
+static
+struct pollset *
+pollset_create(unsigned nfds)
+{
+	struct pollset *ps;
+	unsigned max;
+
+	max = nfds * POLL_MAXQUEUES;
+	ps = kmalloc(sizeof(*ps) + max * sizeof(struct pollent));
+	if (ps == NULL) {
+		return NULL;
+	}
+	ps->ps_wchan = wchan_create("poll");
+	if (ps->ps_wchan == NULL) {
+		kfree(ps);
+		return NULL;
+	}
+	spinlock_init(&ps->ps_lock);
+	ps->ps_woken = false;
+	ps->ps_timedout = false;
+	timer_init(&ps->ps_timer, pollset_timeout, ps);
+	ps->ps_nents = 0;
+	ps->ps_maxents = max;
+	return ps;
+}
+
+/*
+ * Detach from all queues and free.
+ */
+static
+void
+pollset_destroy(struct pollset *ps)
+{
+	struct pollent *pe, **pep;
+	struct pollq *pq;
+	unsigned i;
+
+	for (i=0; i<ps->ps_nents; i++) {
+		pe = &ps->ps_ents[i];
+		pq = pe->pe_q;
+		spinlock_acquire(&pq->pq_lock);
+		for (pep = &pq->pq_head; *pep != pe; pep = &(*pep)->pe_next) {
+			KASSERT(*pep != NULL);
+		}
+		*pep = pe->pe_next;
+		spinlock_release(&pq->pq_lock);
+	}
+
+	spinlock_cleanup(&ps->ps_lock);
+	wchan_destroy(ps->ps_wchan);
+	kfree(ps);
+}
+
+/*
+ * Convert a poll timeout in milliseconds to ticks, rounding up and
+ * clamping rather than overflowing.
+ */
+static
+unsigned
+poll_ticks(int timeout)
+{
+	unsigned secs, ms;
+
+	secs = timeout / 1000;
+	ms = timeout % 1000;
+	if (secs > 0x7fffffff / HZ - 1) {
+		return 0x7fffffff;
+	}
+	return secs * HZ + DIVROUNDUP(ms * HZ, 1000);
+}
+
+////////////////////////////////////////////////////////////
+// poll
+
+/*
+ * Check every file handle once; return how many had events. The
+ * first time around, PS is passed to VOP_POLL to attach it.
+ */
+static
+unsigned
+poll_scan(struct pollfd *kfds, struct openfile **files, unsigned nfds,
+	  struct pollset *ps)
+{
+	const int always = POLLERR | POLLHUP | POLLNVAL;
+	unsigned i, n;
+
+	n = 0;
+	for (i=0; i<nfds; i++) {
+		if (kfds[i].fd < 0) {
+			kfds[i].revents = 0;
+			continue;
+		}
+		if (files[i] == NULL) {
+			kfds[i].revents = POLLNVAL;
+		}
+		else {
+			kfds[i].revents = VOP_POLL(files[i]->of_vnode,
+						   kfds[i].events, ps);
+			kfds[i].revents &= kfds[i].events | always;
+		}
+		if (kfds[i].revents != 0) {
+			n++;
+		}
+	}
+	return n;
+}
+
+/*
+ * poll: wait until at least one of the NFDS file handles in UFDS is
+ * ready for one of the events asked for, or TIMEOUT milliseconds have
+ * passed (forever if TIMEOUT is negative; not at all if it's 0).
+ * Returns the number of file handles with events to report.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct pollfd *kfds;
+	struct openfile **files;
+	struct pollset *ps;
+	unsigned i, n, ticks;
+	bool timedout;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	kfds = kmalloc(nfds * sizeof(*kfds));
+	files = kmalloc(nfds * sizeof(*files));
+	if (kfds == NULL || files == NULL) {
+		kfree(kfds);
+		kfree(files);
+		return ENOMEM;
+	}
+	result = copyin(ufds, kfds, nfds * sizeof(*kfds));
+	if (result) {
+		kfree(kfds);
+		kfree(files);
+		return result;
+	}
+
+	/* hold a reference to each file so it can't vanish while we wait */
+	for (i=0; i<nfds; i++) {
+		files[i] = NULL;
+		if (kfds[i].fd < 0 ||
+		    filetable_get(curproc->p_filetable, kfds[i].fd,
+				  &files[i])) {
+			continue;
+		}
+		openfile_incref(files[i]);
+		filetable_put(curproc->p_filetable, kfds[i].fd, files[i]);
+	}
+
+	ps = pollset_create(nfds);
+	if (ps == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+
+	ticks = timeout > 0 ? poll_ticks(timeout) : 0;
+	if (ticks > 0) {
+		timer_add(&ps->ps_timer, ticks);
+	}
+
+	n = poll_scan(kfds, files, nfds, ps);
+	while (n == 0 && timeout != 0) {
+		spinlock_acquire(&ps->ps_lock);
+		while (!ps->ps_woken && !ps->ps_timedout) {
+			wchan_sleep(ps->ps_wchan, &ps->ps_lock);
+		}
+		timedout = ps->ps_timedout && !ps->ps_woken;
+		ps->ps_woken = false;
+		spinlock_release(&ps->ps_lock);
+
+		if (timedout) {
+			break;
+		}
+		n = poll_scan(kfds, files, nfds, NULL);
+	}
+
+	if (ticks > 0) {
+		timer_cancel(&ps->ps_timer);
+	}
+	pollset_destroy(ps);
+
+	result = copyout(kfds, ufds, nfds * sizeof(*kfds));
+	if (result == 0) {
+		*retval = n;
+	}
+
+ out:
+	for (i=0; i<nfds; i++) {
+		if (files[i] != NULL) {
+			openfile_decref(files[i]);
+		}
+	}
+	kfree(kfds);
+	kfree(files);
+	return result;
+}
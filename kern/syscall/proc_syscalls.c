@@ -34,6 +34,8 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
@@ -157,3 +159,42 @@ sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 	}
 	return result;
 }
+
+/*
+ * sys_getrusage
+ * report the accounting for this process or its reaped children.
+ * Reads the counters without locking; they may be a tick stale.
+ */
+int
+sys_getrusage(int who, userptr_t uru)
+{
+	const struct proc_rusage *pr;
+	struct rusage ru;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		pr = &curproc->p_ru;
+		break;
+	    case RUSAGE_CHILDREN:
+		pr = &curproc->p_cru;
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	ru.ru_utime.tv_sec = pr->pr_utime / HZ;
+	ru.ru_utime.tv_usec = (pr->pr_utime % HZ) * (1000000 / HZ);
+	ru.ru_stime.tv_sec = pr->pr_stime / HZ;
+	ru.ru_stime.tv_usec = (pr->pr_stime % HZ) * (1000000 / HZ);
+	ru.ru_minflt = pr->pr_minflt + pr->pr_cowflt;
+	ru.ru_majflt = pr->pr_majflt;
+	ru.ru_nvcsw = pr->pr_nvcsw;
+	ru.ru_nivcsw = pr->pr_nivcsw;
+	ru.ru_tlbrefill = pr->pr_tlbrefills;
+	ru.ru_cowflt = pr->pr_cowflt;
+	ru.ru_inbytes = pr->pr_inbytes;
+	ru.ru_outbytes = pr->pr_outbytes;
+
+	return copyout(&ru, uru, sizeof(ru));
+}
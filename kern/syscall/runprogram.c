@@ -47,6 +47,9 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <ioring.h>
+#include <timepage.h>
+#include <workqueue.h>
 #include <syscall.h>
 #include <test.h>
 
@@ -55,11 +58,29 @@
  *
  * This is an abstraction that holds an argv while it's being shuffled
  * through the kernel during exec.
+ *
+ * It is page-granular, since we can't allocate more than a page of
+ * contiguous kernel memory: the argument strings are packed end to end
+ * across a list of string pages, and the argv array (one slot per
+ * argument plus the ending NULL) goes in a separate list of pointer
+ * pages. While copying in, each pointer slot holds the offset of its
+ * string; at copyout time they are turned into user addresses in place
+ * and both lists go out a page at a time, which is much cheaper than a
+ * copyout per pointer and per string. Pages are added as needed, so an
+ * argv that outgrows the first page doesn't have to be copied again.
+ *
+ * Like most systems we count the pointers against ARG_MAX as well as
+ * the strings.
  */
+#define ARGBUF_MAXPAGES		(ARG_MAX / PAGE_SIZE + 1)
+#define ARGBUF_PTRSPERPAGE	(PAGE_SIZE / sizeof(userptr_t))
+
 struct argbuf {
-	char *data;
-	size_t len;
-	size_t max;
+	char *strpages[ARGBUF_MAXPAGES];	/* the strings */
+	userptr_t *ptrpages[ARGBUF_MAXPAGES];	/* argv array */
+	unsigned nstrpages;
+	unsigned nptrpages;
+	size_t len;				/* bytes of strings */
 	int nargs;
 	bool tooksem;
 };
@@ -67,9 +88,11 @@ struct argbuf {
 /*
  * Throttle to limit the number of processes in exec at once. Or,
  * rather, the number trying to use large exec buffers at once. See
- * design notes for the rationale.
+ * design notes for the rationale. A small argv (one page each of
+ * strings and pointers) never waits.
  */
 #define EXEC_BIGBUF_THROTTLE	1
+#define EXEC_SMALLBUF_PAGES	2
 static struct semaphore *execthrottle;
 
 /*
@@ -91,9 +114,9 @@ static
 void
 argbuf_init(struct argbuf *buf)
 {
-	buf->data = NULL;
+	buf->nstrpages = 0;
+	buf->nptrpages = 0;
 	buf->len = 0;
-	buf->max = 0;
 	buf->nargs = 0;
 	buf->tooksem = false;
 }
@@ -105,12 +128,17 @@ static
 void
 argbuf_cleanup(struct argbuf *buf)
 {
-	if (buf->data != NULL) {
-		kfree(buf->data);
-		buf->data = NULL;
+	unsigned i;
+
+	for (i=0; i<buf->nstrpages; i++) {
+		kfree(buf->strpages[i]);
 	}
+	for (i=0; i<buf->nptrpages; i++) {
+		kfree(buf->ptrpages[i]);
+	}
+	buf->nstrpages = 0;
+	buf->nptrpages = 0;
 	buf->len = 0;
-	buf->max = 0;
 	buf->nargs = 0;
 	if (buf->tooksem) {
 		V(execthrottle);
@@ -119,20 +147,127 @@ argbuf_cleanup(struct argbuf *buf)
 }
 
 /*
- * Allocate the memory for an argv buffer.
+ * Allocate another page for an argv buffer.
+ */
+static
+void *
+argbuf_getpage(struct argbuf *buf)
+{
+	if (buf->nstrpages + buf->nptrpages >= EXEC_SMALLBUF_PAGES &&
+	    !buf->tooksem) {
+		/* Wait on the semaphore, to throttle big allocations */
+		P(execthrottle);
+		buf->tooksem = true;
+	}
+	return kmalloc(PAGE_SIZE);
+}
+
+/*
+ * Return how many more bytes of string fit under ARG_MAX, counting
+ * the pointers already placed and the ending NULL.
+ */
+static
+size_t
+argbuf_room(struct argbuf *buf)
+{
+	size_t used;
+
+	used = buf->len + (buf->nargs + 1) * sizeof(userptr_t);
+	KASSERT(used <= ARG_MAX);
+	return ARG_MAX - used;
+}
+
+/*
+ * Get the next free stretch of string space, adding a page if the
+ * last one is full. Returns it in *PTR, with its length (to the end
+ * of the page, or the ARG_MAX limit) in *ROOM.
  */
 static
 int
-argbuf_allocate(struct argbuf *buf, size_t size)
+argbuf_strspace(struct argbuf *buf, char **ptr, size_t *room)
 {
-	buf->data = kmalloc(size);
-	if (buf->data == NULL) {
-		return ENOMEM;
+	size_t pageoff, limit;
+	char *page;
+
+	limit = argbuf_room(buf);
+	if (limit == 0) {
+		return E2BIG;
+	}
+
+	pageoff = buf->len % PAGE_SIZE;
+	if (buf->len == buf->nstrpages * PAGE_SIZE) {
+		KASSERT(buf->nstrpages < ARGBUF_MAXPAGES);
+		page = argbuf_getpage(buf);
+		if (page == NULL) {
+			return ENOMEM;
+		}
+		buf->strpages[buf->nstrpages++] = page;
+	}
+
+	*ptr = buf->strpages[buf->len / PAGE_SIZE] + pageoff;
+	*room = PAGE_SIZE - pageoff;
+	if (*room > limit) {
+		*room = limit;
 	}
-	buf->max = size;
 	return 0;
 }
 
+/*
+ * Set argv slot SLOT to VAL, adding a pointer page if needed.
+ */
+static
+int
+argbuf_setptr(struct argbuf *buf, int slot, userptr_t val)
+{
+	unsigned page;
+	void *ptrpage;
+
+	page = slot / ARGBUF_PTRSPERPAGE;
+	if (page == buf->nptrpages) {
+		KASSERT(buf->nptrpages < ARGBUF_MAXPAGES);
+		ptrpage = argbuf_getpage(buf);
+		if (ptrpage == NULL) {
+			return ENOMEM;
+		}
+		buf->ptrpages[buf->nptrpages++] = ptrpage;
+	}
+	KASSERT(page < buf->nptrpages);
+	buf->ptrpages[page][slot % ARGBUF_PTRSPERPAGE] = val;
+	return 0;
+}
+
+/*
+ * Start a new argument: check it has room for its pointer and at
+ * least its terminating null, and record where its string begins.
+ */
+static
+int
+argbuf_newarg(struct argbuf *buf)
+{
+	int result;
+
+	if (argbuf_room(buf) < sizeof(userptr_t) + 1) {
+		return E2BIG;
+	}
+	/* Stash the string's offset; argbuf_copyout fixes it up. */
+	result = argbuf_setptr(buf, buf->nargs, (userptr_t)buf->len);
+	if (result) {
+		return result;
+	}
+	buf->nargs++;
+	return 0;
+}
+
+/*
+ * Close off the argv by placing the ending NULL.
+ */
+static
+int
+argbuf_finish(struct argbuf *buf)
+{
+	return argbuf_setptr(buf, buf->nargs, NULL);
+}
+
 /*
  * Prepare an argv buffer for runprogram, using a kernel pointer.
  *
@@ -143,108 +278,123 @@ static
 int
 argbuf_fromkernel(struct argbuf *buf, const char *progname)
 {
-	size_t len;
+	size_t len, room;
+	char *dest;
 	int result;
 
-	len = strlen(progname) + 1;
-
-	result = argbuf_allocate(buf, len);
+	result = argbuf_newarg(buf);
 	if (result) {
 		return result;
 	}
-	strcpy(buf->data, progname);
-	buf->len = len;
-	buf->nargs = 1;
 
-	return 0;
+	len = strlen(progname) + 1;
+	while (len > 0) {
+		result = argbuf_strspace(buf, &dest, &room);
+		if (result) {
+			return result;
+		}
+		if (room > len) {
+			room = len;
+		}
+		memcpy(dest, progname, room);
+		progname += room;
+		buf->len += room;
+		len -= room;
+	}
+
+	return argbuf_finish(buf);
 }
 
 /*
- * Copy an argv array into kernel space, using an argvdata buffer.
+ * Copy one argument string into the buffer. It may run across the
+ * end of a string page; copyinstr fills all the space it's given
+ * before failing with ENAMETOOLONG, so we can just carry on in the
+ * next page.
  */
 static
 int
-argbuf_copyin(struct argbuf *buf, userptr_t uargv)
+argbuf_copyinstr(struct argbuf *buf, userptr_t uarg)
 {
-	userptr_t thisarg;
-	size_t thisarglen;
+	size_t room, gotlen;
+	char *dest;
 	int result;
 
-	/* loop through the argv, grabbing each arg string */
-	buf->nargs = 0;
 	while (1) {
-		/*
-		 * First, grab the pointer at argv.
-		 * (argv is incremented at the end of the loop)
-		 */
-		result = copyin(uargv, &thisarg, sizeof(userptr_t));
+		result = argbuf_strspace(buf, &dest, &room);
 		if (result) {
 			return result;
 		}
 
-		/* If we got NULL, we're at the end of the argv. */
-		if (thisarg == NULL) {
-			break;
+		result = copyinstr(uarg, dest, room, &gotlen);
+		if (result == 0) {
+			/* gotlen includes the \0. */
+			buf->len += gotlen;
+			return 0;
 		}
-
-		/* Use the pointer to fetch the argument string. */
-		result = copyinstr(thisarg, buf->data + buf->len,
-				   buf->max - buf->len, &thisarglen);
-		if (result == ENAMETOOLONG) {
-			return E2BIG;
-		}
-		else if (result) {
+		if (result != ENAMETOOLONG) {
 			return result;
 		}
 
-		/* Move ahead. Note: thisarglen includes the \0. */
-		buf->len += thisarglen;
-		uargv += sizeof(userptr_t);
-		buf->nargs++;
+		/* Filled this stretch; keep going. */
+		buf->len += room;
+		uarg += room;
 	}
-
-	return 0;
 }
 
 /*
  * Get an argv from user space.
+ *
+ * The user's pointers are fetched in batches rather than one copyin
+ * apiece. A batch never runs past the end of the page it starts on,
+ * so we can't fault on memory beyond the argv's NULL that the caller
+ * didn't promise us.
  */
+#define ARGBUF_PTRBATCH 32
+
 static
 int
 argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
 {
+	userptr_t uptrs[ARGBUF_PTRBATCH];
+	size_t n, i;
 	int result;
 
-	/* try with a small buffer */
-	result = argbuf_allocate(buf, PAGE_SIZE);
-	if (result) {
-		return result;
-	}
-
-	/* do the copyin */
-	result = argbuf_copyin(buf, uargv);
-	if (result == E2BIG) {
-		/*
-		 * Try again with the full-size buffer. Just start
-		 * over instead of trying to keep the page we already
-		 * did; this is a bit inefficient but it's not that
-		 * important.
-		 */
-		argbuf_cleanup(buf);
-		argbuf_init(buf);
-
-		/* Wait on the semaphore, to throttle this allocation */
-		P(execthrottle);
-		buf->tooksem = true;
-
-		result = argbuf_allocate(buf, ARG_MAX);
+	/* loop through the argv, grabbing each arg string */
+	buf->nargs = 0;
+	while (1) {
+		/* First, grab a batch of pointers at argv. */
+		n = (PAGE_SIZE - ((vaddr_t)uargv & ~PAGE_FRAME))
+			/ sizeof(userptr_t);
+		if (n == 0) {
+			/* misaligned, and straddles a page */
+			n = 1;
+		}
+		if (n > ARGBUF_PTRBATCH) {
+			n = ARGBUF_PTRBATCH;
+		}
+		result = copyin(uargv, uptrs, n * sizeof(userptr_t));
 		if (result) {
 			return result;
 		}
 
-		result = argbuf_copyin(buf, uargv);
+		for (i=0; i<n; i++) {
+			/* If we got NULL, we're at the end of the argv. */
+			if (uptrs[i] == NULL) {
+				return argbuf_finish(buf);
+			}
+
+			/* Use the pointer to fetch the argument string. */
+			result = argbuf_newarg(buf);
+			if (result) {
+				return result;
+			}
+			result = argbuf_copyinstr(buf, uptrs[i]);
+			if (result) {
+				return result;
+			}
+		}
+		uargv += n * sizeof(userptr_t);
 	}
-	return result;
 }
 
 /*
@@ -258,10 +408,11 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	       int *argc_ret, userptr_t *uargv_ret)
 {
 	vaddr_t ustack;
-	userptr_t ustringbase, uargvbase, uargv_i;
-	userptr_t thisarg;
-	size_t thisarglen;
-	size_t pos;
+	userptr_t ustringbase, uargvbase;
+	userptr_t *slot;
+	size_t total, chunk;
+	unsigned i;
+	int n;
 	int result;
 
 	/* Begin the stack at the passed in top. */
@@ -270,7 +421,7 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	/*
 	 * Allocate space.
 	 *
-	 * buf->pos is the amount of space used by the strings; put that
+	 * buf->len is the amount of space used by the strings; put that
 	 * first, then align the stack, then make space for the argv
 	 * pointers. Allow an extra slot for the ending NULL.
 	 */
@@ -282,38 +433,36 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	ustack -= (buf->nargs + 1) * sizeof(userptr_t);
 	uargvbase = (userptr_t)ustack;
 
-	/* Now copy the data out. */
-	pos = 0;
-	uargv_i = uargvbase;
-	while (pos < buf->len) {
-		/* The user address of the string will be ustringbase + pos. */
-		thisarg = ustringbase + pos;
+	/* Turn the string offsets into user addresses. */
+	for (n=0; n<buf->nargs; n++) {
+		slot = &buf->ptrpages[n / ARGBUF_PTRSPERPAGE]
+			[n % ARGBUF_PTRSPERPAGE];
+		*slot = ustringbase + (size_t)*slot;
+	}
 
-		/* Place it in the argv array. */
-		result = copyout(&thisarg, uargv_i, sizeof(thisarg));
+	/* Now copy the data out, a page at a time. */
+	total = (buf->nargs + 1) * sizeof(userptr_t);
+	for (i=0; i*PAGE_SIZE < total; i++) {
+		chunk = total - i*PAGE_SIZE;
+		if (chunk > PAGE_SIZE) {
+			chunk = PAGE_SIZE;
+		}
+		result = copyout(buf->ptrpages[i], uargvbase + i*PAGE_SIZE,
+				 chunk);
 		if (result) {
 			return result;
 		}
-
-		/* Push out the string. */
-		result = copyoutstr(buf->data + pos, thisarg,
-				    buf->len - pos, &thisarglen);
+	}
+	for (i=0; i*PAGE_SIZE < buf->len; i++) {
+		chunk = buf->len - i*PAGE_SIZE;
+		if (chunk > PAGE_SIZE) {
+			chunk = PAGE_SIZE;
+		}
+		result = copyout(buf->strpages[i], ustringbase + i*PAGE_SIZE,
+				 chunk);
 		if (result) {
 			return result;
 		}
-
-		/* thisarglen includes the \0 */
-		pos += thisarglen;
-		uargv_i += sizeof(thisarg);
-	}
-	/* Should have come out even... */
-	KASSERT(pos == buf->len);
-
-	/* Add the NULL. */
-	thisarg = NULL;
-	result = copyout(&thisarg, uargv_i, sizeof(userptr_t));
-	if (result) {
-		return result;
 	}
 
 	*ustackp = ustack;
@@ -327,7 +476,8 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
  */
 static
 int
-loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
+loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr,
+	 vaddr_t *timepage)
 {
 	struct addrspace *newvm, *oldvm;
 	struct vnode *v;
@@ -385,6 +535,16 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		return result;
         }
 
+	/* Map the time page, if the VM system can */
+	result = timepage_map(newvm, timepage);
+	if (result) {
+		proc_setas(oldvm);
+		as_activate();
+		as_destroy(newvm);
+		kfree(newname);
+		return result;
+	}
+
 	/*
 	 * Wipe out old address space.
 	 *
@@ -395,11 +555,19 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		as_destroy(oldvm);
 	}
 
+	/* Any I/O rings were in the old address space, so they're gone. */
+	if (curproc->p_ioring != NULL) {
+		ioring_destroy(curproc->p_ioring);
+		curproc->p_ioring = NULL;
+	}
+
 	/*
 	 * Now that we know we're succeeding, change the current thread's
 	 * name to reflect the new process.
 	 */
-	kfree(curthread->t_name);
+	if (curthread->t_name != curthread->t_namebuf) {
+		kfree(curthread->t_name);
+	}
 	curthread->t_name = newname;
 
 	return 0;
@@ -483,7 +651,7 @@ int
 runprogram(char *progname)
 {
 	struct argbuf kargv;
-	vaddr_t entrypoint, stackptr;
+	vaddr_t entrypoint, stackptr, timepage;
 	int argc;
 	userptr_t uargv;
 	int result;
@@ -519,7 +687,7 @@ runprogram(char *progname)
 	}
 
 	/* Load the executable. Note: must not fail after this succeeds. */
-	result = loadexec(progname, &entrypoint, &stackptr);
+	result = loadexec(progname, &entrypoint, &stackptr, &timepage);
 	if (result) {
 		argbuf_cleanup(&kargv);
 		return result;
@@ -535,7 +703,8 @@ runprogram(char *progname)
 	argbuf_cleanup(&kargv);
 
 	/* Warp to user mode. */
-	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+	enter_new_process(argc, uargv, NULL /*uenv*/,
+			  (userptr_t)timepage, stackptr, entrypoint);
 
 	/* enter_new_process does not return. */
 	panic("enter_new_process returned\n");
@@ -556,7 +725,7 @@ sys_execv(userptr_t prog, userptr_t uargv)
 {
 	char *path;
 	struct argbuf kargv;
-	vaddr_t entrypoint, stackptr;
+	vaddr_t entrypoint, stackptr, timepage;
 	int argc;
 	int result;
 
@@ -584,7 +753,12 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	}
 
 	/* Load the executable. Note: must not fail after this succeeds. */
-	result = loadexec(path, &entrypoint, &stackptr);
+	result = loadexec(path, &entrypoint, &stackptr, &timepage);
+	if (result == ENOMEM) {
+		/* exited processes' memory may still be in the reaper */
+		workqueue_flush();
+		result = loadexec(path, &entrypoint, &stackptr, &timepage);
+	}
 	if (result) {
 		argbuf_cleanup(&kargv);
 		kfree(path);
@@ -605,7 +779,8 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	argbuf_cleanup(&kargv);
 
 	/* Warp to user mode. */
-	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+	enter_new_process(argc, uargv, NULL /*uenv*/,
+			  (userptr_t)timepage, stackptr, entrypoint);
 
 	/* enter_new_process does not return. */
 	panic("enter_new_process returned\n");
@@ -89,6 +89,11 @@ sbrk(intptr_t amount) {
         /* inclusive of amount = 0 */
         heap_region->size += amount;
 
+        /* give back the pages we shrank away from */
+        if (amount < 0) {
+                release_hpt(as, end_of_heap, og_break);
+        }
+
         return og_break;
 }
 
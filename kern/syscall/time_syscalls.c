@@ -28,10 +28,15 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
+#include <timer.h>
 #include <copyinout.h>
 #include <syscall.h>
 
+/* Nanoseconds per hardclock tick. */
+#define NSEC_PER_TICK	(1000000000 / HZ)
+
 /*
  * Example system call: get the time of day.
  */
@@ -39,20 +44,68 @@ int
 sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 {
 	struct timespec ts;
-	int result;
+	struct copyseg segs[2];
+	unsigned nsegs = 0;
 
 	gettime(&ts);
 
-	result = copyout(&ts.tv_sec, user_seconds_ptr, sizeof(ts.tv_sec));
-	if (result) {
-		return result;
+	/* either pointer may be NULL if that part isn't wanted */
+	if (user_seconds_ptr != NULL) {
+		segs[nsegs].cs_uaddr = user_seconds_ptr;
+		segs[nsegs].cs_kaddr = &ts.tv_sec;
+		segs[nsegs].cs_len = sizeof(ts.tv_sec);
+		nsegs++;
+	}
+	if (user_nanoseconds_ptr != NULL) {
+		segs[nsegs].cs_uaddr = user_nanoseconds_ptr;
+		segs[nsegs].cs_kaddr = &ts.tv_nsec;
+		segs[nsegs].cs_len = sizeof(ts.tv_nsec);
+		nsegs++;
 	}
 
-	result = copyout(&ts.tv_nsec, user_nanoseconds_ptr,
-			 sizeof(ts.tv_nsec));
+	return copyoutv(segs, nsegs);
+}
+
+/*
+ * nanosleep: sleep for the requested time, rounded up to whole
+ * hardclock ticks. We have no signals, so the sleep is never
+ * interrupted and the remaining time (if asked for) is always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req, rem;
+	unsigned ticks;
+	int result;
+
+	result = copyin(user_req, &req, sizeof(req));
 	if (result) {
 		return result;
 	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	/* Clamp rather than overflow; timer_add clamps further. */
+	if (req.tv_sec > 0x7fffffff / HZ) {
+		ticks = 0x7fffffff;
+	}
+	else {
+		ticks = req.tv_sec * HZ;
+		ticks += (req.tv_nsec + NSEC_PER_TICK - 1) / NSEC_PER_TICK;
+	}
 
+	if (ticks > 0) {
+		timer_sleep(ticks);
+	}
+
+	if (user_rem != NULL) {
+		rem.tv_sec = 0;
+		rem.tv_nsec = 0;
+		result = copyout(&rem, user_rem, sizeof(rem));
+		if (result) {
+			return result;
+		}
+	}
 	return 0;
 }
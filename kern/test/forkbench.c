@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Thread fork benchmark. Measures fork-to-exit latency (one thread
+ * at a time) and fork throughput (batches of threads in flight).
+ * In the steady state both should be served from the per-cpu thread
+ * cache rather than kmalloc.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define FB_LATENCY_ROUNDS	2000
+#define FB_BATCH		8	/* matches THREAD_CACHE_MAX */
+#define FB_BATCH_ROUNDS		250
+
+static struct semaphore *fbsem;
+
+static
+void
+fbthread(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	V(fbsem);
+}
+
+static
+void
+fbreport(const char *what, unsigned count, struct timespec *start)
+{
+	struct timespec now;
+	uint64_t nsecs;
+
+	gettime(&now);
+	timespec_sub(&now, start, &now);
+	nsecs = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	kprintf("%s: %u forks in %llu.%09lu sec, %llu ns/fork\n",
+		what, count, (unsigned long long)now.tv_sec,
+		(unsigned long)now.tv_nsec,
+		(unsigned long long)(nsecs / count));
+}
+
+int
+forkbench(int nargs, char **args)
+{
+	struct timespec start;
+	unsigned i, j;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	fbsem = sem_create("forkbench", 0);
+	if (fbsem == NULL) {
+		panic("forkbench: sem_create failed\n");
+	}
+
+	kprintf("Starting thread fork benchmark...\n");
+
+	/* Latency: fork one thread, wait for it, repeat. */
+	gettime(&start);
+	for (i=0; i<FB_LATENCY_ROUNDS; i++) {
+		result = thread_fork("forkbench", NULL, fbthread, NULL, 0);
+		if (result) {
+			panic("forkbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+		P(fbsem);
+	}
+	fbreport("latency", FB_LATENCY_ROUNDS, &start);
+
+	/* Throughput: keep a batch of threads in flight. */
+	gettime(&start);
+	for (i=0; i<FB_BATCH_ROUNDS; i++) {
+		for (j=0; j<FB_BATCH; j++) {
+			result = thread_fork("forkbench", NULL, fbthread,
+					     NULL, 0);
+			if (result) {
+				panic("forkbench: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<FB_BATCH; j++) {
+			P(fbsem);
+		}
+	}
+	fbreport("throughput", FB_BATCH * FB_BATCH_ROUNDS, &start);
+
+	sem_destroy(fbsem);
+	kprintf("Thread fork benchmark done.\n");
+	return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futex test. User processes don't share memory, so the userland
+ * futextest can only check the single-threaded paths; this runs
+ * several kernel threads in one process, and so one address space,
+ * and has them sleep on the same futex word, to check that wakeups
+ * honor their count, that a stale value never sleeps even with others
+ * queued, and that a different word in the same wait queue doesn't
+ * wake anyone.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <clock.h>
+#include <syscall.h>
+#include <test.h>
+
+#define FXT_NWAITERS	6
+#define FXT_BASE	0x10000000
+#define FXT_SIZE	0x10000
+#define FXT_WORD	((userptr_t)FXT_BASE)
+/* differs from FXT_WORD only above the bits futex_hash uses */
+#define FXT_OTHER	((userptr_t)(FXT_BASE + 0x8000))
+
+static struct semaphore *fxt_done;
+static struct semaphore *fxt_finished;
+static struct spinlock fxt_lock = SPINLOCK_INITIALIZER;
+static unsigned fxt_nwoken;
+static int fxt_results[FXT_NWAITERS];
+static bool fxt_ok;
+
+static
+void
+fxt_fail(const char *msg, int val)
+{
+	kprintf("fx1: %s (%d)\n", msg, val);
+	fxt_ok = false;
+}
+
+static
+unsigned
+fxt_woken(void)
+{
+	unsigned ret;
+
+	spinlock_acquire(&fxt_lock);
+	ret = fxt_nwoken;
+	spinlock_release(&fxt_lock);
+	return ret;
+}
+
+/*
+ * Move the current thread out of the test process and into the
+ * kernel's, so it can exit (and the process can be destroyed).
+ */
+static
+void
+fxt_detach(void)
+{
+	proc_remthread(curthread);
+	proc_addthread(kproc, curthread);
+}
+
+static
+void
+fxt_waiter(void *junk, unsigned long num)
+{
+	int result;
+
+	(void)junk;
+
+	result = sys_futex_wait(FXT_WORD, 0);
+
+	spinlock_acquire(&fxt_lock);
+	fxt_results[num] = result;
+	fxt_nwoken++;
+	spinlock_release(&fxt_lock);
+
+	fxt_detach();
+	V(fxt_done);
+	thread_exit();
+}
+
+/*
+ * Wake waiters on FXT_WORD, COUNT at most, and check that EXPECT of
+ * them were woken and have finished.
+ */
+static
+unsigned
+fxt_wake(int count, int expect)
+{
+	int result, n, i;
+
+	result = sys_futex_wake(FXT_WORD, count, &n);
+	if (result) {
+		fxt_fail("futex_wake failed", result);
+		return 0;
+	}
+	if (n != expect) {
+		fxt_fail("futex_wake woke the wrong number", n);
+	}
+	for (i=0; i<n; i++) {
+		P(fxt_done);
+	}
+	return n;
+}
+
+/*
+ * Runs in the test process: set up its address space, start the
+ * waiters, and wake them in stages.
+ */
+static
+void
+fxt_driver(void *junk, unsigned long junk2)
+{
+	struct addrspace *as;
+	unsigned nforked, ndone, i;
+	int32_t zero = 0;
+	int result, n;
+
+	(void)junk;
+	(void)junk2;
+
+	as = as_create();
+	if (as == NULL) {
+		fxt_fail("as_create failed", ENOMEM);
+		goto out;
+	}
+	proc_setas(as);
+	as_activate();
+	result = as_define_region(as, FXT_BASE, FXT_SIZE, 4, 2, 0);
+	if (result == 0) {
+		result = copyout(&zero, FXT_WORD, sizeof(zero));
+	}
+	if (result == 0) {
+		result = copyout(&zero, FXT_OTHER, sizeof(zero));
+	}
+	if (result) {
+		fxt_fail("can't set up the futex words", result);
+		goto teardown;
+	}
+
+	/* A stale value fails at once, with or without sleepers. */
+	result = sys_futex_wait(FXT_WORD, 1);
+	if (result != EAGAIN) {
+		fxt_fail("futex_wait with a stale value didn't fail", result);
+	}
+
+	for (nforked=0; nforked<FXT_NWAITERS; nforked++) {
+		result = thread_fork("fx1 waiter", NULL, fxt_waiter, NULL,
+				     nforked);
+		if (result) {
+			fxt_fail("thread_fork failed", result);
+			break;
+		}
+	}
+
+	/* Give them all time to go to sleep. */
+	clocksleep(1);
+	if (fxt_woken() != 0) {
+		fxt_fail("waiters returned without a wakeup", fxt_woken());
+	}
+
+	result = sys_futex_wait(FXT_WORD, 1);
+	if (result != EAGAIN) {
+		fxt_fail("futex_wait with a stale value didn't fail", result);
+	}
+
+	/* Another word in the same wait queue has no sleepers. */
+	result = sys_futex_wake(FXT_OTHER, FXT_NWAITERS, &n);
+	if (result || n != 0) {
+		fxt_fail("futex_wake on another word woke someone", n);
+	}
+
+	ndone = 0;
+	if (nforked == FXT_NWAITERS) {
+		ndone += fxt_wake(2, 2);
+		clocksleep(1);
+		if (fxt_woken() != 2) {
+			fxt_fail("wrong number of waiters returned",
+				 fxt_woken());
+		}
+		ndone += fxt_wake(FXT_NWAITERS, FXT_NWAITERS - 2);
+	}
+	/* Whatever happened, let everyone go. */
+	while (ndone < nforked) {
+		ndone += fxt_wake(FXT_NWAITERS, nforked - ndone);
+	}
+	fxt_wake(1, 0);
+
+	for (i=0; i<nforked; i++) {
+		if (fxt_results[i] != 0) {
+			fxt_fail("futex_wait failed", fxt_results[i]);
+		}
+	}
+
+ teardown:
+	as = proc_setas(NULL);
+	as_deactivate();
+	as_destroy(as);
+ out:
+	fxt_detach();
+	V(fxt_finished);
+	thread_exit();
+}
+
+/*
+ * fx1: contended futex wait and wake.
+ */
+int
+futextest(int nargs, char **args)
+{
+	struct proc *proc;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting futex test...\n");
+	fxt_done = sem_create("fx1 done", 0);
+	fxt_finished = sem_create("fx1 finished", 0);
+	if (fxt_done == NULL || fxt_finished == NULL) {
+		panic("fx1: sem_create failed\n");
+	}
+	fxt_nwoken = 0;
+	fxt_ok = true;
+
+	result = proc_create_worker("fx1", &proc);
+	if (result) {
+		panic("fx1: proc_create_worker: %s\n", strerror(result));
+	}
+	result = thread_fork("fx1 driver", proc, fxt_driver, NULL, 0);
+	if (result) {
+		panic("fx1: thread_fork: %s\n", strerror(result));
+	}
+	P(fxt_finished);
+	proc_destroy(proc);
+
+	sem_destroy(fxt_finished);
+	sem_destroy(fxt_done);
+	kprintf("fx1: %s\n", fxt_ok ? "SUCCESS" : "FAILED");
+	kprintf("Futex test done.\n");
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Page zero/copy benchmark. Checks page_zero and page_copy, then
+ * times them against bzero and memcpy on the same pages and reports
+ * the bandwidth of each.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <vm.h>
+#include <test.h>
+
+#define PB_ITERS	2000
+
+/*
+ * Report what PB_ITERS pages in the time since START came to.
+ */
+static
+void
+pbreport(const char *what, const struct timespec *start)
+{
+	struct timespec now;
+	uint64_t nsecs;
+
+	gettime(&now);
+	timespec_sub(&now, start, &now);
+	nsecs = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	if (nsecs == 0) {
+		nsecs = 1;
+	}
+	kprintf("pagebench: %-10s %6llu ns/page  %6llu MB/s\n", what,
+		(unsigned long long)(nsecs / PB_ITERS),
+		(unsigned long long)((uint64_t)PB_ITERS * PAGE_SIZE * 1000
+				     / nsecs));
+}
+
+int
+pagebench(int nargs, char **args)
+{
+	struct timespec start;
+	vaddr_t a, b;
+	unsigned char *pa, *pb;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	a = alloc_kpages(1);
+	b = alloc_kpages(1);
+	if (a == 0 || b == 0) {
+		kprintf("pagebench: Out of memory\n");
+		if (a != 0) {
+			free_kpages(a);
+		}
+		if (b != 0) {
+			free_kpages(b);
+		}
+		return ENOMEM;
+	}
+	pa = (unsigned char *)a;
+	pb = (unsigned char *)b;
+
+	/* check them first */
+	for (i=0; i<PAGE_SIZE; i++) {
+		pa[i] = i * 7 + 1;
+		pb[i] = 0xaa;
+	}
+	page_copy(b, a);
+	for (i=0; i<PAGE_SIZE; i++) {
+		if (pb[i] != pa[i]) {
+			panic("pagebench: page_copy: byte %u is 0x%x, "
+			      "expected 0x%x\n", i, pb[i], pa[i]);
+		}
+	}
+	page_zero(b);
+	for (i=0; i<PAGE_SIZE; i++) {
+		if (pb[i] != 0) {
+			panic("pagebench: page_zero: byte %u is 0x%x\n",
+			      i, pb[i]);
+		}
+	}
+
+	gettime(&start);
+	for (i=0; i<PB_ITERS; i++) {
+		page_zero(a);
+	}
+	pbreport("page_zero", &start);
+
+	gettime(&start);
+	for (i=0; i<PB_ITERS; i++) {
+		bzero(pa, PAGE_SIZE);
+	}
+	pbreport("bzero", &start);
+
+	gettime(&start);
+	for (i=0; i<PB_ITERS; i++) {
+		page_copy(b, a);
+	}
+	pbreport("page_copy", &start);
+
+	gettime(&start);
+	for (i=0; i<PB_ITERS; i++) {
+		memcpy(pb, pa, PAGE_SIZE);
+	}
+	pbreport("memcpy", &start);
+
+	free_kpages(a);
+	free_kpages(b);
+	kprintf("pagebench done.\n");
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * RCU torture test.
+ *
+ * A writer keeps replacing a shared object, retiring the old copies
+ * alternately with synchronize_rcu and call_rcu; the retire path
+ * poisons an object before freeing it. Readers on all cpus keep
+ * dereferencing the shared pointer and check that what they see is
+ * never poisoned and never changes under them, holding each
+ * read-side section open long enough to span timer interrupts.
+ */
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <rcu.h>
+#include <test.h>
+
+#define NREADERS	8
+#define NUPDATES	400
+#define SPINS		200	/* busy-work per read-side section */
+
+#define RT_LIVE		0x11ae11ae
+#define RT_DEAD		0xdeadbeef
+
+struct rtobj {
+	struct rcu_head r_rcu;
+	volatile unsigned r_magic;
+	unsigned r_gen;
+	unsigned r_check;	/* always ~r_gen */
+};
+
+static struct rtobj *rtshared;
+static volatile bool rtdone;
+static struct spinlock rtlock = SPINLOCK_INITIALIZER;
+static unsigned rtfreed, rtreads, rtbad;
+static struct semaphore *rtsem;
+
+static
+void
+rtretire(void *ptr)
+{
+	struct rtobj *r = ptr;
+
+	KASSERT(r->r_magic == RT_LIVE);
+	r->r_magic = RT_DEAD;
+	r->r_gen = 0;
+	r->r_check = 0;
+	kfree(r);
+
+	spinlock_acquire(&rtlock);
+	rtfreed++;
+	spinlock_release(&rtlock);
+}
+
+static
+void
+rtreader(void *junk, unsigned long num)
+{
+	struct rtobj *r;
+	unsigned gen, lastgen, reads, bad, i;
+	volatile unsigned spin;
+
+	(void)junk;
+	(void)num;
+
+	lastgen = 0;
+	reads = bad = 0;
+	while (!rtdone) {
+		rcu_read_lock();
+		r = rcu_dereference(rtshared);
+		gen = r->r_gen;
+		for (i=0; i<SPINS; i++) {
+			spin = i;
+		}
+		(void)spin;
+		if (r->r_magic != RT_LIVE || r->r_gen != gen ||
+		    r->r_check != ~gen || gen < lastgen) {
+			bad++;
+		}
+		rcu_read_unlock();
+		lastgen = gen;
+		reads++;
+
+		if (reads % 16 == 0) {
+			thread_yield();
+		}
+	}
+
+	spinlock_acquire(&rtlock);
+	rtreads += reads;
+	rtbad += bad;
+	spinlock_release(&rtlock);
+	V(rtsem);
+}
+
+static
+struct rtobj *
+rtnew(unsigned gen)
+{
+	struct rtobj *r;
+
+	r = kmalloc(sizeof(*r));
+	if (r == NULL) {
+		panic("rcutest: Out of memory\n");
+	}
+	r->r_magic = RT_LIVE;
+	r->r_gen = gen;
+	r->r_check = ~gen;
+	return r;
+}
+
+int
+rcutest(int nargs, char **args)
+{
+	struct rtobj *old;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting RCU torture test...\n");
+
+	rtsem = sem_create("rcutest", 0);
+	if (rtsem == NULL) {
+		panic("rcutest: sem_create failed\n");
+	}
+	rtdone = false;
+	rtfreed = rtreads = rtbad = 0;
+	rtshared = rtnew(1);
+
+	for (i=0; i<NREADERS; i++) {
+		result = thread_fork("rcutest", NULL, rtreader, NULL, i);
+		if (result) {
+			panic("rcutest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	for (i=2; i<NUPDATES+2; i++) {
+		old = rtshared;
+		rcu_assign_pointer(rtshared, rtnew(i));
+		if (i % 2) {
+			synchronize_rcu();
+			rtretire(old);
+		}
+		else {
+			call_rcu(&old->r_rcu, rtretire, old);
+		}
+		if (i % 8 == 0) {
+			thread_yield();
+		}
+	}
+
+	rtdone = true;
+	for (i=0; i<NREADERS; i++) {
+		P(rtsem);
+	}
+	rcu_barrier();
+
+	kprintf("rcutest: %u reads, %u updates, %u freed, %u bad\n",
+		rtreads, NUPDATES, rtfreed, rtbad);
+	if (rtbad != 0 || rtfreed != NUPDATES) {
+		kprintf("RCU torture test FAILED\n");
+	}
+	else {
+		kprintf("RCU torture test done.\n");
+	}
+
+	rtretire(rtshared);
+	rtshared = NULL;
+	sem_destroy(rtsem);
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Spinlock contention benchmark. One thread per cpu hammers a single
+ * spinlock, first an ordinary test-and-set one and then a queued
+ * (MCS) one, and we report the time per acquire/release pair. With
+ * one cpu there's no contention and this measures the uncontended
+ * overhead of the two kinds instead.
+ *
+ * A last round runs the queued lock with every other thread holding
+ * a full pool of queued spinlocks of its own, so those threads take
+ * it with the test-and-set fallback and hand it to and from the ones
+ * waiting in line.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define SB_ITERS	20000
+
+static struct spinlock sblock;
+static volatile unsigned sbcount;
+static volatile bool sbgo;
+static struct semaphore *sbready, *sbdone;
+
+/*
+ * If DEEP is set, use up this cpu's queue nodes first.
+ */
+static
+void
+sbthread(void *junk, unsigned long deep)
+{
+	struct spinlock held[SPINLOCK_NQNODES];
+	unsigned i, nheld;
+
+	(void)junk;
+
+	nheld = deep ? SPINLOCK_NQNODES : 0;
+	for (i=0; i<nheld; i++) {
+		spinlock_init_queued(&held[i]);
+	}
+
+	V(sbready);
+	/* Yield while waiting so the threads get spread across cpus. */
+	while (!sbgo) {
+		thread_yield();
+	}
+	for (i=0; i<nheld; i++) {
+		spinlock_acquire(&held[i]);
+	}
+	for (i=0; i<SB_ITERS; i++) {
+		spinlock_acquire(&sblock);
+		sbcount++;
+		spinlock_release(&sblock);
+	}
+	for (i=nheld; i-- > 0; ) {
+		spinlock_release(&held[i]);
+		spinlock_cleanup(&held[i]);
+	}
+	V(sbdone);
+}
+
+static
+void
+sbrun(const char *what, bool queued, bool deep, unsigned nthreads)
+{
+	struct timespec start, now;
+	uint64_t nsecs;
+	unsigned i;
+	int result;
+
+	if (queued) {
+		spinlock_init_queued(&sblock);
+	}
+	else {
+		spinlock_init(&sblock);
+	}
+	sbcount = 0;
+	sbgo = false;
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinbench", NULL, sbthread, NULL,
+				     deep && i % 2 == 0);
+		if (result) {
+			panic("spinbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(sbready);
+	}
+
+	gettime(&start);
+	sbgo = true;
+	for (i=0; i<nthreads; i++) {
+		P(sbdone);
+	}
+	gettime(&now);
+
+	if (sbcount != nthreads * SB_ITERS) {
+		panic("spinbench: %s: count %u, expected %u\n", what,
+		      sbcount, nthreads * SB_ITERS);
+	}
+	spinlock_cleanup(&sblock);
+
+	timespec_sub(&now, &start, &now);
+	nsecs = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	kprintf("%s: %u threads x %u in %llu.%09lu sec, %llu ns/op\n",
+		what, nthreads, SB_ITERS, (unsigned long long)now.tv_sec,
+		(unsigned long)now.tv_nsec,
+		(unsigned long long)(nsecs / (nthreads * SB_ITERS)));
+}
+
+int
+spinbench(int nargs, char **args)
+{
+	unsigned ncpus;
+
+	(void)nargs;
+	(void)args;
+
+	sbready = sem_create("spinbench ready", 0);
+	sbdone = sem_create("spinbench done", 0);
+	if (sbready == NULL || sbdone == NULL) {
+		panic("spinbench: sem_create failed\n");
+	}
+
+	for (ncpus = 0; cpu_get(ncpus) != NULL; ncpus++) {
+		/* count */
+	}
+
+	kprintf("Starting spinlock benchmark on %u cpus...\n", ncpus);
+	sbrun("test-and-set", false, false, ncpus);
+	sbrun("queued", true, false, ncpus);
+	sbrun("queued, half out of nodes", true, true, ncpus);
+
+	sem_destroy(sbdone);
+	sem_destroy(sbready);
+	kprintf("Spinlock benchmark done.\n");
+	return 0;
+}
@@ -35,6 +35,7 @@
 #include <kern/wait.h>
 #include <lib.h>
 #include <clock.h>
+#include <cpu.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -400,3 +401,251 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Count context switches per cv_broadcast.
+ *
+ * NTHREADS threads wait on a CV; the main thread broadcasts while
+ * holding the lock, then waits for all of them to come back around.
+ * This is done once with the lock passed to cv_broadcast, which lets
+ * the CV move the waiters straight to the lock (wait morphing), and
+ * once with NULL, which forces the old wake-everyone behavior, for
+ * comparison.
+ */
+
+#define NCVBROUNDS 50
+
+static struct cv *cvbcv, *cvbreadycv;
+static volatile unsigned cvbwaiting;
+static volatile unsigned cvbround;
+
+static
+void
+cvbthread(void *junk, unsigned long num)
+{
+	unsigned r;
+
+	(void)junk;
+	(void)num;
+
+	lock_acquire(testlock);
+	for (r=0; r<NCVBROUNDS; r++) {
+		cvbwaiting++;
+		if (cvbwaiting == NTHREADS) {
+			cv_signal(cvbreadycv, testlock);
+		}
+		while (cvbround == r) {
+			cv_wait(cvbcv, testlock);
+		}
+	}
+	lock_release(testlock);
+	V(donesem);
+}
+
+static
+unsigned
+cvbrun(bool morph)
+{
+	unsigned i, r, start;
+	int result;
+
+	cvbwaiting = 0;
+	cvbround = 0;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("cvbench", NULL, cvbthread, NULL, i);
+		if (result) {
+			panic("cvbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	start = 0;
+	lock_acquire(testlock);
+	for (r=0; r<NCVBROUNDS; r++) {
+		while (cvbwaiting < NTHREADS) {
+			cv_wait(cvbreadycv, testlock);
+		}
+		if (r == 0) {
+			/* don't count getting everyone started */
+			start = cpustat_get(CS_CSWITCHES);
+		}
+		cvbwaiting = 0;
+		cvbround++;
+		cv_broadcast(cvbcv, morph ? testlock : NULL);
+	}
+	lock_release(testlock);
+
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	return cpustat_get(CS_CSWITCHES) - start;
+}
+
+int
+cvbench(int nargs, char **args)
+{
+	unsigned plain, morphed;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	cvbcv = cv_create("cvbench");
+	cvbreadycv = cv_create("cvbench ready");
+	if (cvbcv == NULL || cvbreadycv == NULL) {
+		panic("cvbench: cv_create failed\n");
+	}
+
+	kprintf("Starting CV broadcast benchmark...\n");
+
+	plain = cvbrun(false);
+	morphed = cvbrun(true);
+
+	kprintf("%u waiters, %u broadcasts:\n", NTHREADS, NCVBROUNDS);
+	kprintf("  wake all:      %u context switches (%u per broadcast)\n",
+		plain, plain / NCVBROUNDS);
+	kprintf("  wait morphing: %u context switches (%u per broadcast)\n",
+		morphed, morphed / NCVBROUNDS);
+
+	cv_destroy(cvbreadycv);
+	cv_destroy(cvbcv);
+	cvbcv = cvbreadycv = NULL;
+
+	kprintf("CV broadcast benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Priority inheritance test.
+ *
+ * A low-priority thread takes the lock and then dawdles. A
+ * high-priority thread comes along and blocks on the lock, and a
+ * crowd of medium-priority threads compete for the CPU. Without
+ * priority inheritance the low thread doesn't run again until all the
+ * medium threads are done (unbounded priority inversion); with it,
+ * the low thread runs at high priority until it releases the lock, so
+ * the high thread should get the lock before any medium thread
+ * finishes. On a multiprocessor this can pass by luck.
+ */
+
+#define NPIMEDIUM 8
+#define NPISPINS 200
+
+static struct semaphore *pistartsem;
+static volatile unsigned pimediumdone;
+static volatile unsigned pihighsaw;
+
+static
+void
+pilowthread(void *junk, unsigned long num)
+{
+	unsigned i;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_MIN);
+	lock_acquire(testlock);
+	V(pistartsem);
+	for (i=0; i<NPISPINS; i++) {
+		thread_yield();
+	}
+	lock_release(testlock);
+	V(donesem);
+}
+
+static
+void
+pimediumthread(void *junk, unsigned long num)
+{
+	unsigned i;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_DEFAULT + 1);
+	for (i=0; i<NPISPINS; i++) {
+		thread_yield();
+	}
+	pimediumdone++;
+	V(donesem);
+}
+
+static
+void
+pihighthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_MAX);
+	lock_acquire(testlock);
+	pihighsaw = pimediumdone;
+	lock_release(testlock);
+	V(donesem);
+}
+
+static
+void
+pifork(void (*func)(void *, unsigned long))
+{
+	int result;
+
+	result = thread_fork("pitest", NULL, func, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+int
+pitest(int nargs, char **args)
+{
+	unsigned i;
+	int oldpri;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	pistartsem = sem_create("pistart", 0);
+	if (pistartsem == NULL) {
+		panic("pitest: sem_create failed\n");
+	}
+	pimediumdone = 0;
+	pihighsaw = 0;
+
+	kprintf("Starting priority inheritance test...\n");
+
+	/* Don't let the children run until they're all forked. */
+	oldpri = thread_setpriority(PRI_MAX);
+
+	pifork(pilowthread);
+	P(pistartsem);
+
+	/* Fork the high thread first so it's first to run. */
+	pifork(pihighthread);
+	for (i=0; i<NPIMEDIUM; i++) {
+		pifork(pimediumthread);
+	}
+	thread_setpriority(oldpri);
+
+	for (i=0; i<NPIMEDIUM + 2; i++) {
+		P(donesem);
+	}
+	sem_destroy(pistartsem);
+	pistartsem = NULL;
+
+	kprintf("High-priority thread got the lock after %u of %u "
+		"medium threads finished\n", pihighsaw, NPIMEDIUM);
+	if (pihighsaw > 0) {
+		kprintf("Test failed\n");
+	}
+	kprintf("Priority inheritance test done\n");
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Test code for timers and timed waits.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <clock.h>
+#include <timer.h>
+#include <test.h>
+
+#define NTIMERS		24
+#define MAXDELAY	300	/* ticks; enough to cascade from level 1 */
+
+struct tmtest {
+	struct timer t_timer;
+	unsigned t_delay;
+	unsigned t_addedat;	/* c_hardclocks when added */
+	unsigned t_firedat;
+	bool t_fired;
+	bool t_cancelled;
+};
+
+static struct tmtest tmtests[NTIMERS];
+static struct spinlock tmtest_lock = SPINLOCK_INITIALIZER;
+static unsigned tmtest_fired;
+
+static
+void
+tmtest_func(void *data)
+{
+	struct tmtest *t = data;
+
+	/* called from hardclock, so no sleeping */
+	t->t_firedat = curcpu->c_hardclocks;
+	t->t_fired = true;
+	spinlock_acquire(&tmtest_lock);
+	tmtest_fired++;
+	spinlock_release(&tmtest_lock);
+}
+
+static
+void
+tmtest_holder(void *sem, unsigned long lockptr)
+{
+	struct lock *lock = (struct lock *)lockptr;
+
+	lock_acquire(lock);
+	V(sem);
+	timer_sleep(HZ / 2);
+	lock_release(lock);
+	V(sem);
+}
+
+/*
+ * tm1: timers fire, not early, and cancelled ones don't; timed P and
+ * lock_acquire give up when they should and succeed when they can.
+ */
+int
+timertest(int nargs, char **args)
+{
+	struct semaphore *sem;
+	struct lock *lock;
+	unsigned i, ncancelled, bad;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting timer test...\n");
+
+	/*
+	 * Hardclock counts are per-cpu, and timers fire on the cpu
+	 * that added them; keep interrupts off while adding so the
+	 * count we record is from the right cpu.
+	 */
+	tmtest_fired = 0;
+	ncancelled = 0;
+	for (i=0; i<NTIMERS; i++) {
+		tmtests[i].t_delay = (i * 37) % MAXDELAY;
+		tmtests[i].t_fired = false;
+		tmtests[i].t_cancelled = false;
+		timer_init(&tmtests[i].t_timer, tmtest_func, &tmtests[i]);
+	}
+	for (i=0; i<NTIMERS; i++) {
+		int spl = splhigh();
+		tmtests[i].t_addedat = curcpu->c_hardclocks;
+		timer_add(&tmtests[i].t_timer, tmtests[i].t_delay);
+		splx(spl);
+	}
+	for (i=0; i<NTIMERS; i += 3) {
+		if (tmtests[i].t_delay > HZ && timer_cancel(&tmtests[i].t_timer)) {
+			tmtests[i].t_cancelled = true;
+			ncancelled++;
+		}
+	}
+
+	timer_sleep(MAXDELAY + 2);
+
+	bad = 0;
+	for (i=0; i<NTIMERS; i++) {
+		timer_cancel(&tmtests[i].t_timer);
+		if (tmtests[i].t_cancelled) {
+			if (tmtests[i].t_fired) {
+				kprintf("tm1: timer %u fired after cancel\n",
+					i);
+				bad++;
+			}
+			continue;
+		}
+		if (!tmtests[i].t_fired) {
+			kprintf("tm1: timer %u (delay %u) never fired\n",
+				i, tmtests[i].t_delay);
+			bad++;
+		}
+		else if (tmtests[i].t_firedat - tmtests[i].t_addedat <
+			 tmtests[i].t_delay) {
+			kprintf("tm1: timer %u (delay %u) fired after %u\n",
+				i, tmtests[i].t_delay,
+				tmtests[i].t_firedat - tmtests[i].t_addedat);
+			bad++;
+		}
+	}
+	if (tmtest_fired + ncancelled != NTIMERS) {
+		kprintf("tm1: %u fired + %u cancelled != %u\n",
+			tmtest_fired, ncancelled, NTIMERS);
+		bad++;
+	}
+
+	/* timed P */
+	sem = sem_create("tm1", 0);
+	if (sem == NULL) {
+		panic("tm1: sem_create failed\n");
+	}
+	result = P_timeout(sem, 5);
+	if (result != ETIMEDOUT) {
+		kprintf("tm1: P_timeout on empty sem: %d\n", result);
+		bad++;
+	}
+	V(sem);
+	result = P_timeout(sem, 5);
+	if (result != 0) {
+		kprintf("tm1: P_timeout on full sem: %d\n", result);
+		bad++;
+	}
+
+	/* timed lock_acquire */
+	lock = lock_create("tm1");
+	if (lock == NULL) {
+		panic("tm1: lock_create failed\n");
+	}
+	result = thread_fork("tm1 holder", NULL, tmtest_holder, sem,
+			     (unsigned long)lock);
+	if (result) {
+		panic("tm1: thread_fork failed: %s\n", strerror(result));
+	}
+	P(sem);
+	result = lock_acquire_timeout(lock, 2);
+	if (result != ETIMEDOUT) {
+		kprintf("tm1: lock_acquire_timeout on held lock: %d\n",
+			result);
+		bad++;
+		if (result == 0) {
+			lock_release(lock);
+		}
+	}
+	result = lock_acquire_timeout(lock, 2 * HZ);
+	if (result != 0) {
+		kprintf("tm1: lock_acquire_timeout after release: %d\n",
+			result);
+		bad++;
+	}
+	else {
+		lock_release(lock);
+	}
+	P(sem);
+
+	lock_destroy(lock);
+	sem_destroy(sem);
+
+	if (bad > 0) {
+		kprintf("tm1: FAILED (%u problems)\n", bad);
+	}
+	kprintf("timer test done\n");
+	return 0;
+}
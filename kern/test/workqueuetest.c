@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Test code for the workqueue.
+ */
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <current.h>
+#include <clock.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NITEMS		64
+#define NDELAYED	8
+#define DELAYSTEP	5	/* hardclocks */
+
+struct wqtest_item {
+	struct work wi_work;
+	unsigned wi_num;
+	unsigned wi_delay;	/* requested delay */
+	unsigned wi_queuedat;	/* c_hardclocks when queued */
+	bool wi_early;		/* ran before its delay was up */
+};
+
+static struct wqtest_item wqtest_items[NITEMS];
+static struct spinlock wqtest_lock = SPINLOCK_INITIALIZER;
+static unsigned wqtest_ran;
+
+static
+void
+wqtest_func(void *data)
+{
+	struct wqtest_item *wi = data;
+
+	/* Delays are counted on the queueing CPU's clock. */
+	if (wi->wi_delay > 0 &&
+	    curcpu->c_hardclocks - wi->wi_queuedat < wi->wi_delay) {
+		wi->wi_early = true;
+	}
+
+	spinlock_acquire(&wqtest_lock);
+	wqtest_ran++;
+	spinlock_release(&wqtest_lock);
+}
+
+static
+unsigned
+wqtest_count(void)
+{
+	unsigned ret;
+
+	spinlock_acquire(&wqtest_lock);
+	ret = wqtest_ran;
+	spinlock_release(&wqtest_lock);
+	return ret;
+}
+
+/*
+ * wq1: queue a batch of work and flush it; then queue some delayed
+ * work and check it didn't run early.
+ */
+int
+workqueuetest(int nargs, char **args)
+{
+	unsigned i, n, early;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting workqueue test...\n");
+	wqtest_ran = 0;
+
+	for (i=0; i<NITEMS; i++) {
+		wqtest_items[i].wi_num = i;
+		wqtest_items[i].wi_delay = 0;
+		wqtest_items[i].wi_early = false;
+		work_init(&wqtest_items[i].wi_work, wqtest_func,
+			  &wqtest_items[i]);
+		workqueue_schedule(&wqtest_items[i].wi_work);
+	}
+	workqueue_flush();
+
+	n = wqtest_count();
+	if (n != NITEMS) {
+		kprintf("wq1: %u of %u items ran before flush returned\n",
+			n, NITEMS);
+		kprintf("wq1: FAILED\n");
+		return 0;
+	}
+
+	wqtest_ran = 0;
+	for (i=0; i<NDELAYED; i++) {
+		wqtest_items[i].wi_delay = (i + 1) * DELAYSTEP;
+		wqtest_items[i].wi_early = false;
+		wqtest_items[i].wi_queuedat = curcpu->c_hardclocks;
+		work_init(&wqtest_items[i].wi_work, wqtest_func,
+			  &wqtest_items[i]);
+		workqueue_schedule_delayed(&wqtest_items[i].wi_work,
+					   wqtest_items[i].wi_delay);
+	}
+
+	/* NDELAYED * DELAYSTEP is well under a second */
+	clocksleep(1);
+	workqueue_flush();
+
+	n = wqtest_count();
+	early = 0;
+	for (i=0; i<NDELAYED; i++) {
+		if (wqtest_items[i].wi_early) {
+			early++;
+		}
+	}
+	if (n != NDELAYED || early > 0) {
+		kprintf("wq1: %u of %u delayed items ran, %u early\n",
+			n, NDELAYED, early);
+		kprintf("wq1: FAILED\n");
+		return 0;
+	}
+
+	kprintf("workqueue test done\n");
+	return 0;
+}
@@ -30,17 +30,19 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
-#include <wchan.h>
 #include <clock.h>
 #include <thread.h>
+#include <proc.h>
 #include <current.h>
+#include <timer.h>
+#include <timepage.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Callbacks at specific points in the future, with tick resolution,
+ * are provided by the timer wheels in timer.c, which hardclock()
+ * drives.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -53,23 +55,13 @@
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
-/*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
- */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
-
 /*
  * Setup.
  */
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
-	}
+	timer_bootstrap();
 }
 
 /*
@@ -79,10 +71,7 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
+	/* Nothing to do; timed waits all go through the timer wheels. */
 }
 
 /*
@@ -92,18 +81,39 @@ timerclock(void)
 void
 hardclock(void)
 {
+	struct proc *p;
+
 	/*
 	 * Collect statistics here as desired.
 	 */
 
 	curcpu->c_hardclocks++;
+
+	/* Charge the tick to whatever process we interrupted. */
+	p = curthread->t_proc;
+	if (p != NULL && p != kproc && !curcpu->c_isidle) {
+		if (curcpu->c_intruser) {
+			p->p_ru.pr_utime++;
+		}
+		else {
+			p->p_ru.pr_stime++;
+		}
+	}
+	/* One CPU is enough to keep the time page current. */
+	if (curcpu->c_number == 0) {
+		timepage_update();
+	}
+	timer_tick();
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	/* Don't preempt RCU readers (see rcu.h). */
+	if (curthread->t_rcu_nesting == 0) {
+		thread_yield();
+	}
 }
 
 /*
@@ -112,10 +122,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > 0) {
+		timer_sleep(num_secs * HZ);
 	}
-	spinlock_release(&lbolt_lock);
 }
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention profiler.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <hangman.h>
+#include <lockprof.h>
+
+#define LOCKPROF_NCLASSES	256	/* size of class table */
+#define LOCKPROF_NAMELEN	24
+
+struct lockprof_class {
+	bool lc_inuse;
+	const void *lc_site;
+	char lc_name[LOCKPROF_NAMELEN];
+
+	unsigned lc_acquires;		/* total acquisitions */
+	unsigned lc_contended;		/* ...that had to wait */
+	unsigned lc_giveups;		/* waits that timed out */
+	uint64_t lc_waitcycles;		/* total time waiting */
+	uint64_t lc_holdcycles;		/* total time held */
+	uint32_t lc_maxwait;
+	uint32_t lc_maxhold;
+};
+
+/*
+ * The class table. If it fills up, further classes all share the
+ * overflow entry.
+ *
+ * This is protected by a bare spinlock word rather than a struct
+ * spinlock, because the hooks run inside spinlock_acquire and
+ * spinlock_release. All the hooks are called with interrupts off;
+ * code outside the hooks must raise the spl itself. Nothing that
+ * takes a real spinlock (e.g. kprintf) may be called while holding
+ * it.
+ */
+static struct lockprof_class lockprof_classes[LOCKPROF_NCLASSES];
+static struct lockprof_class lockprof_overflow = {
+	.lc_inuse = true,
+	.lc_name = "<overflow>",
+};
+static volatile spinlock_data_t lockprof_lock = SPINLOCK_DATA_INITIALIZER;
+
+static
+void
+lockprof_lock_acquire(void)
+{
+	while (1) {
+		if (spinlock_data_get(&lockprof_lock) != 0) {
+			continue;
+		}
+		if (spinlock_data_testandset(&lockprof_lock) != 0) {
+			continue;
+		}
+		break;
+	}
+	membar_store_any();
+}
+
+static
+void
+lockprof_lock_release(void)
+{
+	membar_any_store();
+	spinlock_data_set(&lockprof_lock, 0);
+}
+
+/*
+ * Class names are truncated to fit in lc_name.
+ */
+static
+void
+lockprof_setname(struct lockprof_class *lc, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKPROF_NAMELEN-1 && name[i] != 0; i++) {
+		lc->lc_name[i] = name[i];
+	}
+	lc->lc_name[i] = 0;
+}
+
+static
+bool
+lockprof_samename(const struct lockprof_class *lc, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKPROF_NAMELEN-1; i++) {
+		if (lc->lc_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			return true;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find (or make) the class for a lockable. Spinlocks set up with
+ * SPINLOCK_INITIALIZER have no init site; use their own address,
+ * which is as good an identity as any for a static lock.
+ *
+ * Call with lockprof_lock held.
+ */
+static
+struct lockprof_class *
+lockprof_getclass(struct hangman_lockable *l)
+{
+	struct lockprof_class *lc;
+	const void *site;
+	const char *name;
+	unsigned hash, i, n;
+
+	if (l->l_class != NULL) {
+		return l->l_class;
+	}
+
+	site = l->l_site != NULL ? l->l_site : l;
+	name = l->l_name != NULL ? l->l_name : "?";
+
+	hash = (uintptr_t)site >> 2;
+	for (i=0; name[i] != 0; i++) {
+		hash = hash * 31 + (unsigned char)name[i];
+	}
+
+	for (n=0; n<LOCKPROF_NCLASSES; n++) {
+		lc = &lockprof_classes[(hash + n) % LOCKPROF_NCLASSES];
+		if (!lc->lc_inuse) {
+			lc->lc_inuse = true;
+			lc->lc_site = site;
+			lockprof_setname(lc, name);
+			break;
+		}
+		if (lc->lc_site == site && lockprof_samename(lc, name)) {
+			break;
+		}
+	}
+	if (n == LOCKPROF_NCLASSES) {
+		lc = &lockprof_overflow;
+	}
+
+	l->l_class = lc;
+	return lc;
+}
+
+////////////////////////////////////////////////////////////
+// hooks
+
+void
+lockprof_wait(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	/* Unlocked peek at l_held; good enough for statistics. */
+	a->a_contended = l->l_held;
+	a->a_waitstart = cpu_cycles();
+}
+
+void
+lockprof_acquire(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	struct lockprof_class *lc;
+	uint32_t now, wait;
+
+	now = cpu_cycles();
+	wait = now - a->a_waitstart;
+
+	lockprof_lock_acquire();
+	lc = lockprof_getclass(l);
+	lc->lc_acquires++;
+	if (a->a_contended) {
+		lc->lc_contended++;
+	}
+	lc->lc_waitcycles += wait;
+	if (wait > lc->lc_maxwait) {
+		lc->lc_maxwait = wait;
+	}
+	lockprof_lock_release();
+
+	l->l_held = true;
+	l->l_holdstart = cpu_cycles();
+}
+
+void
+lockprof_release(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	struct lockprof_class *lc;
+	uint32_t hold;
+
+	(void)a;
+
+	hold = cpu_cycles() - l->l_holdstart;
+	l->l_held = false;
+
+	lockprof_lock_acquire();
+	lc = lockprof_getclass(l);
+	lc->lc_holdcycles += hold;
+	if (hold > lc->lc_maxhold) {
+		lc->lc_maxhold = hold;
+	}
+	lockprof_lock_release();
+}
+
+void
+lockprof_giveup(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	struct lockprof_class *lc;
+	uint32_t wait;
+
+	wait = cpu_cycles() - a->a_waitstart;
+
+	lockprof_lock_acquire();
+	lc = lockprof_getclass(l);
+	lc->lc_giveups++;
+	if (a->a_contended) {
+		lc->lc_contended++;
+	}
+	lc->lc_waitcycles += wait;
+	if (wait > lc->lc_maxwait) {
+		lc->lc_maxwait = wait;
+	}
+	lockprof_lock_release();
+}
+
+////////////////////////////////////////////////////////////
+// reporting
+
+/*
+ * Order for printing: most contended first, then most time spent
+ * waiting.
+ */
+static
+bool
+lockprof_worse(const struct lockprof_class *a, const struct lockprof_class *b)
+{
+	if (a->lc_contended != b->lc_contended) {
+		return a->lc_contended > b->lc_contended;
+	}
+	return a->lc_waitcycles > b->lc_waitcycles;
+}
+
+void
+lockprof_printstats(unsigned n)
+{
+	struct lockprof_class *snap, *lc, tmp;
+	unsigned i, j, nsnap;
+	int spl;
+
+	snap = kmalloc((LOCKPROF_NCLASSES + 1) * sizeof(*snap));
+	if (snap == NULL) {
+		kprintf("lockprof: Out of memory\n");
+		return;
+	}
+
+	/* Copy the table so we can print without holding the lock. */
+	nsnap = 0;
+	spl = splhigh();
+	lockprof_lock_acquire();
+	for (i=0; i<LOCKPROF_NCLASSES; i++) {
+		if (lockprof_classes[i].lc_inuse) {
+			snap[nsnap++] = lockprof_classes[i];
+		}
+	}
+	if (lockprof_overflow.lc_acquires > 0) {
+		snap[nsnap++] = lockprof_overflow;
+	}
+	lockprof_lock_release();
+	splx(spl);
+
+	if (n > nsnap) {
+		n = nsnap;
+	}
+
+	/* Partial selection sort; we only need the first N. */
+	for (i=0; i<n; i++) {
+		for (j=i+1; j<nsnap; j++) {
+			if (lockprof_worse(&snap[j], &snap[i])) {
+				tmp = snap[i];
+				snap[i] = snap[j];
+				snap[j] = tmp;
+			}
+		}
+	}
+
+	kprintf("%u lock classes; top %u by contention (times in cycles):\n",
+		nsnap, n);
+	kprintf("%9s %9s %6s %12s %10s %12s %10s  %s\n",
+		"acquires", "contended", "tmout", "wait", "maxwait",
+		"hold", "maxhold", "name@site");
+	for (i=0; i<n; i++) {
+		lc = &snap[i];
+		kprintf("%9u %9u %6u %12llu %10lu %12llu %10lu  %s@%p\n",
+			lc->lc_acquires, lc->lc_contended, lc->lc_giveups,
+			(unsigned long long)lc->lc_waitcycles,
+			(unsigned long)lc->lc_maxwait,
+			(unsigned long long)lc->lc_holdcycles,
+			(unsigned long)lc->lc_maxhold,
+			lc->lc_name, lc->lc_site);
+	}
+
+	kfree(snap);
+}
+
+void
+lockprof_reset(void)
+{
+	struct lockprof_class *lc;
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	lockprof_lock_acquire();
+	for (i=0; i<=LOCKPROF_NCLASSES; i++) {
+		lc = i < LOCKPROF_NCLASSES ?
+			&lockprof_classes[i] : &lockprof_overflow;
+		lc->lc_acquires = 0;
+		lc->lc_contended = 0;
+		lc->lc_giveups = 0;
+		lc->lc_waitcycles = 0;
+		lc->lc_holdcycles = 0;
+		lc->lc_maxwait = 0;
+		lc->lc_maxhold = 0;
+	}
+	lockprof_lock_release();
+	splx(spl);
+}
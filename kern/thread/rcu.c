@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Read-copy-update. See rcu.h.
+ *
+ * There is a global grace period number, rcu_gp. Starting a grace
+ * period increments it; every quiescent state on a cpu copies its
+ * current value into that cpu's c_rcu_qs. The grace period GP is
+ * over once every online cpu has c_rcu_qs >= GP, because each one
+ * has passed through thread_switch since GP was started, and no
+ * read-side section spans a thread_switch.
+ *
+ * Cpus that have not come online yet run no readers and are
+ * skipped.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <thread.h>
+#include <current.h>
+#include <timer.h>
+#include <workqueue.h>
+#include <rcu.h>
+
+static volatile unsigned rcu_gp;
+static struct spinlock rcu_lock = SPINLOCK_INITIALIZER;
+
+/* Callbacks waiting for the next batch; protected by rcu_lock. */
+static struct rcu_head *rcu_pending;
+static bool rcu_batch_queued;
+static struct work rcu_batch_work;
+
+/*
+ * Note a quiescent state on this cpu. Called from thread_switch
+ * with interrupts off.
+ */
+void
+rcu_quiescent(void)
+{
+	curcpu->c_rcu_qs = rcu_gp;
+}
+
+/*
+ * This cpu is now running threads and must take part in grace
+ * periods.
+ */
+void
+rcu_cpu_online(void)
+{
+	int spl;
+
+	spl = splhigh();
+	curcpu->c_rcu_qs = rcu_gp;
+	membar_store_store();
+	curcpu->c_rcu_online = true;
+	splx(spl);
+}
+
+/*
+ * Wait for a grace period.
+ */
+void
+synchronize_rcu(void)
+{
+	struct cpu *c;
+	unsigned gp, i;
+	bool done;
+
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(curthread->t_rcu_nesting == 0);
+	KASSERT(curcpu->c_spinlocks == 0);
+
+	/* Make the caller's updates visible before starting. */
+	membar_any_any();
+
+	spinlock_acquire(&rcu_lock);
+	gp = ++rcu_gp;
+	spinlock_release(&rcu_lock);
+
+	/* We're not in a read-side section, so this cpu is quiescent. */
+	rcu_quiescent();
+
+	while (1) {
+		done = true;
+		for (i=0; (c = cpu_get(i)) != NULL; i++) {
+			if (c->c_rcu_online && (int)(c->c_rcu_qs - gp) < 0) {
+				done = false;
+				break;
+			}
+		}
+		if (done) {
+			break;
+		}
+		/* Every cpu passes a quiescent state at least once a tick. */
+		timer_sleep(1);
+	}
+
+	membar_any_any();
+}
+
+/*
+ * Workqueue function: wait out a grace period for everything that
+ * was pending, then run it.
+ */
+static
+void
+rcu_batch(void *junk)
+{
+	struct rcu_head *list, *rh;
+
+	(void)junk;
+
+	spinlock_acquire(&rcu_lock);
+	list = rcu_pending;
+	rcu_pending = NULL;
+	rcu_batch_queued = false;
+	spinlock_release(&rcu_lock);
+
+	synchronize_rcu();
+
+	while (list != NULL) {
+		rh = list;
+		list = rh->rh_next;
+		rh->rh_func(rh->rh_data);
+	}
+}
+
+/*
+ * Run FUNC(DATA) after a grace period.
+ */
+void
+call_rcu(struct rcu_head *rh, void (*func)(void *), void *data)
+{
+	bool schedule;
+
+	rh->rh_func = func;
+	rh->rh_data = data;
+
+	spinlock_acquire(&rcu_lock);
+	rh->rh_next = rcu_pending;
+	rcu_pending = rh;
+	schedule = !rcu_batch_queued;
+	if (schedule) {
+		rcu_batch_queued = true;
+		work_init(&rcu_batch_work, rcu_batch, NULL);
+	}
+	spinlock_release(&rcu_lock);
+
+	if (schedule) {
+		workqueue_schedule(&rcu_batch_work);
+	}
+}
+
+/*
+ * Wait for all callbacks queued so far. Any batch they belong to has
+ * already been handed to a workqueue, so flushing suffices.
+ */
+void
+rcu_barrier(void)
+{
+	workqueue_flush();
+}
@@ -43,6 +43,11 @@
  * Spinlocks.
  */
 
+/*
+ * Queue nodes for queued spinlocks taken before curcpu exists. Only
+ * the boot cpu is running then.
+ */
+static struct spinlock_qnode spinlock_bootqnodes[SPINLOCK_NQNODES];
 
 /*
  * Initialize spinlock.
@@ -52,6 +57,24 @@ spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+	splk->splk_queued = false;
+	splk->splk_qnode = NULL;
+	splk->splk_handoff = false;
+	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+}
+
+/*
+ * Initialize a queued spinlock. (Not done by calling spinlock_init,
+ * because the lock profiler records the caller of the init function.)
+ */
+void
+spinlock_init_queued(struct spinlock *splk)
+{
+	spinlock_data_set(&splk->splk_lock, 0);
+	splk->splk_holder = NULL;
+	splk->splk_queued = true;
+	splk->splk_qnode = NULL;
+	splk->splk_handoff = false;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
 }
 
@@ -65,6 +88,118 @@ spinlock_cleanup(struct spinlock *splk)
 	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
 }
 
+/*
+ * Get a queue node from MYCPU's pool (or the boot pool), or NULL if
+ * they're all in use. Interrupts must be off.
+ */
+static
+struct spinlock_qnode *
+spinlock_qnode_get(struct cpu *mycpu)
+{
+	struct spinlock_qnode *pool;
+	unsigned i;
+
+	pool = mycpu != NULL ? mycpu->c_qnodes : spinlock_bootqnodes;
+	for (i=0; i<SPINLOCK_NQNODES; i++) {
+		if (!pool[i].qn_inuse) {
+			pool[i].qn_inuse = true;
+			return &pool[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * MCS acquire: put ourselves at the tail of the line, and if there
+ * was anyone ahead of us, link in behind them and wait for them to
+ * clear our qn_wait. If the one ahead of us holds the lock without a
+ * node, wait for it to set splk_handoff instead.
+ *
+ * With no node to spare, spin on the lock word until it's free and
+ * take it with SPINLOCK_QTAS.
+ */
+static
+void
+spinlock_acquire_queued(struct spinlock *splk, struct cpu *mycpu)
+{
+	struct spinlock_qnode *node, *pred;
+
+	node = spinlock_qnode_get(mycpu);
+	if (node == NULL) {
+		while (1) {
+			if (spinlock_data_get(&splk->splk_lock) != 0) {
+				continue;
+			}
+			if (spinlock_data_cas(&splk->splk_lock, 0,
+					      SPINLOCK_QTAS) != 0) {
+				continue;
+			}
+			break;
+		}
+		splk->splk_qnode = NULL;
+		return;
+	}
+
+	node->qn_next = NULL;
+	node->qn_wait = true;
+	membar_store_store();
+
+	pred = (struct spinlock_qnode *)
+		spinlock_data_swap(&splk->splk_lock, (spinlock_data_t)node);
+	if (pred == (struct spinlock_qnode *)SPINLOCK_QTAS) {
+		while (!splk->splk_handoff) {
+			/* only the first in line spins here */
+		}
+		splk->splk_handoff = false;
+	}
+	else if (pred != NULL) {
+		pred->qn_next = node;
+		while (node->qn_wait) {
+			/* spin on our own cache line */
+		}
+	}
+	splk->splk_qnode = node;
+}
+
+/*
+ * MCS release: hand the lock to the next in line, or if there is
+ * nobody, mark it free. If somebody has swapped themselves in as the
+ * tail but not yet linked to us, wait for the link to appear.
+ */
+static
+void
+spinlock_release_queued(struct spinlock *splk)
+{
+	struct spinlock_qnode *node;
+
+	/* Read this first; the next holder overwrites it. */
+	node = splk->splk_qnode;
+	splk->splk_qnode = NULL;
+	membar_any_store();
+
+	if (node == NULL) {
+		/* Held with SPINLOCK_QTAS; anyone who swapped in is next */
+		if (spinlock_data_cas(&splk->splk_lock, SPINLOCK_QTAS,
+				      0) != SPINLOCK_QTAS) {
+			splk->splk_handoff = true;
+		}
+		return;
+	}
+
+	if (node->qn_next == NULL) {
+		if (spinlock_data_cas(&splk->splk_lock, (spinlock_data_t)node,
+				      0) == (spinlock_data_t)node) {
+			node->qn_inuse = false;
+			return;
+		}
+		while (node->qn_next == NULL) {
+			/* wait for the successor to link in */
+		}
+	}
+	node->qn_next->qn_wait = false;
+	node->qn_inuse = false;
+}
+
 /*
  * Get the lock.
  *
@@ -93,24 +228,29 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
+	if (splk->splk_queued) {
+		spinlock_acquire_queued(splk, mycpu);
+	}
+	else {
+		while (1) {
+			/*
+			 * Do test-test-and-set, that is, read first before
+			 * doing test-and-set, to reduce bus contention.
+			 *
+			 * Test-and-set is a machine-level atomic operation
+			 * that writes 1 into the lock word and returns the
+			 * previous value. If that value was 0, the lock was
+			 * previously unheld and we now own it. If it was 1,
+			 * we don't.
+			 */
+			if (spinlock_data_get(&splk->splk_lock) != 0) {
+				continue;
+			}
+			if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+				continue;
+			}
+			break;
 		}
-		break;
 	}
 
 	membar_store_any();
@@ -136,8 +276,13 @@ spinlock_release(struct spinlock *splk)
 	}
 
 	splk->splk_holder = NULL;
-	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	if (splk->splk_queued) {
+		spinlock_release_queued(splk);
+	}
+	else {
+		membar_any_store();
+		spinlock_data_set(&splk->splk_lock, 0);
+	}
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -33,13 +33,56 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <timer.h>
 #include <synch.h>
 
+////////////////////////////////////////////////////////////
+//
+// Timeouts.
+//
+// A timed wait arms a timer before taking the object's spinlock.
+// If the timer fires, it sets st_expired and wakes everyone on the
+// wait channel; the waiters all recheck their condition, so the
+// extra wakeups are harmless. Since the timer function takes the
+// object's spinlock, the waiter must not hold it when cancelling.
+
+struct synch_timeout {
+	struct timer st_timer;
+	struct wchan *st_wchan;
+	struct spinlock *st_lock;
+	volatile bool st_expired;
+};
+
+static
+void
+synch_timeout_expire(void *data)
+{
+	struct synch_timeout *st = data;
+
+	spinlock_acquire(st->st_lock);
+	st->st_expired = true;
+	wchan_wakeall(st->st_wchan, st->st_lock);
+	spinlock_release(st->st_lock);
+}
+
+static
+void
+synch_timeout_start(struct synch_timeout *st, struct wchan *wc,
+		    struct spinlock *lk, unsigned ticks)
+{
+	st->st_wchan = wc;
+	st->st_lock = lk;
+	st->st_expired = false;
+	timer_init(&st->st_timer, synch_timeout_expire, st);
+	timer_add(&st->st_timer, ticks);
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
@@ -67,7 +110,7 @@ sem_create(const char *name, unsigned initial_count)
 		return NULL;
 	}
 
-	spinlock_init(&sem->sem_lock);
+	spinlock_init_queued(&sem->sem_lock);
 	sem->sem_count = initial_count;
 
 	return sem;
@@ -134,6 +177,230 @@ V(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+int
+P_timeout(struct semaphore *sem, unsigned ticks)
+{
+	struct synch_timeout st;
+	int result;
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	synch_timeout_start(&st, sem->sem_wchan, &sem->sem_lock, ticks);
+
+	spinlock_acquire(&sem->sem_lock);
+	while (sem->sem_count == 0 && !st.st_expired) {
+		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+	}
+	if (sem->sem_count > 0) {
+		sem->sem_count--;
+		result = 0;
+	}
+	else {
+		result = ETIMEDOUT;
+	}
+	spinlock_release(&sem->sem_lock);
+
+	timer_cancel(&st.st_timer);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Priority inheritance.
+//
+// A thread blocked on a lock lends its priority to the holder, and
+// if the holder is itself blocked on a lock, to that lock's holder,
+// and so on down the chain. Each lock remembers the highest priority
+// among its waiters (lk_waitpri) and each thread the locks it holds
+// (t_heldlocks), so that on release a thread can drop back to the
+// highest priority it still owes anyone.
+//
+// pi_lock protects lk_holder, lk_waitpri, lk_nextheld and the
+// priority fields of struct thread. It comes after every lk_lock and
+// before the run queue locks.
+//
+// When a waiter gives up (lock_acquire_timeout) we recompute only
+// the lock it was waiting for and that lock's holder; threads
+// further down the chain may stay boosted until they release.
+
+static struct spinlock pi_lock = SPINLOCK_QUEUED_INITIALIZER;
+
+/* Bound on the chain walk, in case of a deadlock cycle. */
+#define PI_MAXDEPTH 16
+
+/*
+ * Compute the priority thread T should run at: its base priority or
+ * the most urgent waiter on any lock it holds.
+ */
+static
+int
+pi_compute(struct thread *t)
+{
+	struct lock *l;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(&pi_lock));
+
+	pri = t->t_basepri;
+	for (l = t->t_heldlocks; l != NULL; l = l->lk_nextheld) {
+		if (l->lk_waitpri > pri) {
+			pri = l->lk_waitpri;
+		}
+	}
+	return pri;
+}
+
+/*
+ * A thread of priority PRI is waiting for LOCK; boost the holder and
+ * anyone the holder is in turn waiting for.
+ */
+static
+void
+pi_propagate(struct lock *lock, int pri)
+{
+	struct thread *holder;
+	unsigned depth;
+
+	KASSERT(spinlock_do_i_hold(&pi_lock));
+
+	for (depth = 0; lock != NULL && depth < PI_MAXDEPTH; depth++) {
+		if (lock->lk_waitpri < pri) {
+			lock->lk_waitpri = pri;
+		}
+		holder = lock->lk_holder;
+		if (holder == NULL || holder->t_pri >= pri) {
+			break;
+		}
+		thread_reprioritize(holder, pri);
+		lock = holder->t_waitlock;
+	}
+}
+
+/*
+ * About to sleep on LOCK (whose lk_lock we hold).
+ */
+static
+void
+pi_block(struct lock *lock)
+{
+	spinlock_acquire(&pi_lock);
+	curthread->t_waitlock = lock;
+	pi_propagate(lock, curthread->t_pri);
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Take ownership of LOCK (whose lk_lock we hold). Any remaining
+ * waiters now lend their priority to us.
+ */
+static
+void
+pi_take(struct lock *lock)
+{
+	struct thread *cur = curthread;
+
+	spinlock_acquire(&pi_lock);
+	lock->lk_holder = cur;
+	cur->t_waitlock = NULL;
+	lock->lk_waitpri = wchan_maxpri(lock->lk_wchan, &lock->lk_lock);
+	lock->lk_nextheld = cur->t_heldlocks;
+	cur->t_heldlocks = lock;
+	if (lock->lk_waitpri > cur->t_pri) {
+		thread_reprioritize(cur, lock->lk_waitpri);
+	}
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Give up ownership of LOCK (whose lk_lock we hold) and drop back to
+ * whatever priority we still owe.
+ */
+static
+void
+pi_drop(struct lock *lock)
+{
+	struct thread *cur = curthread;
+	struct lock **lp;
+	int pri;
+
+	spinlock_acquire(&pi_lock);
+	lock->lk_holder = NULL;
+	lock->lk_waitpri = PRI_NONE;
+	for (lp = &cur->t_heldlocks; *lp != lock; lp = &(*lp)->lk_nextheld) {
+		KASSERT(*lp != NULL);
+	}
+	*lp = lock->lk_nextheld;
+	lock->lk_nextheld = NULL;
+	pri = pi_compute(cur);
+	if (pri != cur->t_pri) {
+		thread_reprioritize(cur, pri);
+	}
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Stop waiting for LOCK (whose lk_lock we hold) without getting it.
+ */
+static
+void
+pi_unblock(struct lock *lock)
+{
+	struct thread *holder;
+	int pri;
+
+	spinlock_acquire(&pi_lock);
+	curthread->t_waitlock = NULL;
+	lock->lk_waitpri = wchan_maxpri(lock->lk_wchan, &lock->lk_lock);
+	holder = lock->lk_holder;
+	if (holder != NULL) {
+		pri = pi_compute(holder);
+		if (pri < holder->t_pri) {
+			thread_reprioritize(holder, pri);
+		}
+	}
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Threads moved straight onto LOCK's wait channel (by cv_wake) are
+ * waiting for it now too. Record that in their t_waitlock, as
+ * pi_block would have, so that boosting one of them (because it
+ * holds some other lock) carries on down to LOCK's holder.
+ */
+static
+void
+pi_requeued(struct lock *lock)
+{
+	int pri;
+
+	pri = wchan_maxpri(lock->lk_wchan, &lock->lk_lock);
+	spinlock_acquire(&pi_lock);
+	wchan_setwaitlock(lock->lk_wchan, &lock->lk_lock, lock);
+	pi_propagate(lock, pri);
+	spinlock_release(&pi_lock);
+}
+
+int
+thread_setpriority(int pri)
+{
+	struct thread *cur = curthread;
+	int old, newpri;
+
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	spinlock_acquire(&pi_lock);
+	old = cur->t_basepri;
+	cur->t_basepri = pri;
+	newpri = pi_compute(cur);
+	if (newpri != cur->t_pri) {
+		thread_reprioritize(cur, newpri);
+	}
+	spinlock_release(&pi_lock);
+
+	return old;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Lock.
@@ -162,8 +429,10 @@ lock_create(const char *name)
 		kfree(lock);
 		return NULL;
 	}
-	spinlock_init(&lock->lk_lock);
+	spinlock_init_queued(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	lock->lk_waitpri = PRI_NONE;
+	lock->lk_nextheld = NULL;
 
 	return lock;
 }
@@ -194,10 +463,11 @@ lock_acquire(struct lock *lock)
 
 	KASSERT(lock->lk_holder != curthread);
 	while (lock->lk_holder != NULL) {
-		/* As in the semaphore. */
+		/* Lend the holder our priority, then as in the semaphore. */
+		pi_block(lock);
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
-	lock->lk_holder = curthread;
+	pi_take(lock);
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -213,7 +483,7 @@ lock_release(struct lock *lock)
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
-	lock->lk_holder = NULL;
+	pi_drop(lock);
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 
 	/* Call this (atomically) when the lock is released */
@@ -222,6 +492,44 @@ lock_release(struct lock *lock)
 	spinlock_release(&lock->lk_lock);
 }
 
+int
+lock_acquire_timeout(struct lock *lock, unsigned ticks)
+{
+	struct synch_timeout st;
+	int result;
+
+	DEBUGASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	synch_timeout_start(&st, lock->lk_wchan, &lock->lk_lock, ticks);
+
+	spinlock_acquire(&lock->lk_lock);
+
+	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+
+	KASSERT(lock->lk_holder != curthread);
+	while (lock->lk_holder != NULL && !st.st_expired) {
+		pi_block(lock);
+		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+	}
+	if (lock->lk_holder == NULL) {
+		pi_take(lock);
+		HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
+		result = 0;
+	}
+	else {
+		/* Stop waiting; tell the deadlock detector too. */
+		pi_unblock(lock);
+		HANGMAN_GIVEUP(&curthread->t_hangman, &lock->lk_hangman);
+		result = ETIMEDOUT;
+	}
+
+	spinlock_release(&lock->lk_lock);
+
+	timer_cancel(&st.st_timer);
+	return result;
+}
+
 bool
 lock_do_i_hold(struct lock *lock)
 {
@@ -264,7 +572,7 @@ cv_create(const char *name)
 		return NULL;
 	}
 
-	spinlock_init(&cv->cv_wchanlock);
+	spinlock_init_queued(&cv->cv_wchanlock);
 	return cv;
 }
 
@@ -298,20 +606,50 @@ cv_wait(struct cv *cv, struct lock *lock)
 	lock_acquire(lock);
 }
 
+/*
+ * Wait morphing: the usual caller of cv_signal/cv_broadcast holds
+ * LOCK, so a woken waiter would only run far enough to find LOCK
+ * held and go back to sleep on it. Instead, if LOCK is held, move
+ * the waiters straight onto the lock's wait channel; lock_release
+ * then wakes them one at a time. A waiter woken that way comes back
+ * out of cv_wait's wchan_sleep and calls lock_acquire as usual.
+ *
+ * Lock order is cv_wchanlock, then lk_lock (as in cv_wait).
+ */
+static
 void
-cv_signal(struct cv *cv, struct lock *lock)
+cv_wake(struct cv *cv, struct lock *lock, bool all)
 {
-	(void)lock;
 	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeone(cv->cv_wchan, &cv->cv_wchanlock);
+	if (lock != NULL) {
+		spinlock_acquire(&lock->lk_lock);
+		if (lock->lk_holder != NULL) {
+			wchan_requeue(cv->cv_wchan, &cv->cv_wchanlock,
+				      lock->lk_wchan, &lock->lk_lock, all);
+			pi_requeued(lock);
+			spinlock_release(&lock->lk_lock);
+			spinlock_release(&cv->cv_wchanlock);
+			return;
+		}
+		spinlock_release(&lock->lk_lock);
+	}
+	if (all) {
+		wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
+	}
+	else {
+		wchan_wakeone(cv->cv_wchan, &cv->cv_wchanlock);
+	}
 	spinlock_release(&cv->cv_wchanlock);
 }
 
+void
+cv_signal(struct cv *cv, struct lock *lock)
+{
+	cv_wake(cv, lock, false);
+}
+
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	(void)lock;
-	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
-	spinlock_release(&cv->cv_wchanlock);
+	cv_wake(cv, lock, true);
 }
@@ -42,6 +42,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <membar.h>
 #include <wchan.h>
 #include <thread.h>
 #include <threadlist.h>
@@ -53,11 +54,20 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <workqueue.h>
+#include <timer.h>
+#include <rcu.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Maximum number of dead threads (with their stacks) each cpu keeps
+ * around for reuse by thread_fork.
+ */
+#define THREAD_CACHE_MAX 8
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -89,6 +99,20 @@ thread_checkstack_init(struct thread *thread)
 	((uint32_t *)thread->t_stack)[3] = THREAD_STACK_MAGIC;
 }
 
+/*
+ * Return true if the magic number thread_checkstack_init put on the
+ * bottom end of the stack is still intact.
+ */
+static
+bool
+thread_stackguard_ok(struct thread *thread)
+{
+	return ((uint32_t*)thread->t_stack)[0] == THREAD_STACK_MAGIC &&
+		((uint32_t*)thread->t_stack)[1] == THREAD_STACK_MAGIC &&
+		((uint32_t*)thread->t_stack)[2] == THREAD_STACK_MAGIC &&
+		((uint32_t*)thread->t_stack)[3] == THREAD_STACK_MAGIC;
+}
+
 /*
  * Check the magic number we put on the bottom end of the stack in
  * thread_checkstack_init. If these assertions go off, it most likely
@@ -112,26 +136,34 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Initialize the fields of a thread structure, either freshly
+ * allocated or taken from the thread cache. The stack (t_stack) is
+ * left alone.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_init(struct thread *thread, const char *name)
 {
-	struct thread *thread;
+	int result = 0;
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	/*
+	 * Short names live in the thread itself. If a long name can't
+	 * be allocated, finish initializing (with an empty name) so
+	 * the caller can just thread_destroy the result.
+	 */
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
 	}
-
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+	else {
+		thread->t_name = kstrdup(name);
+		if (thread->t_name == NULL) {
+			thread->t_namebuf[0] = '\0';
+			thread->t_name = thread->t_namebuf;
+			result = ENOMEM;
+		}
 	}
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
@@ -139,11 +171,16 @@ thread_create(const char *name)
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
 	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+	thread->t_rcu_nesting = 0;
+	thread->t_basepri = PRI_DEFAULT;
+	thread->t_pri = PRI_DEFAULT;
+	thread->t_waitlock = NULL;
+	thread->t_heldlocks = NULL;
+	thread->t_age = 0;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -152,9 +189,79 @@ thread_create(const char *name)
 
 	/* If you add to struct thread, be sure to initialize here */
 
+	return result;
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->t_stack = NULL;
+	if (thread_init(thread, name)) {
+		/* nothing else has been allocated yet */
+		kfree(thread);
+		return NULL;
+	}
+
 	return thread;
 }
 
+/*
+ * Per-cpu cache of dead threads, complete with stacks (and stack
+ * guards), so that thread_fork doesn't have to go to kmalloc in the
+ * steady state.
+ *
+ * The cache belongs to the cpu and is touched both by thread_fork and
+ * by exorcise (from inside thread_switch) on that cpu, so interrupts
+ * must be off while manipulating it. That also keeps us from being
+ * switched to another cpu in the middle.
+ */
+static
+struct thread *
+thread_cache_get(void)
+{
+	struct thread *thread;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	if (thread != NULL) {
+		curcpu->c_threadcache_count--;
+	}
+	splx(spl);
+
+	return thread;
+}
+
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	bool ret = false;
+	int spl;
+
+	spl = splhigh();
+	if (curcpu->c_threadcache_count < THREAD_CACHE_MAX) {
+		threadlist_addhead(&curcpu->c_threadcache, thread);
+		curcpu->c_threadcache_count++;
+		ret = true;
+	}
+	splx(spl);
+
+	return ret;
+}
+
 /*
  * Create a CPU structure. This is used for the bootup CPU and
  * also for secondary CPUs.
@@ -168,6 +275,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -182,13 +290,35 @@ cpu_create(unsigned hardware_number)
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_intruser = false;
+	threadlist_init(&c->c_threadcache);
+	c->c_threadcache_count = 0;
+	for (i=0; i<CS_NSTATS; i++) {
+		c->c_stats[i] = 0;
+	}
+	for (i=0; i<SPINLOCK_NQNODES; i++) {
+		c->c_qnodes[i].qn_inuse = false;
+	}
+	c->c_timerwheel = timerwheel_create();
+	if (c->c_timerwheel == NULL) {
+		panic("cpu_create: Out of memory\n");
+	}
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
-	spinlock_init(&c->c_runqueue_lock);
+	spinlock_init_queued(&c->c_runqueue_lock);
+
+	c->c_rcu_qs = 0;
+	c->c_rcu_online = false;
+
+	c->c_workqueue = NULL;
+
+	c->c_tlbas = NULL;
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdown_all = false;
+	c->c_shootdown_gen = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -262,6 +392,9 @@ cpu_create(unsigned hardware_number)
  * Nor can it be called on a running thread.
  *
  * (Freeing the stack you're actually using to run is ... inadvisable.)
+ *
+ * If there's room, the thread structure and its stack go into this
+ * cpu's thread cache instead of back to kmalloc.
  */
 static
 void
@@ -277,16 +410,27 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
+	}
+	thread->t_name = thread->t_namebuf;
+
+	if (thread->t_stack != NULL) {
+		/* Don't recycle a stack whose guard has been trampled */
+		if (thread_stackguard_ok(thread)) {
+			threadlistnode_init(&thread->t_listnode, thread);
+			if (thread_cache_put(thread)) {
+				return;
+			}
+		}
+		kfree(thread->t_stack);
+	}
 	kfree(thread);
 }
 
@@ -394,6 +538,9 @@ thread_bootstrap(void)
 	KASSERT(curthread->t_proc != NULL);
 	KASSERT(curthread->t_proc == kproc);
 
+	/* The boot cpu is now running threads. */
+	rcu_cpu_online();
+
 	/* Done */
 }
 
@@ -419,10 +566,25 @@ cpu_hatch(unsigned software_number)
 
 	kprintf("cpu%u: %s\n", software_number, buf);
 
+	workqueue_cpu_bootstrap();
+	rcu_cpu_online();
+
 	V(cpu_startup_sem);
 	thread_exit();
 }
 
+/*
+ * Look up a cpu by number.
+ */
+struct cpu *
+cpu_get(unsigned n)
+{
+	if (n >= cpuarray_num(&allcpus)) {
+		return NULL;
+	}
+	return cpuarray_get(&allcpus, n);
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -445,6 +607,46 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * The priority a thread has on the run queue: its effective priority
+ * plus however much it has aged while waiting (see schedule()), but
+ * never more than PRI_MAX.
+ */
+static
+int
+runqueue_pri(const struct thread *t)
+{
+	int pri;
+
+	pri = t->t_pri + t->t_age;
+	return pri > PRI_MAX ? PRI_MAX : pri;
+}
+
+/*
+ * Put a thread on a cpu's run queue, which is kept sorted by run
+ * queue priority (highest first) and is FIFO among threads of equal
+ * priority. We search from the tail because in the common case
+ * everything has the same priority and this stops immediately.
+ */
+static
+void
+runqueue_insert(struct cpu *c, struct thread *t)
+{
+	struct thread *t2;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	pri = runqueue_pri(t);
+	THREADLIST_FORALL_REV(t2, c->c_runqueue) {
+		if (runqueue_pri(t2) >= pri) {
+			threadlist_insertafter(&c->c_runqueue, t2, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -469,7 +671,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	runqueue_insert(targetcpu, target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -503,18 +705,29 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
-	if (newthread == NULL) {
-		return ENOMEM;
+	newthread = thread_cache_get();
+	if (newthread != NULL) {
+		/* Recycled; the stack and its guard are already set up */
+		result = thread_init(newthread, name);
+		if (result) {
+			thread_destroy(newthread);
+			return result;
+		}
 	}
+	else {
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -575,6 +788,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 
 	cur = curthread;
 
+	/* No sleeping in RCU read-side sections; otherwise, quiescent. */
+	KASSERT(cur->t_rcu_nesting == 0);
+	rcu_quiescent();
+
 	/*
 	 * If we're idle, return without doing anything. This happens
 	 * when the timer interrupt interrupts the idle loop.
@@ -590,8 +807,15 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. This
+	 * includes yielding when everything waiting is of lower
+	 * priority than we are. Waiting threads age (see schedule())
+	 * until they aren't, so they don't starve.
+	 */
+	next = threadlist_peekhead(&curcpu->c_runqueue);
+	if (newstate == S_READY &&
+	    (next == NULL || runqueue_pri(next) < runqueue_pri(cur))) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -653,6 +877,22 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/* It's been picked; it starts aging again next time it waits. */
+	next->t_age = 0;
+
+	if (next != cur) {
+		cpustat_inc(CS_CSWITCHES);
+		/* Being yielded from the timer interrupt is involuntary. */
+		if (cur->t_proc != NULL && cur->t_proc != kproc) {
+			if (newstate == S_READY && cur->t_in_interrupt) {
+				cur->t_proc->p_ru.pr_nivcsw++;
+			}
+			else if (newstate != S_ZOMBIE) {
+				cur->t_proc->p_ru.pr_nvcsw++;
+			}
+		}
+	}
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -821,17 +1061,27 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is called periodically from hardclock(). The run queue is
+ * already in priority order; what we do here is age it. Every thread
+ * still waiting gains a point of run queue priority, up to PRI_MAX,
+ * so one kept waiting by busier, more urgent threads eventually
+ * reaches their priority and gets a turn. It drops back when it's
+ * picked to run. Aging everything by the same amount (with the cap)
+ * keeps the queue sorted.
  */
 
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct thread *t;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		if (t->t_pri + t->t_age < PRI_MAX) {
+			t->t_age++;
+		}
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
@@ -923,7 +1173,7 @@ thread_consider_migration(void)
 			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			runqueue_insert(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -947,7 +1197,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			runqueue_insert(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -956,6 +1206,122 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Change the effective priority of a thread. If it's waiting on a
+ * run queue, move it to its new place. (Sleeping threads are found
+ * by priority when they're woken, so they need no attention.)
+ *
+ * Called from the priority-inheritance code in synch.c, which
+ * serializes calls.
+ */
+void
+thread_reprioritize(struct thread *t, int pri)
+{
+	struct cpu *c;
+
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	/*
+	 * The thread can migrate while we aren't holding its cpu's
+	 * run queue lock, so check t_cpu again once we have it.
+	 */
+	while (1) {
+		c = t->t_cpu;
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (c == t->t_cpu) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	if (t->t_state == S_READY && t->t_pri != pri) {
+		threadlist_remove(&c->c_runqueue, t);
+		t->t_pri = pri;
+		runqueue_insert(c, t);
+	}
+	else {
+		t->t_pri = pri;
+	}
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Per-cpu statistics.
+ */
+
+static const char *const cpustat_names[CS_NSTATS] = {
+	"intr", "syscall", "fault", "zfill", "cow", "cswitch",
+	"dkread", "dkwrite", "shootdn",
+};
+
+/*
+ * Bump a counter on this cpu. No lock is needed since no other cpu
+ * writes it; raising the spl keeps an interrupt (or a context switch
+ * that moves us to another cpu) from splitting the read-modify-write.
+ */
+void
+cpustat_inc(enum cpustat which)
+{
+	int spl;
+
+	KASSERT(which < CS_NSTATS);
+
+	spl = splhigh();
+	curcpu->c_stats[which]++;
+	splx(spl);
+}
+
+/*
+ * Sum a counter across all cpus. The per-cpu values are read without
+ * synchronization, so the result is only a snapshot.
+ */
+unsigned
+cpustat_get(enum cpustat which)
+{
+	unsigned i, total;
+
+	KASSERT(which < CS_NSTATS);
+
+	total = 0;
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		total += cpuarray_get(&allcpus, i)->c_stats[which];
+	}
+	return total;
+}
+
+/*
+ * Print all counters, one line per cpu plus a line of totals.
+ */
+void
+cpustat_print(void)
+{
+	struct cpu *c;
+	unsigned i, j;
+
+	kprintf("cpu  ");
+	for (j=0; j<CS_NSTATS; j++) {
+		kprintf(" %9s", cpustat_names[j]);
+	}
+	kprintf("\n");
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%-5u", c->c_number);
+		for (j=0; j<CS_NSTATS; j++) {
+			kprintf(" %9u", c->c_stats[j]);
+		}
+		kprintf("\n");
+	}
+
+	kprintf("total");
+	for (j=0; j<CS_NSTATS; j++) {
+		kprintf(" %9u", cpustat_get(j));
+	}
+	kprintf("\n");
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1019,6 +1385,29 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * Take the highest-priority thread off a wait channel, or the one
+ * that has waited longest if there's a tie. Returns NULL if nobody
+ * is sleeping.
+ */
+static
+struct thread *
+wchan_pick(struct wchan *wc)
+{
+	struct thread *t, *best;
+
+	best = NULL;
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (best == NULL || t->t_pri > best->t_pri) {
+			best = t;
+		}
+	}
+	if (best != NULL) {
+		threadlist_remove(&wc->wc_threads, best);
+	}
+	return best;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1030,7 +1419,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	KASSERT(spinlock_do_i_hold(lk));
 
 	/* Grab a thread from the channel */
-	target = threadlist_remhead(&wc->wc_threads);
+	target = wchan_pick(wc);
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
@@ -1081,6 +1470,66 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Move sleepers from one wait channel to another. The threads stay
+ * asleep; this is only list surgery.
+ */
+void
+wchan_requeue(struct wchan *from, struct spinlock *fromlk,
+	      struct wchan *to, struct spinlock *tolk, bool all)
+{
+	struct thread *target;
+
+	KASSERT(spinlock_do_i_hold(fromlk));
+	KASSERT(spinlock_do_i_hold(tolk));
+	KASSERT(from != to);
+
+	while ((target = wchan_pick(from)) != NULL) {
+		KASSERT(target->t_state == S_SLEEP);
+		target->t_wchan_name = to->wc_name;
+		threadlist_addtail(&to->wc_threads, target);
+		if (!all) {
+			break;
+		}
+	}
+}
+
+/*
+ * Return the highest priority of any thread sleeping on the channel,
+ * or PRI_NONE if there are none.
+ */
+int
+wchan_maxpri(struct wchan *wc, struct spinlock *lk)
+{
+	struct thread *t;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	pri = PRI_NONE;
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (t->t_pri > pri) {
+			pri = t->t_pri;
+		}
+	}
+	return pri;
+}
+
+/*
+ * Mark every thread sleeping on the channel as blocked on LOCK.
+ */
+void
+wchan_setwaitlock(struct wchan *wc, struct spinlock *lk, struct lock *lock)
+{
+	struct thread *t;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		t->t_waitlock = lock;
+	}
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1134,37 +1583,98 @@ ipi_broadcast(int code)
 }
 
 /*
- * Send a TLB shootdown IPI to the specified CPU.
+ * Send a TLB shootdown IPI to the specified CPU. Returns a ticket for
+ * ipi_tlbshootdown_wait.
  */
-void
+unsigned
 ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 {
-	unsigned n;
+	unsigned n, ticket;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
 	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
-		/*
-		 * If you have problems with this panic going off,
-		 * consider: (1) increasing the maximum, (2) putting
-		 * logic here to sleep until space appears (may
-		 * interact awkwardly with VM system locking), (3)
-		 * putting logic here to coalesce requests together,
-		 * and/or (4) improving VM system state tracking to
-		 * reduce the number of unnecessary shootdowns.
-		 */
-		panic("ipi_tlbshootdown: Too many shootdowns queued\n");
+	if (target->c_shootdown_all) {
+		/* Already going to flush everything. */
+	}
+	else if (n == TLBSHOOTDOWN_MAX) {
+		/* Coalesce: drop the queue and flush the whole TLB. */
+		target->c_numshootdown = 0;
+		target->c_shootdown_all = true;
 	}
 	else {
 		target->c_shootdown[n] = *mapping;
 		target->c_numshootdown = n+1;
 	}
+	ticket = target->c_shootdown_gen;
 
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
 	mainbus_send_ipi(target);
 
 	spinlock_release(&target->c_ipi_lock);
+
+	cpustat_inc(CS_SHOOTDOWNS);
+	return ticket;
+}
+
+/*
+ * Do the shootdowns queued for the current CPU. Call with its
+ * c_ipi_lock held.
+ */
+static
+void
+tlbshootdown_run(void)
+{
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&curcpu->c_ipi_lock));
+
+	if (curcpu->c_shootdown_all) {
+		struct tlbshootdown all;
+
+		all.ts_as = NULL;
+		all.ts_npages = 0;
+		vm_tlbshootdown(&all);
+		curcpu->c_shootdown_all = false;
+	}
+	else {
+		for (i=0; i<curcpu->c_numshootdown; i++) {
+			vm_tlbshootdown(&curcpu->c_shootdown[i]);
+		}
+	}
+	curcpu->c_numshootdown = 0;
+	membar_store_store();
+	curcpu->c_shootdown_gen++;
+	curcpu->c_ipi_pending &= ~((uint32_t)1 << IPI_TLBSHOOTDOWN);
+}
+
+/*
+ * Wait until TARGET has processed the shootdown that returned TICKET.
+ * The target bumps c_shootdown_gen after doing everything queued, so
+ * any change means ours is done.
+ *
+ * This can be called with interrupts off (e.g. from a VM fault taken
+ * at raised spl), so we can't count on the IPI handler to run our own
+ * queue. If TARGET is waiting on us at the same time, it would never
+ * finish; so while spinning, do any shootdowns queued for this CPU
+ * ourselves. The IPI, when it does arrive, then finds nothing to do.
+ */
+void
+ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket)
+{
+	KASSERT(target != curcpu->c_self);
+
+	while (target->c_shootdown_gen == ticket) {
+		if (curcpu->c_ipi_pending & (1U << IPI_TLBSHOOTDOWN)) {
+			spinlock_acquire(&curcpu->c_ipi_lock);
+			if (curcpu->c_ipi_pending &
+			    (1U << IPI_TLBSHOOTDOWN)) {
+				tlbshootdown_run();
+			}
+			spinlock_release(&curcpu->c_ipi_lock);
+		}
+	}
+	membar_load_load();
 }
 
 /*
@@ -1174,7 +1684,6 @@ void
 interprocessor_interrupt(void)
 {
 	uint32_t bits;
-	unsigned i;
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
@@ -1208,10 +1717,7 @@ interprocessor_interrupt(void)
 		 * need to release the ipi lock while calling
 		 * vm_tlbshootdown.
 		 */
-		for (i=0; i<curcpu->c_numshootdown; i++) {
-			vm_tlbshootdown(&curcpu->c_shootdown[i]);
-		}
-		curcpu->c_numshootdown = 0;
+		tlbshootdown_run();
 	}
 
 	curcpu->c_ipi_pending = 0;
@@ -179,6 +179,21 @@ threadlist_addtail(struct threadlist *tl, struct thread *t)
 	tl->tl_count++;
 }
 
+struct thread *
+threadlist_peekhead(struct threadlist *tl)
+{
+	struct threadlistnode *tln;
+
+	DEBUGASSERT(tl != NULL);
+
+	tln = tl->tl_head.tln_next;
+	if (tln->tln_next == NULL) {
+		/* list is empty  */
+		return NULL;
+	}
+	return tln->tln_self;
+}
+
 struct thread *
 threadlist_remhead(struct threadlist *tl)
 {
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Hierarchical timer wheels. See timer.h for the interface.
+ *
+ * Each CPU's wheel has a 256-slot level for timers due within the
+ * next 256 ticks, and three 64-slot levels above it, each slot of
+ * which covers 64 times as many ticks as a slot of the level below.
+ * Adding a timer drops it straight into the right slot; every 256
+ * ticks the next slot of level 1 is emptied and its timers are
+ * re-added ("cascaded") into level 0, and so on up the hierarchy.
+ * Each slot is an unsorted doubly-linked list, so both adding and
+ * cancelling are constant time, and a tick only looks at timers
+ * that are actually due (or being cascaded).
+ *
+ * This is the same layout as the classic BSD/Linux timer wheel.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <timer.h>
+
+#define TW_L0BITS	8
+#define TW_LNBITS	6
+#define TW_NLEVELS	3		/* levels above level 0 */
+#define TW_L0SIZE	(1U << TW_L0BITS)
+#define TW_LNSIZE	(1U << TW_LNBITS)
+#define TW_L0MASK	(TW_L0SIZE - 1)
+#define TW_LNMASK	(TW_LNSIZE - 1)
+
+/* Longest delay the wheel can hold: 2^26 - 1 ticks, about 7.7 days. */
+#define TW_MAXDELAY	((1U << (TW_L0BITS + TW_NLEVELS*TW_LNBITS)) - 1)
+
+struct timerwheel {
+	struct spinlock tw_lock;
+	unsigned tw_now;			/* next tick to process */
+	struct timer *tw_l0[TW_L0SIZE];
+	struct timer *tw_ln[TW_NLEVELS][TW_LNSIZE];
+};
+
+/*
+ * Wait queues for timer_sleep. Sleepers are spread across several
+ * so that one expiring doesn't wake everybody.
+ */
+#define TIMER_NSLEEPQS	16
+
+struct timer_sleepq {
+	struct spinlock tsq_lock;
+	struct wchan *tsq_wchan;
+};
+
+static struct timer_sleepq timer_sleepqs[TIMER_NSLEEPQS];
+
+////////////////////////////////////////////////////////////
+// wheel internals
+
+static
+void
+tw_link(struct timer **slot, struct timer *tm)
+{
+	tm->tm_next = *slot;
+	if (*slot != NULL) {
+		(*slot)->tm_prevp = &tm->tm_next;
+	}
+	*slot = tm;
+	tm->tm_prevp = slot;
+}
+
+static
+void
+tw_unlink(struct timer *tm)
+{
+	*tm->tm_prevp = tm->tm_next;
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_prevp = tm->tm_prevp;
+	}
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+}
+
+/*
+ * Find the slot for a timer due at tick EXPIRES.
+ */
+static
+struct timer **
+tw_slot(struct timerwheel *tw, unsigned expires)
+{
+	unsigned delta, shift, level;
+
+	delta = expires - tw->tw_now;
+	if (delta < TW_L0SIZE) {
+		return &tw->tw_l0[expires & TW_L0MASK];
+	}
+	for (level = 0; level < TW_NLEVELS - 1; level++) {
+		shift = TW_L0BITS + level * TW_LNBITS;
+		if (delta < (1U << (shift + TW_LNBITS))) {
+			return &tw->tw_ln[level][(expires >> shift) &
+						 TW_LNMASK];
+		}
+	}
+	KASSERT(delta <= TW_MAXDELAY);
+	shift = TW_L0BITS + level * TW_LNBITS;
+	return &tw->tw_ln[level][(expires >> shift) & TW_LNMASK];
+}
+
+/*
+ * Refill level 0 from the levels above. Called when the low bits of
+ * tw_now wrap around.
+ */
+static
+void
+tw_cascade(struct timerwheel *tw)
+{
+	struct timer *tm, *next;
+	unsigned level, shift, idx;
+
+	for (level = 0; level < TW_NLEVELS; level++) {
+		shift = TW_L0BITS + level * TW_LNBITS;
+		idx = (tw->tw_now >> shift) & TW_LNMASK;
+
+		tm = tw->tw_ln[level][idx];
+		tw->tw_ln[level][idx] = NULL;
+		while (tm != NULL) {
+			next = tm->tm_next;
+			tw_link(tw_slot(tw, tm->tm_expires), tm);
+			tm = next;
+		}
+
+		if (idx != 0) {
+			/* the next level up hasn't wrapped */
+			break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// interface
+
+struct timerwheel *
+timerwheel_create(void)
+{
+	struct timerwheel *tw;
+	unsigned i, j;
+
+	tw = kmalloc(sizeof(*tw));
+	if (tw == NULL) {
+		return NULL;
+	}
+	spinlock_init(&tw->tw_lock);
+	tw->tw_now = 0;
+	for (i=0; i<TW_L0SIZE; i++) {
+		tw->tw_l0[i] = NULL;
+	}
+	for (i=0; i<TW_NLEVELS; i++) {
+		for (j=0; j<TW_LNSIZE; j++) {
+			tw->tw_ln[i][j] = NULL;
+		}
+	}
+	return tw;
+}
+
+void
+timer_init(struct timer *tm, void (*func)(void *), void *data)
+{
+	tm->tm_func = func;
+	tm->tm_data = data;
+	tm->tm_expires = 0;
+	tm->tm_wheel = NULL;
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+}
+
+/*
+ * Arrange for TM to fire after TICKS complete ticks have gone by.
+ * The current tick is already partly over, so that means on the
+ * (TICKS+1)th hardclock from now.
+ *
+ * tm_wheel is left set after the timer fires, so that timer_cancel
+ * knows which wheel's lock to take to wait out the function.
+ */
+void
+timer_add(struct timer *tm, unsigned ticks)
+{
+	struct timerwheel *tw;
+
+	KASSERT(tm->tm_prevp == NULL);
+
+	if (ticks > TW_MAXDELAY) {
+		ticks = TW_MAXDELAY;
+	}
+
+	tw = curcpu->c_timerwheel;
+	spinlock_acquire(&tw->tw_lock);
+	tm->tm_expires = tw->tw_now + ticks;
+	tm->tm_wheel = tw;
+	tw_link(tw_slot(tw, tm->tm_expires), tm);
+	spinlock_release(&tw->tw_lock);
+}
+
+bool
+timer_cancel(struct timer *tm)
+{
+	struct timerwheel *tw;
+	bool pending;
+
+	tw = tm->tm_wheel;
+	if (tw == NULL) {
+		/* never added */
+		return false;
+	}
+
+	/*
+	 * Timer functions run with the wheel locked, so once we have
+	 * the lock this one is either still pending or completely
+	 * finished.
+	 */
+	spinlock_acquire(&tw->tw_lock);
+	pending = (tm->tm_prevp != NULL);
+	if (pending) {
+		tw_unlink(tm);
+	}
+	spinlock_release(&tw->tw_lock);
+
+	return pending;
+}
+
+/*
+ * Process one tick on the current CPU.
+ */
+void
+timer_tick(void)
+{
+	struct timerwheel *tw;
+	struct timer *tm;
+	unsigned idx;
+
+	tw = curcpu->c_timerwheel;
+
+	spinlock_acquire(&tw->tw_lock);
+	idx = tw->tw_now & TW_L0MASK;
+	if (idx == 0) {
+		tw_cascade(tw);
+	}
+	while ((tm = tw->tw_l0[idx]) != NULL) {
+		KASSERT(tm->tm_expires == tw->tw_now);
+		tw_unlink(tm);
+		tm->tm_func(tm->tm_data);
+		/* tm may be gone now */
+	}
+	tw->tw_now++;
+	spinlock_release(&tw->tw_lock);
+}
+
+////////////////////////////////////////////////////////////
+// timed sleep
+
+struct timer_sleeper {
+	struct timer ts_timer;
+	struct timer_sleepq *ts_q;
+	volatile bool ts_done;
+};
+
+void
+timer_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<TIMER_NSLEEPQS; i++) {
+		spinlock_init(&timer_sleepqs[i].tsq_lock);
+		timer_sleepqs[i].tsq_wchan = wchan_create("timer_sleep");
+		if (timer_sleepqs[i].tsq_wchan == NULL) {
+			panic("timer_bootstrap: Out of memory\n");
+		}
+	}
+}
+
+static
+void
+timer_sleep_expire(void *data)
+{
+	struct timer_sleeper *ts = data;
+
+	spinlock_acquire(&ts->ts_q->tsq_lock);
+	ts->ts_done = true;
+	wchan_wakeall(ts->ts_q->tsq_wchan, &ts->ts_q->tsq_lock);
+	spinlock_release(&ts->ts_q->tsq_lock);
+}
+
+void
+timer_sleep(unsigned ticks)
+{
+	struct timer_sleeper ts;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	ts.ts_q = &timer_sleepqs[((uintptr_t)curthread >> 5) % TIMER_NSLEEPQS];
+	ts.ts_done = false;
+	timer_init(&ts.ts_timer, timer_sleep_expire, &ts);
+	timer_add(&ts.ts_timer, ticks);
+
+	spinlock_acquire(&ts.ts_q->tsq_lock);
+	while (!ts.ts_done) {
+		wchan_sleep(ts.ts_q->tsq_wchan, &ts.ts_q->tsq_lock);
+	}
+	spinlock_release(&ts.ts_q->tsq_lock);
+
+	/* Make sure timer_sleep_expire is done with TS. */
+	timer_cancel(&ts.ts_timer);
+}
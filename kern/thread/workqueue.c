@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-CPU workqueues. See workqueue.h for the interface.
+ *
+ * Each CPU's queue has its own spinlock, so queueing work never
+ * contends with other CPUs. The workers for a queue are started on
+ * its CPU; nothing stops the scheduler from migrating them later,
+ * which is harmless.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <workqueue.h>
+
+/* Worker threads per CPU. */
+#define WORKQUEUE_NWORKERS	2
+
+struct workqueue {
+	struct cpu *wq_cpu;		/* CPU we belong to */
+	struct spinlock wq_lock;	/* protects everything below */
+	struct wchan *wq_wchan;		/* idle workers sleep here */
+	struct wchan *wq_flushwchan;	/* workqueue_flush sleeps here */
+	struct work *wq_head;		/* work ready to run */
+	struct work *wq_tail;
+	unsigned wq_queued;		/* items on wq_head */
+	unsigned wq_running;		/* items being run right now */
+	struct workqueue *wq_next;	/* next in workqueue_list */
+};
+
+/* All workqueues, for workqueue_flush. Append-only. */
+static struct workqueue *workqueue_list;
+static struct spinlock workqueue_list_lock = SPINLOCK_INITIALIZER;
+
+static void workqueue_delay_expire(void *data);
+
+/*
+ * Set up a work item.
+ */
+void
+work_init(struct work *w, void (*func)(void *), void *data)
+{
+	w->w_func = func;
+	w->w_data = data;
+	w->w_wq = NULL;
+	timer_init(&w->w_timer, workqueue_delay_expire, w);
+	w->w_next = NULL;
+}
+
+/*
+ * Put work on the ready list and get a worker to run it. Caller
+ * holds the queue lock.
+ */
+static
+void
+workqueue_enqueue(struct workqueue *wq, struct work *w)
+{
+	KASSERT(spinlock_do_i_hold(&wq->wq_lock));
+
+	w->w_next = NULL;
+	if (wq->wq_tail == NULL) {
+		wq->wq_head = w;
+	}
+	else {
+		wq->wq_tail->w_next = w;
+	}
+	wq->wq_tail = w;
+	wq->wq_queued++;
+	wchan_wakeone(wq->wq_wchan, &wq->wq_lock);
+}
+
+/*
+ * Queue work on the current CPU.
+ *
+ * If we get migrated after looking at curcpu we end up queueing on
+ * the CPU we came from; that's fine.
+ */
+void
+workqueue_schedule(struct work *w)
+{
+	struct workqueue *wq;
+
+	wq = curcpu->c_workqueue;
+	if (wq == NULL) {
+		/* too early; just do it */
+		w->w_func(w->w_data);
+		return;
+	}
+
+	spinlock_acquire(&wq->wq_lock);
+	workqueue_enqueue(wq, w);
+	spinlock_release(&wq->wq_lock);
+}
+
+/*
+ * Timer function for delayed work: queue it now. This runs in
+ * hardclock with the timer wheel locked; taking wq_lock under it is
+ * fine because we never touch timers while holding wq_lock.
+ */
+static
+void
+workqueue_delay_expire(void *data)
+{
+	struct work *w = data;
+	struct workqueue *wq = w->w_wq;
+
+	spinlock_acquire(&wq->wq_lock);
+	workqueue_enqueue(wq, w);
+	spinlock_release(&wq->wq_lock);
+}
+
+/*
+ * Queue work on the current CPU after at least TICKS hardclocks.
+ */
+void
+workqueue_schedule_delayed(struct work *w, unsigned ticks)
+{
+	struct workqueue *wq;
+
+	wq = curcpu->c_workqueue;
+	if (wq == NULL || ticks == 0) {
+		workqueue_schedule(w);
+		return;
+	}
+
+	w->w_wq = wq;
+	timer_add(&w->w_timer, ticks);
+}
+
+/*
+ * Wait until every workqueue is empty and idle. Work functions may
+ * queue more work, possibly on a queue we've already passed, so keep
+ * making passes until one finds every queue idle without waiting.
+ * Must not be called from a work function.
+ */
+void
+workqueue_flush(void)
+{
+	struct workqueue *wq;
+	bool waited;
+
+	do {
+		waited = false;
+
+		spinlock_acquire(&workqueue_list_lock);
+		wq = workqueue_list;
+		spinlock_release(&workqueue_list_lock);
+
+		while (wq != NULL) {
+			spinlock_acquire(&wq->wq_lock);
+			while (wq->wq_queued > 0 || wq->wq_running > 0) {
+				waited = true;
+				wchan_sleep(wq->wq_flushwchan, &wq->wq_lock);
+			}
+			spinlock_release(&wq->wq_lock);
+
+			spinlock_acquire(&workqueue_list_lock);
+			wq = wq->wq_next;
+			spinlock_release(&workqueue_list_lock);
+		}
+	} while (waited);
+}
+
+/*
+ * Worker thread: run work until the end of time.
+ */
+static
+void
+workqueue_worker(void *data1, unsigned long data2)
+{
+	struct workqueue *wq = data1;
+	struct work *w;
+
+	(void)data2;
+
+	spinlock_acquire(&wq->wq_lock);
+	while (1) {
+		while (wq->wq_head == NULL) {
+			wchan_sleep(wq->wq_wchan, &wq->wq_lock);
+		}
+
+		w = wq->wq_head;
+		wq->wq_head = w->w_next;
+		if (wq->wq_head == NULL) {
+			wq->wq_tail = NULL;
+		}
+		wq->wq_queued--;
+		wq->wq_running++;
+		spinlock_release(&wq->wq_lock);
+
+		/* W may be gone as soon as this is called. */
+		w->w_func(w->w_data);
+
+		spinlock_acquire(&wq->wq_lock);
+		wq->wq_running--;
+		if (wq->wq_queued == 0 && wq->wq_running == 0) {
+			wchan_wakeall(wq->wq_flushwchan, &wq->wq_lock);
+		}
+	}
+}
+
+/*
+ * Create the current CPU's workqueue and start its workers.
+ */
+void
+workqueue_cpu_bootstrap(void)
+{
+	struct workqueue *wq, **wqp;
+	char name[32];
+	unsigned i;
+	int result;
+
+	KASSERT(curcpu->c_workqueue == NULL);
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		panic("workqueue_cpu_bootstrap: Out of memory\n");
+	}
+	wq->wq_cpu = curcpu->c_self;
+	spinlock_init(&wq->wq_lock);
+	wq->wq_wchan = wchan_create("workqueue");
+	wq->wq_flushwchan = wchan_create("workqueue flush");
+	if (wq->wq_wchan == NULL || wq->wq_flushwchan == NULL) {
+		panic("workqueue_cpu_bootstrap: Out of memory\n");
+	}
+	wq->wq_head = wq->wq_tail = NULL;
+	wq->wq_queued = 0;
+	wq->wq_running = 0;
+	wq->wq_next = NULL;
+
+	for (i=0; i<WORKQUEUE_NWORKERS; i++) {
+		snprintf(name, sizeof(name), "worker %u/%u",
+			 curcpu->c_number, i);
+		result = thread_fork(name, kproc, workqueue_worker, wq, i);
+		if (result) {
+			panic("workqueue_cpu_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+
+	spinlock_acquire(&workqueue_list_lock);
+	for (wqp = &workqueue_list; *wqp != NULL; wqp = &(*wqp)->wq_next) {
+		/* nothing */
+	}
+	*wqp = wq;
+	spinlock_release(&workqueue_list_lock);
+
+	/* Publish it last, so nobody sees a half-built queue. */
+	curcpu->c_workqueue = wq;
+}
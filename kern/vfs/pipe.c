@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipes.
+ *
+ * A pipe is a ring buffer of PIPE_NPAGES pages plus two vnodes, one
+ * for each end. The pages are allocated as the writer first reaches
+ * them and kept until the pipe goes away.
+ *
+ * Readers are serialized among themselves by pp_readlock and writers
+ * by pp_writelock, so at any time there's at most one of each in the
+ * ring. The reader owns the bytes between pp_rpos and pp_wpos, and
+ * the writer owns the rest; each copies to or from its part of the
+ * ring with pp_lock released and takes pp_lock only to look at and
+ * advance the positions and to sleep. Transfers are broken only at
+ * page boundaries, so a large write or read moves a whole page per
+ * uiomove.
+ *
+ * Wakeups are batched: a sleeping reader is woken once there's
+ * PIPE_WAKEBATCH bytes of data, and a sleeping writer once there's
+ * that much space, or sooner if the other side is about to stop
+ * (going to sleep itself, or returning), rather than after every
+ * chunk.
+ *
+ * Because writers are serialized, every write is atomic with respect
+ * to other writers, which more than covers PIPE_BUF. Writing when the
+ * read end is closed fails with EPIPE (there are no signals); reading
+ * an empty pipe whose write end is closed returns end of file.
+ *
+ * For poll, the read end is ready when there's data and the write end
+ * when there's room for PIPE_BUF bytes. Pollers are woken only when
+ * the pipe crosses one of those lines (or an end closes), not on
+ * every transfer.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+/* Size of the buffer, in pages. */
+#define PIPE_NPAGES	8
+#define PIPE_SIZE	(PIPE_NPAGES * PAGE_SIZE)
+
+/* Amount of data, or space, worth waking the other side for. */
+#define PIPE_WAKEBATCH	PAGE_SIZE
+
+struct pipe {
+	struct lock *pp_readlock;	/* one reader at a time */
+	struct lock *pp_writelock;	/* one writer at a time */
+	struct lock *pp_lock;		/* protects the fields below */
+	struct cv *pp_readcv;		/* the reader waits here for data */
+	struct cv *pp_writecv;		/* the writer waits here for space */
+	unsigned pp_rpos;		/* bytes ever read */
+	unsigned pp_wpos;		/* bytes ever written */
+	bool pp_readwait;		/* the reader is asleep */
+	bool pp_writewait;		/* the writer is asleep */
+	bool pp_readopen;		/* read end still open */
+	bool pp_writeopen;		/* write end still open */
+	struct pollq pp_readq;		/* pollers waiting for data */
+	struct pollq pp_writeq;		/* pollers waiting for space */
+	void *pp_pages[PIPE_NPAGES];	/* the buffer */
+	struct vnode pp_readvn;		/* read end */
+	struct vnode pp_writevn;	/* write end */
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+/*
+ * Wake the reader if it's asleep. Called with pp_lock held.
+ */
+static
+void
+pipe_wakereader(struct pipe *pp)
+{
+	if (pp->pp_readwait) {
+		pp->pp_readwait = false;
+		cv_signal(pp->pp_readcv, pp->pp_lock);
+	}
+}
+
+/*
+ * Wake the writer if it's asleep. Called with pp_lock held.
+ */
+static
+void
+pipe_wakewriter(struct pipe *pp)
+{
+	if (pp->pp_writewait) {
+		pp->pp_writewait = false;
+		cv_signal(pp->pp_writecv, pp->pp_lock);
+	}
+}
+
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	unsigned i;
+
+	for (i=0; i<PIPE_NPAGES; i++) {
+		kfree(pp->pp_pages[i]);
+	}
+	pollq_cleanup(&pp->pp_writeq);
+	pollq_cleanup(&pp->pp_readq);
+	if (pp->pp_writecv != NULL) {
+		cv_destroy(pp->pp_writecv);
+	}
+	if (pp->pp_readcv != NULL) {
+		cv_destroy(pp->pp_readcv);
+	}
+	if (pp->pp_lock != NULL) {
+		lock_destroy(pp->pp_lock);
+	}
+	if (pp->pp_writelock != NULL) {
+		lock_destroy(pp->pp_writelock);
+	}
+	if (pp->pp_readlock != NULL) {
+		lock_destroy(pp->pp_readlock);
+	}
+	kfree(pp);
+}
+
+/*
+ * Make a pipe.
+ */
+int
+pipe_create(struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *pp;
+	unsigned i;
+	int result;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pollq_init(&pp->pp_readq);
+	pollq_init(&pp->pp_writeq);
+	pp->pp_readlock = lock_create("pipe reader");
+	pp->pp_writelock = lock_create("pipe writer");
+	pp->pp_lock = lock_create("pipe");
+	pp->pp_readcv = cv_create("pipe read");
+	pp->pp_writecv = cv_create("pipe write");
+	for (i=0; i<PIPE_NPAGES; i++) {
+		pp->pp_pages[i] = NULL;
+	}
+	if (pp->pp_readlock == NULL || pp->pp_writelock == NULL ||
+	    pp->pp_lock == NULL ||
+	    pp->pp_readcv == NULL || pp->pp_writecv == NULL) {
+		pipe_destroy(pp);
+		return ENOMEM;
+	}
+	pp->pp_rpos = pp->pp_wpos = 0;
+	pp->pp_readwait = pp->pp_writewait = false;
+	pp->pp_readopen = pp->pp_writeopen = true;
+
+	result = vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	KASSERT(result == 0);
+	result = vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+	KASSERT(result == 0);
+
+	*readend = &pp->pp_readvn;
+	*writeend = &pp->pp_writevn;
+	return 0;
+}
+
+/*
+ * Called for open(); since pipes can't be opened by name, this is
+ * never reached.
+ */
+static
+int
+pipe_eachopen(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+/*
+ * Called when an end's refcount reaches zero: that end is closed.
+ * The pipe goes away when both are.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool isread, done;
+
+	spinlock_acquire(&v->vn_countlock);
+	if (v->vn_refcount != 1) {
+		/* consume the reference VOP_DECREF gave us */
+		KASSERT(v->vn_refcount > 1);
+		v->vn_refcount--;
+		spinlock_release(&v->vn_countlock);
+		return EBUSY;
+	}
+	spinlock_release(&v->vn_countlock);
+
+	/* once the end is marked closed, the other end may free V */
+	isread = v == &pp->pp_readvn;
+	vnode_cleanup(v);
+
+	lock_acquire(pp->pp_lock);
+	if (isread) {
+		pp->pp_readopen = false;
+		pipe_wakewriter(pp);
+		pollq_wakeup(&pp->pp_writeq);
+	}
+	else {
+		pp->pp_writeopen = false;
+		pipe_wakereader(pp);
+		pollq_wakeup(&pp->pp_readq);
+	}
+	done = !pp->pp_readopen && !pp->pp_writeopen;
+	lock_release(pp->pp_lock);
+
+	if (done) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Read: wait until there's data (or the write end is closed), then
+ * take as much as is there, up to what was asked for.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	unsigned pos, space;
+	size_t len, resid;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+	if (v != &pp->pp_readvn) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_readlock);
+	lock_acquire(pp->pp_lock);
+
+	while (uio->uio_resid > 0 &&
+	       pp->pp_rpos == pp->pp_wpos && pp->pp_writeopen) {
+		pp->pp_readwait = true;
+		cv_wait(pp->pp_readcv, pp->pp_lock);
+	}
+
+	result = 0;
+	while (uio->uio_resid > 0 && pp->pp_rpos != pp->pp_wpos) {
+		pos = pp->pp_rpos % PIPE_SIZE;
+		len = PAGE_SIZE - pos % PAGE_SIZE;
+		if (len > pp->pp_wpos - pp->pp_rpos) {
+			len = pp->pp_wpos - pp->pp_rpos;
+		}
+
+		/* the bytes from pp_rpos to pp_wpos are ours to read */
+		lock_release(pp->pp_lock);
+		resid = uio->uio_resid;
+		result = uiomove((char *)pp->pp_pages[pos / PAGE_SIZE] +
+				 pos % PAGE_SIZE, len, uio);
+		lock_acquire(pp->pp_lock);
+
+		space = PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos);
+		pp->pp_rpos += resid - uio->uio_resid;
+		if (space < PIPE_BUF &&
+		    space + (resid - uio->uio_resid) >= PIPE_BUF) {
+			pollq_wakeup(&pp->pp_writeq);
+		}
+		if (result) {
+			break;
+		}
+		if (PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos) >= PIPE_WAKEBATCH) {
+			pipe_wakewriter(pp);
+		}
+	}
+
+	/* we're done; don't leave the writer waiting for a full batch */
+	if (pp->pp_wpos - pp->pp_rpos < PIPE_SIZE) {
+		pipe_wakewriter(pp);
+	}
+
+	lock_release(pp->pp_lock);
+	lock_release(pp->pp_readlock);
+	return result;
+}
+
+/*
+ * Write: copy everything in, waiting for space as needed. Fails with
+ * EPIPE if the read end is closed before anything is written; if it
+ * closes partway, the write comes up short.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	unsigned pos;
+	size_t len, resid, start;
+	void **page;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	if (v != &pp->pp_writevn) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_writelock);
+	lock_acquire(pp->pp_lock);
+
+	start = uio->uio_resid;
+	result = 0;
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readopen) {
+			result = EPIPE;
+			break;
+		}
+		if (pp->pp_wpos - pp->pp_rpos == PIPE_SIZE) {
+			/* full; make sure the reader isn't waiting too */
+			pipe_wakereader(pp);
+			pp->pp_writewait = true;
+			cv_wait(pp->pp_writecv, pp->pp_lock);
+			continue;
+		}
+
+		pos = pp->pp_wpos % PIPE_SIZE;
+		len = PAGE_SIZE - pos % PAGE_SIZE;
+		if (len > PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos)) {
+			len = PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos);
+		}
+
+		page = &pp->pp_pages[pos / PAGE_SIZE];
+		if (*page == NULL) {
+			*page = kmalloc(PAGE_SIZE);
+			if (*page == NULL) {
+				result = ENOMEM;
+				break;
+			}
+		}
+
+		/* the bytes from pp_wpos up to the reader are ours to fill */
+		lock_release(pp->pp_lock);
+		resid = uio->uio_resid;
+		result = uiomove((char *)*page + pos % PAGE_SIZE, len, uio);
+		lock_acquire(pp->pp_lock);
+
+		if (pp->pp_wpos == pp->pp_rpos && resid != uio->uio_resid) {
+			pollq_wakeup(&pp->pp_readq);
+		}
+		pp->pp_wpos += resid - uio->uio_resid;
+		if (result) {
+			break;
+		}
+		if (pp->pp_wpos - pp->pp_rpos >= PIPE_WAKEBATCH) {
+			pipe_wakereader(pp);
+		}
+	}
+
+	/* we're done; don't leave the reader waiting for a full batch */
+	if (pp->pp_wpos != pp->pp_rpos) {
+		pipe_wakereader(pp);
+	}
+
+	lock_release(pp->pp_lock);
+	lock_release(pp->pp_writelock);
+
+	if (result && uio->uio_resid < start) {
+		/* report the partial write as a short count */
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Pipes don't do ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+/*
+ * stat: a FIFO, whose size is the amount of data waiting in it.
+ */
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_wpos - pp->pp_rpos;
+	lock_release(pp->pp_lock);
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PAGE_SIZE;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *v)
+{
+	(void)v;
+	return false;
+}
+
+/*
+ * fsync and ftruncate make no sense on a pipe.
+ */
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * poll: the read end is readable when there's data, and hung up once
+ * the write end is closed; the write end is writable when PIPE_BUF
+ * bytes would fit, and in error once the read end is closed.
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct pollset *ps)
+{
+	struct pipe *pp = v->vn_data;
+	int revents;
+
+	(void)events;
+
+	revents = 0;
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_readvn) {
+		pollset_add(ps, &pp->pp_readq);
+		if (pp->pp_wpos != pp->pp_rpos) {
+			revents |= POLLIN | POLLRDNORM;
+		}
+		if (!pp->pp_writeopen) {
+			revents |= POLLHUP;
+		}
+	}
+	else {
+		pollset_add(ps, &pp->pp_writeq);
+		if (!pp->pp_readopen) {
+			revents |= POLLERR;
+		}
+		else if (PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos) >= PIPE_BUF) {
+			revents |= POLLOUT | POLLWRNORM;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	return revents;
+}
+
+/*
+ * Function table for pipe vnodes.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = pipe_poll,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <vnode.h>
+#include <poll.h>
 
 /*
  * Routines that fail.
@@ -262,3 +263,18 @@ vopfail_lookparent_notdir(struct vnode *vn, char *path, struct vnode **result,
 	return ENOTDIR;
 }
 
+////////////////////////////////////////////////////////////
+// poll
+
+/*
+ * Not a failure: for objects where I/O never waits (regular files,
+ * directories), reads and writes are always ready.
+ */
+int
+vopnull_poll(struct vnode *vn, int events, struct pollset *ps)
+{
+	(void)vn;
+	(void)ps;
+	return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+}
+
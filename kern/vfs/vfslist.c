@@ -39,6 +39,7 @@
 #include <lib.h>
 #include <array.h>
 #include <synch.h>
+#include <rcu.h>
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
@@ -85,10 +86,28 @@ struct knowndev {
 /* A placeholder for kd_fs for devices used as swap */
 #define SWAP_FS	((struct fs *)-1)
 
-DECLARRAY(knowndev, static __UNUSED inline);
-DEFARRAY(knowndev, static __UNUSED inline);
+/*
+ * The table of known devices.
+ *
+ * This is looked at on every path lookup that names a device, and
+ * changes only when a device is added, so it is managed with RCU
+ * (see rcu.h): lookups walk it under rcu_read_lock without taking
+ * the big lock, and vfs_doadd replaces it with a new copy and frees
+ * the old one after a grace period. Changes also hold vfs_biglock,
+ * so code holding that can use knowndevs directly.
+ *
+ * Entries are never removed, so a struct knowndev found in the
+ * table stays valid, and its names never change. kd_fs changes on
+ * mount/unmount, under the big lock, so anything that goes on to
+ * use the filesystem of a mountable device must hold that.
+ */
+struct knowndevtab {
+	struct rcu_head kt_rcu;
+	unsigned kt_num;
+	struct knowndev *kt_devs[];
+};
 
-static struct knowndevarray *knowndevs;
+static struct knowndevtab *knowndevs;
 
 /* The big lock for all FS ops. Remove for filesystem assignment. */
 static struct lock *vfs_biglock;
@@ -101,10 +120,11 @@ static unsigned vfs_biglock_depth;
 void
 vfs_bootstrap(void)
 {
-	knowndevs = knowndevarray_create();
+	knowndevs = kmalloc(sizeof(*knowndevs));
 	if (knowndevs==NULL) {
 		panic("vfs: Could not create knowndevs array\n");
 	}
+	knowndevs->kt_num = 0;
 
 	vfs_biglock = lock_create("vfs_biglock");
 	if (vfs_biglock==NULL) {
@@ -177,9 +197,9 @@ vfs_sync(void)
 
 	vfs_biglock_acquire();
 
-	num = knowndevarray_num(knowndevs);
+	num = knowndevs->kt_num;
 	for (i=0; i<num; i++) {
-		dev = knowndevarray_get(knowndevs, i);
+		dev = knowndevs->kt_devs[i];
 		if (dev->kd_fs != NULL && dev->kd_fs != SWAP_FS) {
 			/*result =*/ FSOP_SYNC(dev->kd_fs);
 		}
@@ -190,55 +210,105 @@ vfs_sync(void)
 	return 0;
 }
 
+/*
+ * Hand back the root of the filesystem on a mountable device, or
+ * ENXIO if there isn't one. Takes the big lock so the filesystem
+ * can't be unmounted out from under FSOP_GETROOT.
+ */
+static
+int
+getroot_mountable(struct knowndev *kd, struct vnode **ret)
+{
+	struct fs *fs;
+	int result;
+
+	vfs_biglock_acquire();
+	fs = kd->kd_fs;
+	if (fs == NULL || fs == SWAP_FS) {
+		result = ENXIO;
+	}
+	else {
+		result = FSOP_GETROOT(fs, ret);
+	}
+	vfs_biglock_release();
+	return result;
+}
+
+/*
+ * Hand back the root of the mounted filesystem whose volume name is
+ * DEVNAME. The volume name lives in the filesystem, so unlike device
+ * names this has to be looked at under the big lock.
+ */
+static
+int
+getroot_byvolname(const char *devname, struct vnode **ret)
+{
+	struct knowndevtab *kt;
+	struct knowndev *kd;
+	const char *volname;
+	struct fs *fs;
+	unsigned i;
+	int result = ENODEV;
+
+	vfs_biglock_acquire();
+	/* Changes hold the big lock, so no need for RCU here */
+	kt = knowndevs;
+	for (i=0; i<kt->kt_num; i++) {
+		kd = kt->kt_devs[i];
+		fs = kd->kd_fs;
+		if (fs == NULL || fs == SWAP_FS) {
+			continue;
+		}
+		volname = FSOP_GETVOLNAME(fs);
+		if (volname != NULL && !strcmp(volname, devname)) {
+			result = FSOP_GETROOT(fs, ret);
+			break;
+		}
+	}
+	vfs_biglock_release();
+	return result;
+}
+
 /*
  * Given a device name (lhd0, emu0, somevolname, null, etc.), hand
  * back an appropriate vnode.
+ *
+ * Device names are matched under RCU without the big lock: entries
+ * are never removed and their names never change. So is the root of
+ * a filesystem that's hardwired to its device (like emu0), as that
+ * can't be unmounted. Only a mountable device's filesystem, or a
+ * volume name, needs the big lock.
  */
 int
 vfs_getroot(const char *devname, struct vnode **ret)
 {
+	struct knowndevtab *kt;
 	struct knowndev *kd;
-	unsigned i, num;
-
-	KASSERT(vfs_biglock_do_i_hold());
+	unsigned i;
 
-	num = knowndevarray_num(knowndevs);
-	for (i=0; i<num; i++) {
-		kd = knowndevarray_get(knowndevs, i);
+	rcu_read_lock();
+	kt = rcu_dereference(knowndevs);
+	for (i=0; i<kt->kt_num; i++) {
+		kd = kt->kt_devs[i];
 
 		/*
-		 * If this device has a mounted filesystem, and
-		 * DEVNAME names either the filesystem or the device,
-		 * return the root of the filesystem.
+		 * If DEVNAME names a mountable device, return the
+		 * root of the filesystem mounted on it, or ENXIO if
+		 * there isn't one.
 		 *
-		 * If it has no mounted filesystem, it's mountable,
-		 * and DEVNAME names the device, return ENXIO.
+		 * If it names a device that isn't mountable, return
+		 * the root of the filesystem hardwired to it, if any,
+		 * or else the device itself.
 		 */
-
-		if (kd->kd_fs != NULL && kd->kd_fs != SWAP_FS) {
-			const char *volname;
-			volname = FSOP_GETVOLNAME(kd->kd_fs);
-
-			if (!strcmp(kd->kd_name, devname) ||
-			    (volname!=NULL && !strcmp(volname, devname))) {
-				return FSOP_GETROOT(kd->kd_fs, ret);
+		if (!strcmp(kd->kd_name, devname)) {
+			rcu_read_unlock();
+			if (kd->kd_rawname != NULL) {
+				return getroot_mountable(kd, ret);
 			}
-		}
-		else {
-			if (kd->kd_rawname!=NULL &&
-			    !strcmp(kd->kd_name, devname)) {
-				return ENXIO;
+			if (kd->kd_fs != NULL) {
+				/* FSOP_GETROOT may sleep */
+				return FSOP_GETROOT(kd->kd_fs, ret);
 			}
-		}
-
-		/*
-		 * If DEVNAME names the device, and we get here, it
-		 * must have no fs and not be mountable. In this case,
-		 * we return the device itself.
-		 */
-		if (!strcmp(kd->kd_name, devname)) {
-			KASSERT(kd->kd_fs==NULL);
-			KASSERT(kd->kd_rawname==NULL);
 			KASSERT(kd->kd_device != NULL);
 			VOP_INCREF(kd->kd_vnode);
 			*ret = kd->kd_vnode;
@@ -251,23 +321,19 @@ vfs_getroot(const char *devname, struct vnode **ret)
 		 */
 		if (kd->kd_rawname!=NULL && !strcmp(kd->kd_rawname, devname)) {
 			KASSERT(kd->kd_device != NULL);
+			rcu_read_unlock();
 			VOP_INCREF(kd->kd_vnode);
 			*ret = kd->kd_vnode;
 			return 0;
 		}
-
-		/*
-		 * If none of the above tests matched, we didn't name
-		 * any of the names of this device, so go on to the
-		 * next one.
-		 */
 	}
+	rcu_read_unlock();
 
 	/*
-	 * If we got here, the device specified by devname doesn't exist.
+	 * If we got here, DEVNAME is no device's name; it might be
+	 * the volume name of a mounted filesystem.
 	 */
-
-	return ENODEV;
+	return getroot_byvolname(devname, ret);
 }
 
 /*
@@ -276,29 +342,33 @@ vfs_getroot(const char *devname, struct vnode **ret)
 const char *
 vfs_getdevname(struct fs *fs)
 {
+	struct knowndevtab *kt;
 	struct knowndev *kd;
-	unsigned i, num;
+	const char *name = NULL;
+	unsigned i;
 
 	KASSERT(fs != NULL);
 
-	KASSERT(vfs_biglock_do_i_hold());
-
-	num = knowndevarray_num(knowndevs);
-	for (i=0; i<num; i++) {
-		kd = knowndevarray_get(knowndevs, i);
+	rcu_read_lock();
+	kt = rcu_dereference(knowndevs);
+	for (i=0; i<kt->kt_num; i++) {
+		kd = kt->kt_devs[i];
 
 		if (kd->kd_fs == fs) {
 			/*
 			 * This is not a race condition: as long as the
 			 * guy calling us holds a reference to the fs,
 			 * the fs cannot go away, and the device can't
-			 * go away until the fs goes away.
+			 * go away until the fs goes away. (And
+			 * knowndevs entries never go away.)
 			 */
-			return kd->kd_name;
+			name = kd->kd_name;
+			break;
 		}
 	}
+	rcu_read_unlock();
 
-	return NULL;
+	return name;
 }
 
 /*
@@ -360,9 +430,9 @@ badnames(const char *n1, const char *n2, const char *n3)
 
 	KASSERT(vfs_biglock_do_i_hold());
 
-	num = knowndevarray_num(knowndevs);
+	num = knowndevs->kt_num;
 	for (i=0; i<num; i++) {
-		kd = knowndevarray_get(knowndevs, i);
+		kd = knowndevs->kt_devs[i];
 
 		if (kd->kd_fs != NULL && kd->kd_fs != SWAP_FS) {
 			volname = FSOP_GETVOLNAME(kd->kd_fs);
@@ -392,15 +462,13 @@ int
 vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 {
 	char *name=NULL, *rawname=NULL;
+	struct knowndevtab *oldkt, *newkt=NULL;
 	struct knowndev *kd=NULL;
 	struct vnode *vnode=NULL;
 	const char *volname=NULL;
-	unsigned index;
+	unsigned index, i;
 	int result;
 
-	/* Silence warning with gcc 4.8 -Og (but not -O2) */
-	index = 0;
-
 	vfs_biglock_acquire();
 
 	name = kstrdup(dname);
@@ -443,10 +511,26 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		goto fail;
 	}
 
-	result = knowndevarray_add(knowndevs, kd, &index);
-	if (result) {
+	/*
+	 * Make a copy of the table with the new device on the end and
+	 * publish it. Readers may still be looking at the old table,
+	 * so free it only after a grace period.
+	 */
+	oldkt = knowndevs;
+	index = oldkt->kt_num;
+	newkt = kmalloc(sizeof(*newkt) +
+			(index + 1) * sizeof(newkt->kt_devs[0]));
+	if (newkt==NULL) {
+		result = ENOMEM;
 		goto fail;
 	}
+	for (i=0; i<index; i++) {
+		newkt->kt_devs[i] = oldkt->kt_devs[i];
+	}
+	newkt->kt_devs[index] = kd;
+	newkt->kt_num = index + 1;
+	rcu_assign_pointer(knowndevs, newkt);
+	call_rcu(&oldkt->kt_rcu, kfree, oldkt);
 
 	if (dev != NULL) {
 		/* use index+1 as the device number, so 0 is reserved */
@@ -499,21 +583,24 @@ vfs_addfs(const char *devname, struct fs *fs)
 
 /*
  * Look for a mountable device named DEVNAME.
- * Should already hold knowndevs_lock.
+ *
+ * This doesn't need the big lock, but callers that are going to
+ * mount or unmount the result should hold it so it doesn't change
+ * state under them.
  */
 static
 int
 findmount(const char *devname, struct knowndev **result)
 {
+	struct knowndevtab *kt;
 	struct knowndev *dev;
-	unsigned i, num;
+	unsigned i;
 	bool found = false;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
-	num = knowndevarray_num(knowndevs);
-	for (i=0; !found && i<num; i++) {
-		dev = knowndevarray_get(knowndevs, i);
+	rcu_read_lock();
+	kt = rcu_dereference(knowndevs);
+	for (i=0; !found && i<kt->kt_num; i++) {
+		dev = kt->kt_devs[i];
 		if (dev->kd_rawname==NULL) {
 			/* not mountable/unmountable */
 			continue;
@@ -524,6 +611,7 @@ findmount(const char *devname, struct knowndev **result)
 			found = true;
 		}
 	}
+	rcu_read_unlock();
 
 	return found ? 0 : ENODEV;
 }
@@ -726,9 +814,9 @@ vfs_unmountall(void)
 
 	vfs_biglock_acquire();
 
-	num = knowndevarray_num(knowndevs);
+	num = knowndevs->kt_num;
 	for (i=0; i<num; i++) {
-		dev = knowndevarray_get(knowndevs, i);
+		dev = knowndevs->kt_devs[i];
 		if (dev->kd_rawname == NULL) {
 			/* not mountable/unmountable */
 			continue;
@@ -34,8 +34,10 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <synch.h>
+#include <membar.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <execcache.h>
 
 /*
  * Initialize an abstract vnode.
@@ -52,6 +54,8 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	spinlock_init(&vn->vn_countlock);
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+	vn->vn_execcached = false;
+	vn->vn_writegen = 0;
 	return 0;
 }
 
@@ -63,6 +67,10 @@ vnode_cleanup(struct vnode *vn)
 {
 	KASSERT(vn->vn_refcount == 1);
 
+	if (vn->vn_execcached) {
+		execcache_invalidate(vn);
+	}
+
 	spinlock_cleanup(&vn->vn_countlock);
 
 	vn->vn_ops = NULL;
@@ -122,6 +130,49 @@ vnode_decref(struct vnode *vn)
 	}
 }
 
+/*
+ * Write to a file.
+ * Called by VOP_WRITE.
+ *
+ * The exec image cache is checked after the write rather than
+ * before, and only after bumping vn_writegen: an exec that read the
+ * file concurrently either sees the new count when it goes to insert
+ * its half-old, half-new copy, and drops it, or has inserted it and
+ * set vn_execcached by the time we look. (execcache_insert does the
+ * same two steps in the other order.)
+ */
+int
+vnode_write(struct vnode *vn, struct uio *uio)
+{
+	int result;
+
+	result = __VOP(vn, write)(vn, uio);
+	vn->vn_writegen++;
+	membar_any_any();
+	if (vn->vn_execcached) {
+		execcache_invalidate(vn);
+	}
+	return result;
+}
+
+/*
+ * Truncate a file.
+ * Called by VOP_TRUNCATE.
+ */
+int
+vnode_truncate(struct vnode *vn, off_t len)
+{
+	int result;
+
+	result = __VOP(vn, truncate)(vn, len);
+	vn->vn_writegen++;
+	membar_any_any();
+	if (vn->vn_execcached) {
+		execcache_invalidate(vn);
+	}
+	return result;
+}
+
 /*
  * Check for various things being valid.
  * Called before all VOP_* calls.
@@ -102,7 +102,9 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 }
 
 /* as_destroy
- * destroys the addrspace
+ * destroys the addrspace. This is done synchronously, so that when
+ * exec returns the old image's frames are back on the free list.
+ * (proc_exit leaves it to the workqueue instead.)
  */
     void
 as_destroy(struct addrspace *as)
@@ -139,7 +141,10 @@ as_activate(void)
     }
 
     /* Disable interrupts and flush TLB */
+    int spl = splhigh();
     flush_tlb();
+    curcpu->c_tlbas = as;
+    splx(spl);
 }
 
 /* as_deactivate
@@ -157,7 +162,10 @@ as_deactivate(void)
         return;
     }
 
+    int spl = splhigh();
     flush_tlb();
+    curcpu->c_tlbas = NULL;
+    splx(spl);
 }
 
 /*
@@ -224,6 +232,16 @@ as_complete_load(struct addrspace *as)
     return 0;
 }
 
+/* as_share_page
+ * map a page-aligned kernel page read-only at vaddr instead of loading a
+ * private copy of it; the frame is refcounted, so it stays around until
+ * the last address space mapping it goes away */
+    int
+as_share_page(struct addrspace *as, vaddr_t vaddr, vaddr_t kpage)
+{
+    return share_hpt(as, vaddr & PAGE_FRAME, kpage);
+}
+
 /* as_define_stack
  * define the stack region within the addr space */
     int
@@ -263,7 +281,7 @@ append_region(struct addrspace *as, int permissions, vaddr_t start, size_t size)
 
     /* append the new region to where it fits in the region list */
     t_region = c_region = as->regions;
-    if (c_region) {
+    if (c_region && c_region->start < n_region->start) {
         while(c_region && c_region->start < n_region->start){
             t_region = c_region;
             c_region = c_region->next;
@@ -271,6 +289,8 @@ append_region(struct addrspace *as, int permissions, vaddr_t start, size_t size)
         t_region->next = n_region;
         n_region->next = c_region;
     } else {
+        /* empty list, or the new region goes first */
+        n_region->next = c_region;
         as->regions = n_region;
     }
 
@@ -88,9 +88,9 @@
 
 /*
  * Recovery function. If a fatal fault occurs during copyin, copyout,
- * copyinstr, or copyoutstr, execution resumes here. (This behavior is
- * caused by setting t_machdep.tm_badfaultfunc and is implemented in
- * machine-dependent code.)
+ * copyinstr, copyoutstr, copyinv, or copyoutv, execution resumes
+ * here. (This behavior is caused by setting t_machdep.tm_badfaultfunc
+ * and is implemented in machine-dependent code.)
  *
  * We use the C standard function longjmp() to teleport up the call
  * stack to where setjmp() was called. At that point we return EFAULT.
@@ -214,6 +214,91 @@ copyout(const void *src, userptr_t userdest, size_t len)
         return 0;
 }
 
+/*
+ * Common code for copyinv and copyoutv.
+ *
+ * Checks every segment before touching any of them, so a bad address
+ * anywhere in the list fails the whole call with nothing copied. Then
+ * arms the fault handler once for all of them; a fault partway
+ * through returns EFAULT with the earlier segments already copied.
+ */
+static
+int
+copyvec(const struct copyseg *segs, unsigned nsegs, bool in)
+{
+        unsigned i;
+        int result;
+        size_t stoplen;
+
+        for (i=0; i<nsegs; i++) {
+                result = copycheck(segs[i].cs_uaddr, segs[i].cs_len,
+                                   &stoplen);
+                if (result) {
+                        return result;
+                }
+                if (stoplen != segs[i].cs_len) {
+                        return EFAULT;
+                }
+        }
+
+        curthread->t_machdep.tm_badfaultfunc = copyfail;
+
+        result = setjmp(curthread->t_machdep.tm_copyjmp);
+        if (result) {
+                curthread->t_machdep.tm_badfaultfunc = NULL;
+                return EFAULT;
+        }
+
+        for (i=0; i<nsegs; i++) {
+                if (in) {
+                        memcpy(segs[i].cs_kaddr,
+                               (const void *)segs[i].cs_uaddr,
+                               segs[i].cs_len);
+                }
+                else {
+                        memcpy((void *)segs[i].cs_uaddr,
+                               segs[i].cs_kaddr, segs[i].cs_len);
+                }
+        }
+
+        curthread->t_machdep.tm_badfaultfunc = NULL;
+        return 0;
+}
+
+/*
+ * copyinv
+ *
+ * Copy each of NSEGS segments from user space into the kernel, as
+ * per copyvec above. For fetching several small values (offsets,
+ * pointers, structures) in one go without setting up the fault
+ * handler for each one.
+ */
+int
+copyinv(const struct copyseg *segs, unsigned nsegs)
+{
+        return copyvec(segs, nsegs, true);
+}
+
+/*
+ * copyoutv
+ *
+ * Copy each of NSEGS segments from the kernel out to user space, as
+ * per copyvec above.
+ */
+int
+copyoutv(const struct copyseg *segs, unsigned nsegs)
+{
+        return copyvec(segs, nsegs, false);
+}
+
+/*
+ * Nonzero if any byte of the 32-bit word W is zero. Subtracting 1
+ * from each byte only borrows into the high bit of a byte that was
+ * zero (or already had the high bit set, which ~W masks off). Works
+ * the same for either byte order.
+ */
+#define WORD_HASZERO(w) (((w) - 0x01010101U) & ~(w) & 0x80808080U)
+
 /*
  * Common string copying function that behaves the way that's desired
  * for copyinstr and copyoutstr.
@@ -229,21 +314,55 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not
  * ENAMETOOLONG.
+ *
+ * Once SRC is word-aligned, this moves a word at a time until it
+ * finds a word with a zero byte in it, then finishes byte by byte.
+ * Aligned words never straddle a page, and we only read whole words
+ * that lie below both limits, so this touches no user page the byte
+ * loop wouldn't have; a fault happens at the same place either way.
  */
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
         size_t *gotlen)
 {
-        size_t i;
+        size_t i, limit;
+        uint32_t w;
+        bool dalign;
+
+        limit = maxlen < stoplen ? maxlen : stoplen;
+        i = 0;
 
-        for (i=0; i<maxlen && i<stoplen; i++) {
+        /* Bytes up to the first word boundary in SRC. */
+        while (i < limit && ((vaddr_t)(src + i) & (sizeof(w) - 1)) != 0) {
                 dest[i] = src[i];
                 if (src[i] == 0) {
-                        if (gotlen != NULL) {
-                                *gotlen = i+1;
-                        }
-                        return 0;
+                        goto found;
+                }
+                i++;
+        }
+
+        /* Whole words, until one has the terminator in it. */
+        dalign = ((vaddr_t)(dest + i) & (sizeof(w) - 1)) == 0;
+        while (i + sizeof(w) <= limit) {
+                w = *(const uint32_t *)(src + i);
+                if (WORD_HASZERO(w)) {
+                        break;
+                }
+                if (dalign) {
+                        *(uint32_t *)(dest + i) = w;
+                }
+                else {
+                        memcpy(dest + i, &w, sizeof(w));
+                }
+                i += sizeof(w);
+        }
+
+        /* The last word, or the tail short of a word. */
+        for (; i < limit; i++) {
+                dest[i] = src[i];
+                if (src[i] == 0) {
+                        goto found;
                 }
         }
         if (stoplen < maxlen) {
@@ -252,6 +371,12 @@ copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
         }
         /* otherwise just ran out of space */
         return ENAMETOOLONG;
+
+ found:
+        if (gotlen != NULL) {
+                *gotlen = i+1;
+        }
+        return 0;
 }
 
 /*
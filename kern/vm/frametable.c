@@ -5,12 +5,13 @@
 #include <addrspace.h>
 #include <vm.h>
 #include <spl.h>
+#include <execcache.h>
 
 
 #define ROUND_UP(N) ((((N) + (PAGE_SIZE) - 1) / (PAGE_SIZE)) * (PAGE_SIZE))
 static vaddr_t pop_frame(void);
 static void push_frame(vaddr_t vaddr);
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock = SPINLOCK_QUEUED_INITIALIZER;
 
         void
 frametable_init()
@@ -100,10 +101,18 @@ alloc_kpages(unsigned int npages)
                         return 0;
                 }
                 spinlock_acquire(&stealmem_lock);
-                /* ensure we have enough memory to alloc */
+                /* ensure we have enough memory to alloc; if not, make
+                 * the exec cache give its pages back and try once more */
                 if (cur_free == VM_INVALID_INDEX) {
                         spinlock_release(&stealmem_lock);
-                        return 0;
+                        if (!execcache_reclaim()) {
+                                return 0;
+                        }
+                        spinlock_acquire(&stealmem_lock);
+                        if (cur_free == VM_INVALID_INDEX) {
+                                spinlock_release(&stealmem_lock);
+                                return 0;
+                        }
                 }
                 /* pop the next free frame */         
                 vaddr_t addr = pop_frame();
@@ -134,7 +143,7 @@ pop_frame(void)
         ft[c_index].fe_next = VM_INVALID_INDEX;
 
         vaddr_t addr = FINDEX_TO_KVADDR(c_index);       /* find the kvaddr */
-        bzero((void *)addr, PAGE_SIZE);                 /* zero the frame */
+        page_zero(addr);                                /* zero the frame */
         
         return addr;
 }
@@ -162,6 +171,19 @@ push_frame(vaddr_t vaddr)
         }
 }
 
+/* frame_incref()
+ * take another reference to a frame, e.g. when mapping it into a second
+ * address space. free_kpages drops a reference.
+ */
+        void
+frame_incref(vaddr_t vaddr)
+{
+        spinlock_acquire(&stealmem_lock);
+        KASSERT(ft[KVADDR_TO_FINDEX(vaddr)].fe_refcount > 0);
+        ft[KVADDR_TO_FINDEX(vaddr)].fe_refcount++;
+        spinlock_release(&stealmem_lock);
+}
+
         void
 free_kpages(vaddr_t addr)
 {
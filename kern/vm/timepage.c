@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * The time page.
+ *
+ * One page, allocated at boot, holding the time of day and the tick
+ * count, which every user address space maps read-only (see
+ * <kern/timepage.h>). Only the boot CPU's hardclock writes it, so
+ * the sequence count is all the synchronization it needs: readers in
+ * userland retry if they see it odd or see it change.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <membar.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <timepage.h>
+#include "opt-dumbvm.h"
+
+static struct timepage *timepage;
+
+void
+timepage_bootstrap(void)
+{
+	struct timepage *tp;
+
+	tp = (struct timepage *)alloc_kpages(1);
+	if (tp == NULL) {
+		panic("timepage_bootstrap: Out of memory\n");
+	}
+	page_zero((vaddr_t)tp);
+	tp->tp_hz = HZ;
+
+	/* hardclock fills it in from its next tick on */
+	membar_store_store();
+	timepage = tp;
+}
+
+/*
+ * Refresh the page. Called from hardclock on the boot CPU.
+ */
+void
+timepage_update(void)
+{
+	struct timepage *tp = timepage;
+	struct timespec ts;
+
+	if (tp == NULL) {
+		/* not set up yet */
+		return;
+	}
+
+	gettime(&ts);
+
+	tp->tp_seq++;
+	membar_store_store();
+	tp->tp_ticks++;
+	tp->tp_sec = ts.tv_sec;
+	tp->tp_nsec = ts.tv_nsec;
+	membar_store_store();
+	tp->tp_seq++;
+}
+
+/*
+ * Map the page at USERTIMEPAGE in AS. The region is read-only, so
+ * the shared frame can never be written from userland.
+ */
+int
+timepage_map(struct addrspace *as, vaddr_t *uaddr)
+{
+#if OPT_DUMBVM
+	(void)as;
+	*uaddr = 0;
+	return 0;
+#else
+	int result;
+
+	*uaddr = 0;
+	if (timepage == NULL) {
+		return 0;
+	}
+	result = as_define_region(as, USERTIMEPAGE, PAGE_SIZE, 4, 0, 0);
+	if (result) {
+		return result;
+	}
+	result = as_share_page(as, USERTIMEPAGE, (vaddr_t)timepage);
+	if (result) {
+		return result;
+	}
+	*uaddr = USERTIMEPAGE;
+	return 0;
+#endif
+}
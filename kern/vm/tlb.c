@@ -5,6 +5,10 @@
 #include <tlb.h>
 #include <vm.h>
 #include <spl.h>
+#include <membar.h>
+#include <cpu.h>
+#include <current.h>
+#include <addrspace.h>
 
 /* insert a record into the tlb */
 /* insert_tlb
@@ -45,3 +49,73 @@ void replace_tlb(int vaddr, int ppn)
         /* replace the ppn with something else */
         tlb_write(vaddr, ppn, index);
 }
+
+/* invalidate_tlb
+ * drops the entry for vaddr from this cpu's tlb, if there is one
+ */
+void invalidate_tlb(vaddr_t vaddr)
+{
+        int index, spl;
+
+        spl = splhigh();
+        index = tlb_probe(vaddr & PAGE_FRAME, 0);
+        if (index >= 0) {
+                tlb_write(TLBHI_INVALID(index), TLBLO_INVALID(), index);
+        }
+        splx(spl);
+}
+
+/* shootdown_tlb
+ * invalidates npages pages of as (or all of as if npages is 0) in the
+ * tlb of every cpu that may have them mapped, and waits until that's
+ * done. The page table must already have been updated. Only cpus whose
+ * c_tlbas is as need telling, since as_activate flushes the whole tlb.
+ * Big requests are sent as whole-tlb flushes.
+ *
+ * Safe at any spl, including from a fault taken with interrupts off;
+ * see ipi_tlbshootdown_wait.
+ */
+void shootdown_tlb(struct addrspace *as, const vaddr_t *pages, unsigned npages)
+{
+        struct tlbshootdown ts;
+        struct cpu *c;
+        unsigned i, tickets[32];
+        uint32_t sent;
+
+        KASSERT(as != NULL);
+
+        ts.ts_as = as;
+        ts.ts_npages = npages <= TLBSHOOTDOWN_BATCH ? npages : 0;
+        for (i = 0; i < ts.ts_npages; i++) {
+                ts.ts_pages[i] = pages[i];
+        }
+
+        /* our own tlb first */
+        vm_tlbshootdown(&ts);
+
+        /* make the page table changes visible before looking at c_tlbas */
+        membar_any_any();
+
+        sent = 0;
+        for (i = 0; (c = cpu_get(i)) != NULL; i++) {
+                if (c == curcpu->c_self || c->c_tlbas != as) {
+                        continue;
+                }
+                if (i < 32) {
+                        tickets[i] = ipi_tlbshootdown(c, &ts);
+                        sent |= (uint32_t)1 << i;
+                }
+                else {
+                        /* no room to remember the ticket; wait now */
+                        ipi_tlbshootdown_wait(c, ipi_tlbshootdown(c, &ts));
+                }
+        }
+
+        /* wait for the acknowledgements */
+        for (i = 0; sent != 0; i++) {
+                if (sent & ((uint32_t)1 << i)) {
+                        ipi_tlbshootdown_wait(cpu_get(i), tickets[i]);
+                        sent &= ~((uint32_t)1 << i);
+                }
+        }
+}
@@ -9,6 +9,7 @@
 #include <mips/tlb.h>
 #include <proc.h>
 #include <current.h>
+#include <cpu.h>
 
 /* define static methods */
 static uint32_t hpt_hash(struct addrspace *as, vaddr_t faultaddr);
@@ -57,6 +58,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     struct page_entry *pe;
     struct addrspace *as;
 
+    cpustat_inc(CS_VMFAULTS);
+
     as = proc_getas();
     /* sanity check */
     if (!curproc || !hpt || !as) {
@@ -95,6 +98,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
                     goto do_cow;
         
                 /* region is writable and page is writeable - fix TLB */
+                curproc->p_ru.pr_tlbrefills++;
                 ppn = (uint32_t) PN_TO_ADDR(pe->pe_ppn) | TLBLO_DIRTY;
                 replace_tlb(faultaddress, ppn);
                 return 0;
@@ -106,12 +110,19 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 do_cow:
         spl = splhigh();
         if (pe) {
-            struct frame_entry fe = ft[pe->pe_ppn]; /* get the frame entry */
-            if (fe.fe_refcount > 1) {
-                fe.fe_refcount--;
+            curproc->p_ru.pr_cowflt++;
+            if (ft[pe->pe_ppn].fe_refcount > 1) {
+                cpustat_inc(CS_COWCOPIES);
+                vaddr_t old_frame = FINDEX_TO_KVADDR(pe->pe_ppn);
                 vaddr_t new_frame = alloc_kpages(1);
-                memcpy((void *)new_frame, (void *)FINDEX_TO_KVADDR(pe->pe_ppn), PAGE_SIZE);
+                if (new_frame == 0) {
+                    splx(spl);
+                    return ENOMEM;
+                }
+                page_copy(new_frame, old_frame);
                 pe->pe_ppn = KVADDR_TO_FINDEX(new_frame);
+                /* drop our reference to the shared frame */
+                free_kpages(old_frame);
             }
             /* if refcount is 1, then the other process in the fork has
              * already done their deed and copied the frame so we can just
@@ -121,11 +132,13 @@ do_cow:
             panic("COW but we don't have a page entry??");
         }
         splx(spl);
-        flush_tlb();
+        /* only this page changed; drop the stale read-only mapping */
+        shootdown_tlb(as, &faultaddress, 1);
         goto fill_tlb;
 
 normal_handle:
         if (pe) { // && GET_PAGE_PRES(pe->pe_flags)) { /* if in frame table */
+            curproc->p_ru.pr_tlbrefills++;
                 //   pte->flag has pt_r?   |
                 //      return EFAULT;     |
                 //   else
@@ -140,6 +153,8 @@ normal_handle:
                 //return -1;
                 //    } else {
                 /* create and insert the page entry */
+            cpustat_inc(CS_ZEROFILLS);
+            curproc->p_ru.pr_minflt++;
             spl = splhigh();
             vaddr_t n_frame = alloc_kpages(1);
             pe = insert_hpt(as, faultaddress, n_frame);
@@ -228,7 +243,9 @@ page_entry * search_hpt(struct addrspace *as, vaddr_t addr)
 /*
  * purge_hpt
  * purges all records in the hpt and then the records they refer to in the ft
- * for the current addresspace - this is called when the process is ending
+ * for the current addresspace - this is called when the process is ending.
+ * Frames that are shared (after fork, or text pages mapped from the exec
+ * image cache) just lose this addrspace's reference in free_kpages.
  */
         void
 purge_hpt(struct addrspace *as)
@@ -287,22 +304,115 @@ duplicate_hpt(struct addrspace *new, struct addrspace *old)
                                 pe->pe_flags = SET_PAGE_NOWRITE(pe->pe_flags);
                                 
                                 /* increment refcount on frame */
-                                ft[pe->pe_ppn].fe_refcount++;
+                                frame_incref(old_frame);
                         }
                         pe = n_pe->pe_next;
                 }
         }
     splx(spl);
+
+    /* the parent's writable mappings may still be in some tlb */
+    shootdown_tlb(old, NULL, 0);
+}
+
+/* share_hpt
+ * maps the kernel page kpage (a whole frame, e.g. a page of the exec image
+ * cache) at vaddr in as, taking a reference on the frame. The mapping is
+ * always read-only, whatever the region says, so nobody can write to a
+ * frame other processes see; the region must not be writable either, or
+ * a write fault would try to copy-on-write it.
+ */
+int
+share_hpt(struct addrspace *as, vaddr_t vaddr, vaddr_t kpage)
+{
+        struct page_entry *pe;
+        int spl;
+
+        KASSERT((kpage & ~PAGE_FRAME) == 0);
+
+        spl = splhigh();
+        if (search_hpt(as, vaddr) != NULL) {
+                splx(spl);
+                return EEXIST;
+        }
+        frame_incref(kpage);
+        pe = insert_hpt(as, vaddr, kpage);
+        pe->pe_flags = SET_PAGE_NOWRITE(pe->pe_flags);
+        splx(spl);
+        return 0;
+}
+
+/* release_hpt
+ * removes the pages of as in [start, end) from the hpt and frees their
+ * frames, e.g. when the heap shrinks. The tlbs are shot down in batches
+ * before the frames are freed, so no cpu can still reach a frame that
+ * is handed out again.
+ */
+void
+release_hpt(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+        struct page_entry *batch[TLBSHOOTDOWN_BATCH];
+        vaddr_t pages[TLBSHOOTDOWN_BATCH];
+        struct page_entry **pp, *pe;
+        unsigned i, n;
+        vaddr_t va;
+        int spl;
+
+        va = start & PAGE_FRAME;
+        while (va < end) {
+                /* unlink up to a batch of pages */
+                n = 0;
+                spl = splhigh();
+                for (; va < end && n < TLBSHOOTDOWN_BATCH; va += PAGE_SIZE) {
+                        pp = &hpt[hpt_hash(as, va)];
+                        while (*pp != NULL) {
+                                pe = *pp;
+                                if (pe->pe_proc == (uint32_t) as &&
+                                    pe->pe_vpn == ADDR_TO_PN(va)) {
+                                        *pp = pe->pe_next;
+                                        batch[n] = pe;
+                                        pages[n] = va;
+                                        n++;
+                                        break;
+                                }
+                                pp = &pe->pe_next;
+                        }
+                }
+                splx(spl);
+
+                if (n == 0) {
+                        continue;
+                }
+                shootdown_tlb(as, pages, n);
+                for (i = 0; i < n; i++) {
+                        free_kpages(FINDEX_TO_KVADDR(batch[i]->pe_ppn));
+                        kfree(batch[i]);
+                }
+        }
 }
 
 /*
- *
- * SMP-specific functions.  Unused in our configuration.
+ * SMP-specific functions.
  */
 
+/* vm_tlbshootdown
+ * does a shootdown request on this cpu (called from the ipi handler,
+ * and by shootdown_tlb for the initiating cpu). If this cpu has since
+ * activated some other addrspace its tlb has been flushed already.
+ */
 void vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-        (void)ts;
-        panic("vm tried to do tlb shootdown?!\n");
+        unsigned i;
+
+        if (ts->ts_as != NULL && ts->ts_as != curcpu->c_tlbas) {
+                return;
+        }
+        if (ts->ts_npages == 0) {
+                flush_tlb();
+                return;
+        }
+        for (i = 0; i < ts->ts_npages; i++) {
+                invalidate_tlb(ts->ts_pages[i]);
+        }
 }
 
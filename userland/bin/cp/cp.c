@@ -36,6 +36,11 @@
  */
 
 
+/*
+ * Amount to ask copy_file_range for at a time. It may do less.
+ */
+#define CHUNK (64*1024)
+
 /* Copy one file to another. */
 static
 void
@@ -43,8 +48,7 @@ copy(const char *from, const char *to)
 {
 	int fromfd;
 	int tofd;
-	char buf[1024];
-	int len, wr, wrtot;
+	int len;
 
 	/*
 	 * Open the files, and give up if they won't open
@@ -59,30 +63,22 @@ copy(const char *from, const char *to)
 	}
 
 	/*
-	 * As long as we get more than zero bytes, we haven't hit EOF.
-	 * Zero means EOF. Less than zero means an error occurred.
-	 * We may read less than we asked for, though, in various cases
-	 * for various reasons.
+	 * Let the kernel move the data, using (and advancing) both
+	 * files' seek positions. As long as we get more than zero
+	 * bytes, we haven't hit EOF. Zero means EOF. Less than zero
+	 * means an error occurred. We may copy less than we asked for,
+	 * though, in various cases for various reasons.
 	 */
-	while ((len = read(fromfd, buf, sizeof(buf)))>0) {
-		/*
-		 * Likewise, we may actually write less than we attempted
-		 * to. So loop until we're done.
-		 */
-		wrtot = 0;
-		while (wrtot < len) {
-			wr = write(tofd, buf+wrtot, len-wrtot);
-			if (wr<0) {
-				err(1, "%s", to);
-			}
-			wrtot += wr;
-		}
+	while ((len = copy_file_range(fromfd, NULL, tofd, NULL,
+				      CHUNK, 0)) > 0) {
+		/* nothing */
 	}
 	/*
-	 * If we got a read error, print it and exit.
+	 * If we got an error, print it and exit. We can't tell which
+	 * file it came from.
 	 */
 	if (len<0) {
-		err(1, "%s", from);
+		err(1, "%s to %s", from, to);
 	}
 
 	if (close(fromfd) < 0) {
@@ -131,6 +131,8 @@ int rmdir(const char *dirname);
 pid_t getpid(void);
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
 int fsync(int filehandle);
 int ftruncate(int filehandle, off_t size);
 int remove(const char *filename);
@@ -147,6 +149,7 @@ ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -170,4 +173,23 @@ time_t time(time_t *seconds);			/* calls __time */
 void *mmap(size_t length, int prot, int fd, off_t offset);
 int munmap(void *addr);
 
+/*
+ * OS/161 extension: futexes. futex_wait sleeps only if the word at
+ * ADDR still contains VAL (otherwise it fails with EAGAIN);
+ * futex_wake wakes up to COUNT sleepers and returns how many it
+ * woke. Most code should use the wrappers in <umutex.h> instead.
+ */
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int count);
+
+/*
+ * OS/161 extension (as in Linux): copy LEN bytes from INFD to OUTFD
+ * inside the kernel. A NULL offset pointer means use and update that
+ * file's seek position; otherwise the offset it points to is used and
+ * updated instead. FLAGS must be 0. Returns the number of bytes copied, which
+ * is 0 at end of file.
+ */
+ssize_t copy_file_range(int infd, off_t *inoff, int outfd, off_t *outoff,
+			size_t len, unsigned flags);
+
 #endif /* _UNISTD_H_ */
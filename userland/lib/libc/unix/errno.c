@@ -27,19 +27,23 @@
  * SUCH DAMAGE.
  */
 
+#include <sys/types.h>
 #include <errno.h>
+#include <kern/timepage.h>
 
 /*
  * Source file that declares the space for the global variable errno.
  *
  * We also declare the space for __argv, which is used by the err*
- * functions, and __environ, which is used by getenv(). Since these
- * are set by crt0, they are always referenced in every program;
+ * functions, __environ, which is used by getenv(), and __timepage,
+ * which is used by time(). Since these are set by crt0, they are
+ * always referenced in every program;
  * putting them here prevents gratuitously linking all the err* and
  * warn* functions (and thus printf) into every program.
  */
 
 char **__argv;
 char **__environ;
+const volatile struct timepage *__timepage;
 
 int errno;
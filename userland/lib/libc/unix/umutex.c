@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Userlevel mutexes and condition variables on top of futexes.
+ *
+ * The mutex is the three-state design from Drepper's "Futexes Are
+ * Tricky": 0 is unlocked, 1 is locked with no waiters, and 2 is
+ * locked with (possibly) waiters. Only the 2 state costs a system
+ * call on unlock.
+ *
+ * The condition variable is a sequence number. A waiter samples it
+ * before dropping the mutex and sleeps only if no signal has bumped
+ * it since, so wakeups between the unlock and the sleep are not lost.
+ */
+
+#include <unistd.h>
+#include <umutex.h>
+
+/* futex_wake count meaning "everyone" */
+#define WAKE_ALL 0x7fffffff
+
+/*
+ * Atomic operations, using LL/SC. See the kernel's
+ * arch/mips/include/spinlock.h for an explanation of LL and SC.
+ */
+
+/* If *p == old, set it to new. Returns the previous value of *p. */
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   if (prev != old) goto 2 */
+		" move %1, %4;"		/*   tmp = new (delay slot) */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   if (!tmp) retry */
+		" nop;"			/*   (delay slot) */
+		"2: .set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/* Set *p to val. Returns the previous value of *p. */
+static
+int
+atomic_swap(volatile int *p, int val)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set noreorder;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"move %1, %3;"		/*   tmp = val */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   if (!tmp) retry */
+		" nop;"
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (val)
+		: "memory");
+	return prev;
+}
+
+/* Add one to *p. */
+static
+void
+atomic_inc(volatile int *p)
+{
+	int tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set noreorder;"
+		"1: ll %0, 0(%1);"	/*   tmp = *p */
+		"addiu %0, %0, 1;"	/*   tmp++ */
+		"sc %0, 0(%1);"		/*   *p = tmp; tmp = success? */
+		"beqz %0, 1b;"		/*   if (!tmp) retry */
+		" nop;"
+		".set pop"
+		: "=&r" (tmp)
+		: "r" (p)
+		: "memory");
+}
+
+////////////////////////////////////////////////////////////
+// mutex
+
+void
+umutex_init(struct umutex *m)
+{
+	m->um_state = 0;
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	return atomic_cas(&m->um_state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	int c;
+
+	c = atomic_cas(&m->um_state, 0, 1);
+	if (c == 0) {
+		/* fast path: it was free */
+		return;
+	}
+
+	/*
+	 * Contended. Mark the mutex as having waiters and sleep
+	 * until it's released. Once we've slept we can't tell if
+	 * anyone else is waiting, so always take it in state 2.
+	 */
+	if (c != 2) {
+		c = atomic_swap(&m->um_state, 2);
+	}
+	while (c != 0) {
+		futex_wait(&m->um_state, 2);
+		c = atomic_swap(&m->um_state, 2);
+	}
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	if (atomic_swap(&m->um_state, 0) == 2) {
+		futex_wake(&m->um_state, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// condition variable
+
+void
+ucond_init(struct ucond *c)
+{
+	c->uc_seq = 0;
+}
+
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+	int seq;
+
+	seq = c->uc_seq;
+	umutex_unlock(m);
+
+	/* EAGAIN here just means we were signalled already */
+	futex_wait(&c->uc_seq, seq);
+
+	/*
+	 * Reacquire in state 2: other threads woken by a broadcast
+	 * may be piling up on the mutex behind us.
+	 */
+	while (atomic_swap(&m->um_state, 2) != 0) {
+		futex_wait(&m->um_state, 2);
+	}
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+	atomic_inc(&c->uc_seq);
+	futex_wake(&c->uc_seq, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+	atomic_inc(&c->uc_seq);
+	futex_wake(&c->uc_seq, WAKE_ALL);
+}
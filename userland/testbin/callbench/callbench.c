@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * callbench - check multicall() and measure what batching system
+ * calls saves.
+ *
+ * Usage: callbench [-n calls]
+ *
+ * First checks that multicall stops at the first failure and refuses
+ * calls it can't batch. Then makes the given number of calls
+ * (default 4096) of getpid and of 1-byte writes to null: one at a
+ * time and in batches of increasing size, and reports the cost per
+ * call.
+ */
+
+#include <sys/types.h>
+#include <sys/multicall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_CALLS	4096
+
+static struct mcall calls[MULTICALL_MAX];
+static char byte = 'x';
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: callbench [-n calls]");
+}
+
+static
+unsigned long
+now_us(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000000UL + ns / 1000;
+}
+
+static
+void
+setcall(struct mcall *mc, int callno, int a0, int a1, int a2)
+{
+	mc->mc_callno = callno;
+	mc->mc_args[0] = a0;
+	mc->mc_args[1] = a1;
+	mc->mc_args[2] = a2;
+	mc->mc_args[3] = 0;
+	mc->mc_retval = -1;
+	mc->mc_err = -1;
+}
+
+/*
+ * Stop-on-error, results, and calls that can't be batched.
+ */
+static
+void
+test_semantics(int nullfd)
+{
+	int r;
+
+	setcall(&calls[0], SYS_getpid, 0, 0, 0);
+	setcall(&calls[1], SYS_write, nullfd, (int)(intptr_t)&byte, 1);
+	setcall(&calls[2], SYS_close, -1, 0, 0);
+	setcall(&calls[3], SYS_getpid, 0, 0, 0);
+	r = multicall(calls, 4);
+	if (r != 2) {
+		errx(1, "multicall: returned %d, expected 2", r);
+	}
+	if (calls[0].mc_err != 0 || calls[0].mc_retval != getpid()) {
+		errx(1, "getpid: wrong result");
+	}
+	if (calls[1].mc_err != 0 || calls[1].mc_retval != 1) {
+		errx(1, "write: wrong result");
+	}
+	if (calls[2].mc_err != EBADF) {
+		errx(1, "close(-1): error %d, expected EBADF",
+		     calls[2].mc_err);
+	}
+	if (calls[3].mc_err != -1) {
+		errx(1, "call after the failure was run");
+	}
+
+	setcall(&calls[0], SYS_fork, 0, 0, 0);
+	if (multicall(calls, 1) != 0 || calls[0].mc_err != EINVAL) {
+		errx(1, "fork in a batch: expected EINVAL");
+	}
+
+	/* takes its whence argument from the stack */
+	setcall(&calls[0], SYS_lseek, nullfd, 0, 0);
+	if (multicall(calls, 1) != 0 || calls[0].mc_err != EINVAL) {
+		errx(1, "lseek in a batch: expected EINVAL");
+	}
+
+	/* not a call at all, so not on the kernel's list either */
+	setcall(&calls[0], 999, 0, 0, 0);
+	if (multicall(calls, 1) != 0 || calls[0].mc_err != EINVAL) {
+		errx(1, "unknown call in a batch: expected EINVAL");
+	}
+
+	if (multicall(calls, MULTICALL_MAX + 1) != -1 || errno != EINVAL) {
+		errx(1, "oversized batch: expected EINVAL");
+	}
+
+	printf("  semantics: ok\n");
+}
+
+/*
+ * Make NCALLS calls like the one in calls[0], BATCH at a time (or
+ * directly, if BATCH is 0). Returns microseconds taken.
+ */
+static
+unsigned long
+run(unsigned ncalls, unsigned batch, int nullfd)
+{
+	unsigned long t;
+	unsigned i;
+
+	for (i = 1; i < MULTICALL_MAX; i++) {
+		calls[i] = calls[0];
+	}
+
+	t = now_us();
+	if (batch == 0) {
+		for (i = 0; i < ncalls; i++) {
+			if (calls[0].mc_callno == SYS_getpid) {
+				getpid();
+			}
+			else if (write(nullfd, &byte, 1) != 1) {
+				err(1, "write");
+			}
+		}
+	}
+	else {
+		for (i = 0; i < ncalls; i += batch) {
+			if (multicall(calls, batch) != (int)batch) {
+				err(1, "multicall");
+			}
+		}
+	}
+	return now_us() - t;
+}
+
+static
+void
+bench(const char *what, unsigned ncalls, int nullfd)
+{
+	static const unsigned batches[] = { 0, 1, 2, 4, 8, 16, 32, 64 };
+	unsigned long us;
+	unsigned i;
+
+	printf("  %s:\n", what);
+	for (i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+		us = run(ncalls, batches[i], nullfd);
+		if (batches[i] == 0) {
+			printf("    %-12s", "direct");
+		}
+		else {
+			printf("    batch of %-3u", batches[i]);
+		}
+		printf(" %8lu us  %6lu ns/call\n", us,
+		       us * 1000UL / ncalls);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned ncalls = DEFAULT_CALLS;
+	int nullfd;
+
+	if (argc == 3 && !strcmp(argv[1], "-n")) {
+		ncalls = atoi(argv[2]);
+	}
+	else if (argc != 1) {
+		usage();
+	}
+	/* a whole number of the largest batch */
+	ncalls -= ncalls % MULTICALL_MAX;
+	if (ncalls == 0) {
+		usage();
+	}
+
+	nullfd = open("null:", O_WRONLY);
+	if (nullfd < 0) {
+		err(1, "null:");
+	}
+
+	printf("callbench: %u calls\n", ncalls);
+	test_semantics(nullfd);
+
+	setcall(&calls[0], SYS_getpid, 0, 0, 0);
+	bench("getpid", ncalls, nullfd);
+
+	setcall(&calls[0], SYS_write, nullfd, (int)(intptr_t)&byte, 1);
+	bench("1-byte write to null:", ncalls, nullfd);
+
+	close(nullfd);
+	return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * copybench - compare file copy throughput through user space
+ * (read + write, as cp used to do) with copy_file_range.
+ *
+ * Usage: copybench [-k kilobytes] [directory]
+ *
+ * Makes a test file of the given size (default 512K) in DIRECTORY
+ * (default the current directory) and copies it three ways, checking
+ * each copy. Run it once on an SFS volume (e.g. "copybench lhd1:")
+ * and once on emufs to compare the two.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_KB	512
+#define BUFSIZE		4096
+
+static char srcname[256], dstname[256];
+static char buf[BUFSIZE], buf2[BUFSIZE];
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: copybench [-k kilobytes] [directory]");
+}
+
+static
+void
+mkname(char *name, size_t max, const char *dir, const char *file)
+{
+	size_t len;
+
+	len = strlen(dir);
+	if (len == 0 || dir[len-1] == '/' || dir[len-1] == ':') {
+		snprintf(name, max, "%s%s", dir, file);
+	}
+	else {
+		snprintf(name, max, "%s/%s", dir, file);
+	}
+}
+
+static
+unsigned long
+now_us(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000000UL + ns / 1000;
+}
+
+static
+void
+makesrc(unsigned kb)
+{
+	unsigned i, j;
+	int fd;
+
+	fd = open(srcname, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", srcname);
+	}
+	for (i = 0; i < kb / 4; i++) {
+		for (j = 0; j < BUFSIZE; j++) {
+			buf[j] = (char)(i * 7 + j);
+		}
+		if (write(fd, buf, BUFSIZE) != BUFSIZE) {
+			err(1, "%s: write", srcname);
+		}
+	}
+	close(fd);
+}
+
+static
+void
+check(void)
+{
+	int a, b;
+	ssize_t ra, rb;
+
+	a = open(srcname, O_RDONLY);
+	b = open(dstname, O_RDONLY);
+	if (a < 0 || b < 0) {
+		err(1, "check: open");
+	}
+	do {
+		ra = read(a, buf, BUFSIZE);
+		rb = read(b, buf2, BUFSIZE);
+		if (ra != rb || ra < 0 || memcmp(buf, buf2, ra) != 0) {
+			errx(1, "%s differs from %s", dstname, srcname);
+		}
+	} while (ra > 0);
+	close(a);
+	close(b);
+}
+
+/*
+ * Copy with read and write through a user buffer of BUFLEN bytes.
+ */
+static
+void
+copy_rw(size_t buflen)
+{
+	int from, to;
+	ssize_t len, wr, wrtot;
+
+	from = open(srcname, O_RDONLY);
+	to = open(dstname, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (from < 0 || to < 0) {
+		err(1, "copy_rw: open");
+	}
+	while ((len = read(from, buf, buflen)) > 0) {
+		wrtot = 0;
+		while (wrtot < len) {
+			wr = write(to, buf + wrtot, len - wrtot);
+			if (wr < 0) {
+				err(1, "%s: write", dstname);
+			}
+			wrtot += wr;
+		}
+	}
+	if (len < 0) {
+		err(1, "%s: read", srcname);
+	}
+	close(from);
+	close(to);
+}
+
+/*
+ * Copy with copy_file_range.
+ */
+static
+void
+copy_cfr(void)
+{
+	int from, to;
+	ssize_t len;
+
+	from = open(srcname, O_RDONLY);
+	to = open(dstname, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (from < 0 || to < 0) {
+		err(1, "copy_cfr: open");
+	}
+	while ((len = copy_file_range(from, NULL, to, NULL,
+				      64 * 1024, 0)) > 0) {
+		/* nothing */
+	}
+	if (len < 0) {
+		err(1, "copy_file_range");
+	}
+	close(from);
+	close(to);
+}
+
+static
+void
+report(const char *what, unsigned kb, unsigned long us)
+{
+	if (us == 0) {
+		us = 1;
+	}
+	printf("  %-24s %8lu us  %6lu KB/s\n", what, us,
+	       (unsigned long)kb * 1000000UL / us);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *dir = ".";
+	unsigned kb = DEFAULT_KB;
+	unsigned long t;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+			kb = atoi(argv[++i]);
+		}
+		else if (argv[i][0] == '-' || i != argc - 1) {
+			usage();
+		}
+		else {
+			dir = argv[i];
+		}
+	}
+	if (kb < 4) {
+		usage();
+	}
+	kb -= kb % 4;
+
+	mkname(srcname, sizeof(srcname), dir, "copybench.src");
+	mkname(dstname, sizeof(dstname), dir, "copybench.dst");
+	makesrc(kb);
+
+	printf("copybench: %uK in %s\n", kb, dir);
+
+	t = now_us();
+	copy_rw(1024);
+	report("read/write, 1K buffer", kb, now_us() - t);
+	check();
+
+	t = now_us();
+	copy_rw(BUFSIZE);
+	report("read/write, 4K buffer", kb, now_us() - t);
+	check();
+
+	t = now_us();
+	copy_cfr();
+	report("copy_file_range", kb, now_us() - t);
+	check();
+
+	remove(srcname);
+	remove(dstname);
+	return 0;
+}
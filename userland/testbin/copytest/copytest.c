@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * copytest - check the kernel's user string and value copying at
+ * the edges of user memory, and time the system calls that use it.
+ *
+ * Usage: copytest [-n calls]
+ *
+ * Passes path strings to open() that end at, or run off, the end of
+ * a mapped page and the top of user space, at every alignment and
+ * with the terminator at every byte of a word, and checks that each
+ * one is copied in or fails with EFAULT or ENAMETOOLONG as it should.
+ * Does the same for __time's two result pointers. Then times the
+ * given number of calls (default 20000) with short and long paths.
+ *
+ * This assumes 4K pages and that user space ends at 0x80000000, as
+ * on MIPS.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <kern/timepage.h>
+
+#define DEFAULT_CALLS	20000
+#define PAGE_SIZE	4096
+#define USERSPACETOP	0x80000000UL
+
+/* Longest unterminated run to try against the end of a page. */
+#define MAXRUN		24
+
+/* Set by crt0. */
+extern const volatile struct timepage *__timepage;
+
+/* A page with nothing mapped after it. */
+static char *lastpage;
+
+static char longpath[PATH_MAX];
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: copytest [-n calls]");
+}
+
+static
+unsigned long
+now_us(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000000UL + ns / 1000;
+}
+
+/*
+ * Grow the heap to a page boundary and then by one more page, which
+ * leaves that page the last thing mapped below the break.
+ */
+static
+void
+setup_lastpage(void)
+{
+	char *p;
+	size_t pad;
+
+	p = sbrk(0);
+	pad = (PAGE_SIZE - ((unsigned long)p % PAGE_SIZE)) % PAGE_SIZE;
+	if (sbrk(pad + PAGE_SIZE) == (void *)-1) {
+		err(1, "sbrk");
+	}
+	lastpage = p + pad;
+}
+
+/*
+ * Fill LEN bytes at P with a path that doesn't exist ("x/x/x..."),
+ * optionally ending in a null.
+ */
+static
+void
+fillpath(char *p, size_t len, int terminate)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		p[i] = (i % 2) ? '/' : 'x';
+	}
+	if (terminate && len > 0) {
+		p[len-1] = 0;
+	}
+}
+
+/*
+ * Call open on PATH and check the error: EXPECT if it's nonzero, or
+ * anything but EFAULT and ENAMETOOLONG (i.e., the path was copied in
+ * and looked up) if it's zero.
+ */
+static
+void
+tryopen(const char *path, int expect, const char *what, size_t arg)
+{
+	int fd;
+
+	errno = 0;
+	fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (expect != 0) {
+		if (fd >= 0 || errno != expect) {
+			errx(1, "%s (%zu) at %p: got %s, expected %s",
+			     what, arg, path,
+			     fd >= 0 ? "success" : strerror(errno),
+			     strerror(expect));
+		}
+	}
+	else if (fd < 0 && (errno == EFAULT || errno == ENAMETOOLONG)) {
+		errx(1, "%s (%zu) at %p: %s", what, arg, path,
+		     strerror(errno));
+	}
+}
+
+/*
+ * Strings that end at, or run off, the end of the heap.
+ */
+static
+void
+test_pageend(void)
+{
+	char *end = lastpage + PAGE_SIZE;
+	size_t len, nul, skew;
+	char *p;
+
+	/* Terminated on the last byte, at every alignment. */
+	for (len = 1; len <= MAXRUN; len++) {
+		fillpath(end - len, len, 1);
+		tryopen(end - len, 0, "string ending at page end", len);
+	}
+
+	/* Not terminated: runs into the unmapped page. */
+	for (len = 1; len <= MAXRUN; len++) {
+		fillpath(end - len, len, 0);
+		tryopen(end - len, EFAULT, "string off page end", len);
+	}
+	fillpath(end - (PATH_MAX - 1), PATH_MAX - 1, 0);
+	tryopen(end - (PATH_MAX - 1), EFAULT, "long string off page end",
+		PATH_MAX - 1);
+
+	/*
+	 * Terminator at each byte of the last two words, with more
+	 * nonzero bytes after it, starting at each alignment.
+	 */
+	for (skew = 0; skew < sizeof(int); skew++) {
+		p = end - 4 * sizeof(int) + skew;
+		for (nul = 0; p + nul < end; nul++) {
+			fillpath(p, end - p, 0);
+			p[nul] = 0;
+			tryopen(p, 0, "string with bytes after the null",
+				nul);
+		}
+	}
+
+	printf("  page end: ok\n");
+}
+
+/*
+ * Strings at and past PATH_MAX.
+ */
+static
+void
+test_pathmax(void)
+{
+	char *end = lastpage + PAGE_SIZE;
+
+	fillpath(end - PATH_MAX, PATH_MAX, 1);
+	tryopen(end - PATH_MAX, 0, "PATH_MAX string at page end", PATH_MAX);
+
+	fillpath(end - (PATH_MAX + 1), PATH_MAX + 1, 1);
+	tryopen(end - (PATH_MAX + 1), ENAMETOOLONG,
+		"PATH_MAX+1 string at page end", PATH_MAX + 1);
+
+	/* Too long, and the limit comes before the unmapped page. */
+	fillpath(lastpage, PAGE_SIZE, 0);
+	tryopen(lastpage, ENAMETOOLONG, "unterminated page", PAGE_SIZE);
+
+	printf("  PATH_MAX: ok\n");
+}
+
+/*
+ * Strings that run into the kernel. The top of the stack page holds
+ * the argument strings, which we're done with, but put them back
+ * anyway.
+ */
+static
+void
+test_usertop(void)
+{
+	char *top = (char *)USERSPACETOP;
+	char save[MAXRUN];
+	size_t len;
+
+	memcpy(save, top - MAXRUN, MAXRUN);
+	for (len = 1; len <= MAXRUN; len++) {
+		fillpath(top - len, len, 1);
+		tryopen(top - len, 0, "string ending at user top", len);
+		fillpath(top - len, len, 0);
+		tryopen(top - len, EFAULT, "string off user top", len);
+	}
+	memcpy(top - MAXRUN, save, MAXRUN);
+
+	tryopen(top, EFAULT, "string in the kernel", 0);
+	tryopen(NULL, EFAULT, "null string", 0);
+
+	printf("  user top: ok\n");
+}
+
+/*
+ * __time returns both values with one batched copyout: a kernel
+ * pointer for either should fail before anything is written, and an
+ * unmapped or read-only one should fail.
+ */
+static
+void
+test_time(void)
+{
+	char *end = lastpage + PAGE_SIZE;
+	time_t s;
+	unsigned long ns;
+	int r;
+
+	s = -1;
+	ns = 0;
+	if (__time(&s, &ns) < 0 || s < 0) {
+		err(1, "__time");
+	}
+
+	s = -1;
+	r = __time(&s, (unsigned long *)USERSPACETOP);
+	if (r >= 0 || errno != EFAULT) {
+		errx(1, "__time with kernel nanoseconds pointer: %d", r);
+	}
+	if (s != -1) {
+		errx(1, "__time wrote seconds despite a kernel pointer");
+	}
+
+	r = __time((time_t *)(end - sizeof(time_t) / 2), NULL);
+	if (r >= 0 || errno != EFAULT) {
+		errx(1, "__time with seconds off page end: %d", r);
+	}
+	r = __time(&s, (unsigned long *)(end - sizeof(ns) / 2));
+	if (r >= 0 || errno != EFAULT) {
+		errx(1, "__time with nanoseconds off page end: %d", r);
+	}
+
+	if (__timepage != NULL) {
+		r = __time((time_t *)__timepage, NULL);
+		if (r >= 0 || errno != EFAULT) {
+			errx(1, "__time into the time page: %d", r);
+		}
+	}
+
+	printf("  __time: ok\n");
+}
+
+/*
+ * Time NCALLS opens of PATH.
+ */
+static
+void
+bench(const char *what, const char *path, unsigned ncalls)
+{
+	unsigned long t, us;
+	unsigned i;
+
+	t = now_us();
+	for (i = 0; i < ncalls; i++) {
+		(void)open(path, O_RDONLY);
+	}
+	us = now_us() - t;
+	printf("  %-24s %8lu us  %6lu ns/call\n", what, us,
+	       us * 1000UL / ncalls);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long t, us;
+	unsigned ncalls = DEFAULT_CALLS;
+	unsigned long ns;
+	unsigned i;
+	time_t s;
+
+	if (argc == 3 && !strcmp(argv[1], "-n")) {
+		ncalls = atoi(argv[2]);
+	}
+	else if (argc != 1) {
+		usage();
+	}
+	if (ncalls == 0) {
+		usage();
+	}
+
+	setup_lastpage();
+
+	printf("copytest: %u calls\n", ncalls);
+	test_pageend();
+	test_pathmax();
+	test_usertop();
+	test_time();
+
+	/*
+	 * A device that doesn't exist fails before any filesystem
+	 * gets involved, so these mostly measure the trap and the
+	 * copyinstr.
+	 */
+	strcpy(longpath, "copytest-nodev:");
+	memset(longpath + strlen(longpath), 'a',
+	       sizeof(longpath) - strlen(longpath) - 1);
+	bench("open, 16-byte path", "copytest-nodev:", ncalls);
+	bench("open, 1023-byte path", longpath, ncalls);
+
+	t = now_us();
+	for (i = 0; i < ncalls; i++) {
+		__time(&s, &ns);
+	}
+	us = now_us() - t;
+	printf("  %-24s %8lu us  %6lu ns/call\n", "__time, both values", us,
+	       us * 1000UL / ncalls);
+
+	return 0;
+}
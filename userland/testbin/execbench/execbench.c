@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * execbench - time repeated fork/exec/wait of the same program.
+ *
+ * Usage: execbench [-n count] [-a nargs] [program]
+ *
+ * Runs PROGRAM (default /bin/true) COUNT times in a row and reports
+ * the time for the first run separately from the average of the rest.
+ * The first exec of a program not run recently has to read it from
+ * the filesystem; the rest should be served from the kernel's exec
+ * image cache, so the difference between the two numbers is roughly
+ * what the cache saves per exec.
+ *
+ * With -a, each exec also passes NARGS extra arguments (short words),
+ * to measure the cost of moving a big argv through the kernel.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_PROG	"/bin/true"
+#define DEFAULT_COUNT	50
+#define MAXARGS		4096
+
+static char *args[MAXARGS + 2];
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: execbench [-n count] [-a nargs] [program]");
+}
+
+/*
+ * Run PROG once and return how long it took, in microseconds.
+ */
+static
+unsigned long
+runone(const char *prog)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	pid_t pid;
+	int status;
+
+	__time(&s0, &ns0);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(prog, args);
+		warn("%s", prog);
+		_exit(255);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	__time(&s1, &ns1);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 255) {
+		errx(1, "%s failed", prog);
+	}
+
+	return (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *prog = DEFAULT_PROG;
+	unsigned count = DEFAULT_COUNT;
+	unsigned nargs = 0;
+	unsigned long first, rest, t;
+	unsigned i;
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+			count = atoi(argv[++arg]);
+		}
+		else if (!strcmp(argv[arg], "-a") && arg + 1 < argc) {
+			nargs = atoi(argv[++arg]);
+		}
+		else if (argv[arg][0] == '-') {
+			usage();
+		}
+		else if (arg == argc - 1) {
+			prog = argv[arg];
+		}
+		else {
+			usage();
+		}
+	}
+	if (count < 2 || nargs > MAXARGS) {
+		usage();
+	}
+
+	args[0] = (char *)prog;
+	for (i = 1; i <= nargs; i++) {
+		args[i] = (char *)"argument";
+	}
+	args[nargs + 1] = NULL;
+
+	first = runone(prog);
+	rest = 0;
+	for (i = 1; i < count; i++) {
+		t = runone(prog);
+		rest += t;
+	}
+
+	printf("execbench: %s, %u args, %u runs\n", prog, nargs, count);
+	printf("  first run:    %lu us\n", first);
+	printf("  later runs:   %lu us average\n", rest / (count - 1));
+	return 0;
+}
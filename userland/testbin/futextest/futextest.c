@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futextest - check the futex system calls and the <umutex.h>
+ * wrappers built on them.
+ *
+ * Processes don't share memory, so this can only exercise the
+ * single-threaded paths: the uncontended mutex and condvar fast
+ * paths, and the kernel's argument and value checks. Several threads
+ * sleeping on one word, and wakeups with a count, are tested from
+ * the kernel menu instead (fx1), with kernel threads sharing one
+ * address space.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <umutex.h>
+#include <err.h>
+
+static struct umutex smutex = UMUTEX_INITIALIZER;
+static struct ucond scond = UCOND_INITIALIZER;
+
+static
+void
+test_syscalls(void)
+{
+	volatile int word;
+	int r;
+
+	word = 5;
+
+	/* value mismatch must not sleep */
+	r = futex_wait(&word, 6);
+	if (r != -1 || errno != EAGAIN) {
+		errx(1, "futex_wait with stale value: got %d (errno %d)",
+		     r, errno);
+	}
+
+	/* nobody is sleeping */
+	r = futex_wake(&word, 1);
+	if (r != 0) {
+		errx(1, "futex_wake with no waiters: got %d", r);
+	}
+
+	/* misaligned */
+	r = futex_wake((volatile int *)((char *)&word + 1), 1);
+	if (r != -1 || errno != EINVAL) {
+		errx(1, "futex_wake on misaligned word: got %d (errno %d)",
+		     r, errno);
+	}
+
+	/* bad pointer */
+	r = futex_wait((volatile int *)0x40000000, 0);
+	if (r != -1 || errno != EFAULT) {
+		errx(1, "futex_wait on bad pointer: got %d (errno %d)",
+		     r, errno);
+	}
+
+	printf("futex syscalls: ok\n");
+}
+
+static
+void
+test_mutex(void)
+{
+	struct umutex m;
+	unsigned i;
+
+	umutex_init(&m);
+	for (i=0; i<1000; i++) {
+		umutex_lock(&m);
+		if (m.um_state != 1) {
+			errx(1, "uncontended lock left state %d", m.um_state);
+		}
+		if (umutex_trylock(&m) == 0) {
+			errx(1, "trylock succeeded on a held mutex");
+		}
+		umutex_unlock(&m);
+	}
+	if (umutex_trylock(&smutex) != 0) {
+		errx(1, "trylock failed on a free mutex");
+	}
+	umutex_unlock(&smutex);
+	if (smutex.um_state != 0) {
+		errx(1, "unlock left state %d", smutex.um_state);
+	}
+
+	printf("umutex: ok\n");
+}
+
+static
+void
+test_cond(void)
+{
+	int seq;
+
+	seq = scond.uc_seq;
+	ucond_signal(&scond);
+	ucond_broadcast(&scond);
+	if (scond.uc_seq != seq + 2) {
+		errx(1, "ucond sequence did not advance");
+	}
+
+	printf("ucond: ok\n");
+}
+
+int
+main(void)
+{
+	test_syscalls();
+	test_mutex();
+	test_cond();
+	printf("futextest: passed\n");
+	return 0;
+}
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ioringtest - test the asynchronous I/O rings (io_setup/io_enter)
+ * and compare reading a file through them with plain pread.
+ *
+ * Usage: ioringtest [-k kilobytes] [directory]
+ *
+ * Checks that no-ops, opens, writes, fsyncs, and reads all complete
+ * with the right results, including failures, and that a ring can be
+ * torn down while its reads are stuck, then times reading a file of
+ * the given size (default 256K) in DIRECTORY (default the current
+ * directory) one block at a time with pread and QDEPTH blocks at a
+ * time through the rings.
+ */
+
+#include <sys/types.h>
+#include <sys/ioring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_KB	256
+#define BLOCKSIZE	4096
+#define NBLOCKS		8
+#define QDEPTH		16
+#define SQENTRIES	32
+#define CQENTRIES	64
+
+static struct io_rings rings;
+static struct io_sqe sqes[SQENTRIES];
+static struct io_cqe cqes[CQENTRIES];
+
+static char filename[256];
+static char wbuf[NBLOCKS][BLOCKSIZE];
+static char rbuf[QDEPTH][BLOCKSIZE];
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: ioringtest [-k kilobytes] [directory]");
+}
+
+static
+unsigned long
+now_us(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000000UL + ns / 1000;
+}
+
+/*
+ * Fill in the next submission queue entry.
+ */
+static
+void
+queue(int op, int fd, void *buf, size_t len, off_t offset,
+      unsigned userdata)
+{
+	struct io_sqe *sqe;
+
+	if (rings.ir_sqtail - rings.ir_sqhead >= SQENTRIES) {
+		errx(1, "submission queue overflow");
+	}
+	sqe = &sqes[rings.ir_sqtail % SQENTRIES];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_offset = offset;
+	sqe->sqe_userdata = userdata;
+	rings.ir_sqtail++;
+}
+
+static
+void
+queue_open(const char *path, int flags, unsigned userdata)
+{
+	queue(IO_OP_OPEN, -1, (void *)path, 0, 0, userdata);
+	sqes[(rings.ir_sqtail - 1) % SQENTRIES].sqe_openflags = flags;
+	sqes[(rings.ir_sqtail - 1) % SQENTRIES].sqe_mode = 0664;
+}
+
+/*
+ * Submit everything queued and wait for N completions, which go into
+ * RES indexed by userdata.
+ */
+static
+void
+submit_wait(unsigned n, int *res)
+{
+	struct io_cqe *cqe;
+	unsigned got;
+	int r;
+
+	r = io_enter(rings.ir_sqtail - rings.ir_sqhead, n);
+	if (r < 0) {
+		err(1, "io_enter");
+	}
+	for (got = 0; got < n; got++) {
+		while (rings.ir_cqhead == rings.ir_cqtail) {
+			if (io_enter(0, 1) < 0) {
+				err(1, "io_enter");
+			}
+		}
+		cqe = &cqes[rings.ir_cqhead % CQENTRIES];
+		res[cqe->cqe_userdata] = cqe->cqe_res;
+		rings.ir_cqhead++;
+	}
+}
+
+static
+void
+test_setup(void)
+{
+	rings.ir_sqentries = SQENTRIES;
+	rings.ir_cqentries = CQENTRIES;
+	rings.ir_sqes = sqes;
+	rings.ir_cqes = cqes;
+	if (io_setup(&rings) < 0) {
+		err(1, "io_setup");
+	}
+	if (io_setup(&rings) != -1 || errno != EBUSY) {
+		errx(1, "second io_setup: expected EBUSY");
+	}
+	printf("  setup: ok\n");
+}
+
+static
+void
+test_nop(void)
+{
+	int res[NBLOCKS];
+	unsigned i;
+
+	for (i = 0; i < NBLOCKS; i++) {
+		res[i] = -1;
+		queue(IO_OP_NOP, -1, NULL, 0, 0, i);
+	}
+	submit_wait(NBLOCKS, res);
+	for (i = 0; i < NBLOCKS; i++) {
+		if (res[i] != 0) {
+			errx(1, "nop %u: result %d", i, res[i]);
+		}
+	}
+	printf("  nop: ok\n");
+}
+
+/*
+ * Open, write, fsync, and read back a file entirely through the rings.
+ */
+static
+void
+test_file(void)
+{
+	int res[NBLOCKS];
+	unsigned i, j;
+	int fd;
+
+	queue_open(filename, O_RDWR | O_CREAT | O_TRUNC, 0);
+	submit_wait(1, res);
+	if (res[0] < 0) {
+		errx(1, "%s: open: %s", filename, strerror(-res[0]));
+	}
+	fd = res[0];
+
+	for (i = 0; i < NBLOCKS; i++) {
+		for (j = 0; j < BLOCKSIZE; j++) {
+			wbuf[i][j] = (char)(i * 13 + j);
+		}
+		queue(IO_OP_WRITE, fd, wbuf[i], BLOCKSIZE, i * BLOCKSIZE, i);
+	}
+	submit_wait(NBLOCKS, res);
+	for (i = 0; i < NBLOCKS; i++) {
+		if (res[i] != BLOCKSIZE) {
+			errx(1, "write %u: result %d", i, res[i]);
+		}
+	}
+
+	queue(IO_OP_FSYNC, fd, NULL, 0, 0, 0);
+	submit_wait(1, res);
+	if (res[0] != 0) {
+		errx(1, "fsync: %s", strerror(-res[0]));
+	}
+
+	/* read the blocks back in the opposite order */
+	for (i = 0; i < NBLOCKS; i++) {
+		memset(rbuf[i], 0, BLOCKSIZE);
+		queue(IO_OP_READ, fd, rbuf[i], BLOCKSIZE,
+		      (NBLOCKS - 1 - i) * BLOCKSIZE, i);
+	}
+	submit_wait(NBLOCKS, res);
+	for (i = 0; i < NBLOCKS; i++) {
+		if (res[i] != BLOCKSIZE) {
+			errx(1, "read %u: result %d", i, res[i]);
+		}
+		if (memcmp(rbuf[i], wbuf[NBLOCKS - 1 - i], BLOCKSIZE)) {
+			errx(1, "read %u: wrong data", i);
+		}
+	}
+
+	/* the file's seek position should not have moved */
+	if (lseek(fd, 0, SEEK_CUR) != 0) {
+		errx(1, "ring I/O moved the seek position");
+	}
+
+	close(fd);
+	printf("  open/write/fsync/read: ok\n");
+}
+
+static
+void
+test_errors(void)
+{
+	int res[4];
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+
+	queue(IO_OP_READ, -1, rbuf[0], BLOCKSIZE, 0, 0);
+	queue(IO_OP_WRITE, fd, wbuf[0], BLOCKSIZE, 0, 1);
+	queue(IO_OP_READ, fd, NULL, BLOCKSIZE, 0, 2);
+	queue(99, fd, NULL, 0, 0, 3);
+	submit_wait(4, res);
+
+	if (res[0] != -EBADF) {
+		errx(1, "read on bad fd: result %d", res[0]);
+	}
+	if (res[1] != -EBADF) {
+		errx(1, "write on read-only fd: result %d", res[1]);
+	}
+	if (res[2] != -EFAULT) {
+		errx(1, "read into NULL: result %d", res[2]);
+	}
+	if (res[3] != -EINVAL) {
+		errx(1, "bad op: result %d", res[3]);
+	}
+
+	close(fd);
+	printf("  errors: ok\n");
+}
+
+/*
+ * Tear down a ring whose workers are all stuck reading an empty pipe,
+ * with more reads queued behind them, and check that this doesn't
+ * wait for them and that a new ring works at once.
+ */
+static
+void
+test_teardown(void)
+{
+	int p[2];
+	unsigned i;
+
+	if (pipe(p) < 0) {
+		err(1, "pipe");
+	}
+	for (i = 0; i < NBLOCKS; i++) {
+		queue(IO_OP_READ, p[0], rbuf[i], BLOCKSIZE, 0, i);
+	}
+	if (io_enter(NBLOCKS, 0) != NBLOCKS) {
+		err(1, "io_enter");
+	}
+	if (io_setup(NULL) < 0) {
+		err(1, "io_setup(NULL)");
+	}
+	if (io_setup(&rings) < 0) {
+		err(1, "io_setup");
+	}
+	test_nop();
+
+	/* let the old ring's reads finish (at end of file) */
+	close(p[1]);
+	close(p[0]);
+	printf("  teardown: ok\n");
+}
+
+static
+void
+makefile(unsigned kb)
+{
+	unsigned i;
+	int fd;
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	for (i = 0; i < kb / 4; i++) {
+		memset(wbuf[0], (char)i, BLOCKSIZE);
+		if (write(fd, wbuf[0], BLOCKSIZE) != BLOCKSIZE) {
+			err(1, "%s: write", filename);
+		}
+	}
+	close(fd);
+}
+
+static
+void
+report(const char *what, unsigned kb, unsigned long us)
+{
+	if (us == 0) {
+		us = 1;
+	}
+	printf("  %-24s %8lu us  %6lu KB/s\n", what, us,
+	       (unsigned long)kb * 1000000UL / us);
+}
+
+static
+void
+bench_pread(int fd, unsigned nblocks)
+{
+	unsigned i;
+
+	for (i = 0; i < nblocks; i++) {
+		if (pread(fd, rbuf[0], BLOCKSIZE, i * BLOCKSIZE) != BLOCKSIZE) {
+			err(1, "pread");
+		}
+	}
+}
+
+static
+void
+bench_ring(int fd, unsigned nblocks)
+{
+	int res[QDEPTH];
+	unsigned i, j, n;
+
+	for (i = 0; i < nblocks; i += n) {
+		n = nblocks - i < QDEPTH ? nblocks - i : QDEPTH;
+		for (j = 0; j < n; j++) {
+			queue(IO_OP_READ, fd, rbuf[j], BLOCKSIZE,
+			      (i + j) * BLOCKSIZE, j);
+		}
+		submit_wait(n, res);
+		for (j = 0; j < n; j++) {
+			if (res[j] != BLOCKSIZE) {
+				errx(1, "ring read: result %d", res[j]);
+			}
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *dir = ".";
+	unsigned kb = DEFAULT_KB;
+	unsigned long t;
+	size_t len;
+	int i, fd;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+			kb = atoi(argv[++i]);
+		}
+		else if (argv[i][0] == '-' || i != argc - 1) {
+			usage();
+		}
+		else {
+			dir = argv[i];
+		}
+	}
+	if (kb < 4) {
+		usage();
+	}
+	kb -= kb % 4;
+
+	len = strlen(dir);
+	snprintf(filename, sizeof(filename), "%s%sioringtest.tmp", dir,
+		 (dir[len-1] == '/' || dir[len-1] == ':') ? "" : "/");
+
+	printf("ioringtest: %s\n", filename);
+	test_setup();
+	test_nop();
+	test_file();
+	test_errors();
+	test_teardown();
+
+	makefile(kb);
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+
+	printf("reading %uK:\n", kb);
+	t = now_us();
+	bench_pread(fd, kb / 4);
+	report("pread, 4K at a time", kb, now_us() - t);
+
+	t = now_us();
+	bench_ring(fd, kb / 4);
+	report("ring, 16 x 4K at a time", kb, now_us() - t);
+
+	close(fd);
+	remove(filename);
+	return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovtest - check readv, writev, preadv, and pwritev, and pread and
+ * pwrite.
+ *
+ * Writes a header/payload/trailer record with one writev, reads it
+ * back scattered differently, then checks the positional calls don't
+ * move the seek pointer, a vector longer than the kernel's batch
+ * size, and the argument checks.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <err.h>
+
+#define TESTFILE	"iovtest.tmp"
+#define MANY		600	/* more than fit in a page of iovecs */
+
+static char hdr[] = "HDR:";
+static char payload[] = "the quick brown fox jumps over the lazy dog";
+static char trailer[] = ":END\n";
+static char record[sizeof(hdr) + sizeof(payload) + sizeof(trailer)];
+static char buf[sizeof(record)];
+static struct iovec many[MANY];
+static char manybytes[MANY];
+
+static
+void
+checkpos(int fd, off_t want, const char *what)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos != want) {
+		errx(1, "%s: seek position %ld, expected %ld", what,
+		     (long)pos, (long)want);
+	}
+}
+
+static
+void
+test_basic(int fd)
+{
+	struct iovec iov[3];
+	size_t len;
+	ssize_t r;
+
+	len = strlen(hdr) + strlen(payload) + strlen(trailer);
+	snprintf(record, sizeof(record), "%s%s%s", hdr, payload, trailer);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = strlen(hdr);
+	iov[1].iov_base = payload;
+	iov[1].iov_len = strlen(payload);
+	iov[2].iov_base = trailer;
+	iov[2].iov_len = strlen(trailer);
+	r = writev(fd, iov, 3);
+	if (r != (ssize_t)len) {
+		err(1, "writev: got %ld", (long)r);
+	}
+	checkpos(fd, len, "writev");
+
+	/* read it back in two uneven pieces plus an empty one */
+	memset(buf, 0, sizeof(buf));
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 7;
+	iov[1].iov_base = buf + 7;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = buf + 7;
+	iov[2].iov_len = sizeof(buf) - 7;
+	lseek(fd, 0, SEEK_SET);
+	r = readv(fd, iov, 3);
+	if (r != (ssize_t)len) {
+		err(1, "readv: got %ld", (long)r);
+	}
+	if (memcmp(buf, record, len) != 0) {
+		errx(1, "readv: data mismatch");
+	}
+	checkpos(fd, len, "readv");
+	printf("writev/readv ok\n");
+}
+
+static
+void
+test_positional(int fd)
+{
+	struct iovec iov[2];
+	ssize_t r;
+
+	/* overwrite "quick" with "QUICK" without moving the seek ptr */
+	lseek(fd, 3, SEEK_SET);
+	iov[0].iov_base = (char *)"QUI";
+	iov[0].iov_len = 3;
+	iov[1].iov_base = (char *)"CK";
+	iov[1].iov_len = 2;
+	r = pwritev(fd, iov, 2, strlen(hdr) + 4);
+	if (r != 5) {
+		err(1, "pwritev: got %ld", (long)r);
+	}
+	checkpos(fd, 3, "pwritev");
+
+	memset(buf, 0, sizeof(buf));
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = buf + 4;
+	iov[1].iov_len = 5;
+	r = preadv(fd, iov, 2, strlen(hdr));
+	if (r != 9) {
+		err(1, "preadv: got %ld", (long)r);
+	}
+	if (memcmp(buf, "the QUICK", 9) != 0) {
+		errx(1, "preadv: got \"%.9s\"", buf);
+	}
+	checkpos(fd, 3, "preadv");
+	printf("pwritev/preadv ok\n");
+}
+
+static
+void
+test_pread(int fd)
+{
+	ssize_t r;
+
+	lseek(fd, 1, SEEK_SET);
+	r = pwrite(fd, "LAZY", 4, strlen(hdr) + 35);
+	if (r != 4) {
+		err(1, "pwrite: got %ld", (long)r);
+	}
+	checkpos(fd, 1, "pwrite");
+
+	memset(buf, 0, sizeof(buf));
+	r = pread(fd, buf, 8, strlen(hdr) + 35);
+	if (r != 8) {
+		err(1, "pread: got %ld", (long)r);
+	}
+	if (memcmp(buf, "LAZY dog", 8) != 0) {
+		errx(1, "pread: got \"%.8s\"", buf);
+	}
+	checkpos(fd, 1, "pread");
+
+	/* reading at the end of the file gets nothing */
+	r = pread(fd, buf, sizeof(buf), 100000);
+	if (r != 0) {
+		errx(1, "pread past EOF: got %ld", (long)r);
+	}
+	printf("pwrite/pread ok\n");
+}
+
+static
+void
+test_many(int fd)
+{
+	ssize_t r;
+	int i;
+
+	for (i = 0; i < MANY; i++) {
+		manybytes[i] = 'a' + i % 26;
+		many[i].iov_base = &manybytes[i];
+		many[i].iov_len = 1;
+	}
+	r = pwritev(fd, many, MANY, 0);
+	if (r != MANY) {
+		err(1, "pwritev of %d iovecs: got %ld", MANY, (long)r);
+	}
+
+	memset(manybytes, 0, sizeof(manybytes));
+	r = preadv(fd, many, MANY, 0);
+	if (r != MANY) {
+		err(1, "preadv of %d iovecs: got %ld", MANY, (long)r);
+	}
+	for (i = 0; i < MANY; i++) {
+		if (manybytes[i] != 'a' + i % 26) {
+			errx(1, "preadv of %d iovecs: mismatch at %d",
+			     MANY, i);
+		}
+	}
+	printf("%d iovecs ok\n", MANY);
+}
+
+static
+void
+expect(ssize_t r, int wanterr, const char *what)
+{
+	if (r != -1 || errno != wanterr) {
+		errx(1, "%s: got %ld (errno %d), expected errno %d",
+		     what, (long)r, errno, wanterr);
+	}
+}
+
+static
+void
+test_errors(int fd)
+{
+	struct iovec iov[1];
+
+	iov[0].iov_base = buf;
+	iov[0].iov_len = sizeof(buf);
+
+	expect(readv(fd, iov, 0), EINVAL, "readv with iovcnt 0");
+	expect(readv(fd, iov, IOV_MAX + 1), EINVAL, "readv past IOV_MAX");
+	expect(readv(fd, NULL, 1), EFAULT, "readv with NULL iov");
+	expect(preadv(fd, iov, 1, -1), EINVAL, "preadv at -1");
+	expect(pread(fd, buf, 1, -1), EINVAL, "pread at -1");
+	expect(pwrite(STDOUT_FILENO, buf, 1, 0), ESPIPE,
+	       "pwrite on console");
+	expect(writev(-1, iov, 1), EBADF, "writev on bad fd");
+	expect(preadv(STDIN_FILENO, iov, 1, 0), ESPIPE,
+	       "preadv on console");
+
+	/* a NULL buffer is just a bad address, and the fd comes first */
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "lseek");
+	}
+	expect(read(fd, NULL, 1), EFAULT, "read into NULL");
+	expect(write(fd, NULL, 1), EFAULT, "write from NULL");
+	expect(read(-1, NULL, 1), EBADF, "read NULL on bad fd");
+	expect(readv(-1, iov, 0), EBADF, "readv with iovcnt 0 on bad fd");
+	expect(pread(fd, NULL, 1, 0), EFAULT, "pread into NULL");
+	expect(pwrite(fd, NULL, 1, 0), EFAULT, "pwrite from NULL");
+	expect(pread(-1, NULL, 1, 0), EBADF, "pread NULL on bad fd");
+	printf("error checks ok\n");
+}
+
+int
+main(void)
+{
+	int fd;
+
+	fd = open(TESTFILE, O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+
+	test_basic(fd);
+	test_positional(fd);
+	test_pread(fd);
+	test_many(fd);
+	test_errors(fd);
+
+	close(fd);
+	remove(TESTFILE);
+	printf("iovtest: passed\n");
+	return 0;
+}
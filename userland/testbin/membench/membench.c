@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * membench - check memcpy, memmove, memset, and bzero, and measure
+ * their bandwidth.
+ *
+ * Usage: membench [-k kilobytes]
+ *
+ * First compares each one with a plain byte loop for every length up
+ * to a few hundred bytes at every source and destination alignment,
+ * overlapping both ways for memmove. Then, for each size from 16
+ * bytes to 64K and each of a few alignments, moves the given amount
+ * of data in total (default 4096K) and reports MB/s.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_KB	4096
+#define MAXSIZE		65536
+#define CHECKLEN	300
+#define ALIGN		8
+
+/* room for the largest size, any alignment, and memmove's overlap */
+static char bufa[MAXSIZE + 4 * ALIGN], bufb[MAXSIZE + 4 * ALIGN];
+static char ref[CHECKLEN + 4 * ALIGN];
+
+static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/* source and destination offsets from word alignment */
+static const struct {
+	unsigned src, dst;
+} aligns[] = {
+	{ 0, 0 },
+	{ 1, 1 },
+	{ 1, 0 },
+	{ 0, 3 },
+	{ 2, 1 },
+};
+#define NALIGNS (sizeof(aligns) / sizeof(aligns[0]))
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: membench [-k kilobytes]");
+}
+
+static
+unsigned long
+now_us(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000000UL + ns / 1000;
+}
+
+static
+void
+fill(char *p, size_t len, unsigned seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		p[i] = (char)(i * 31 + seed);
+	}
+}
+
+static
+void
+bytecopy(char *d, const char *s, size_t len)
+{
+	size_t i;
+
+	if (d < s) {
+		for (i = 0; i < len; i++) {
+			d[i] = s[i];
+		}
+	}
+	else {
+		for (i = len; i > 0; i--) {
+			d[i-1] = s[i-1];
+		}
+	}
+}
+
+static
+void
+byteset(char *p, int ch, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		p[i] = (char)ch;
+	}
+}
+
+static
+void
+compare(const char *what, size_t len, unsigned so, unsigned dof)
+{
+	if (memcmp(bufb, ref, sizeof(ref)) != 0) {
+		errx(1, "%s of %zu bytes, src +%u dst +%u: wrong result",
+		     what, len, so, dof);
+	}
+}
+
+/*
+ * Every length and alignment against a byte loop. Everything happens
+ * in the first CHECKLEN + 4*ALIGN bytes of bufb, which we compare
+ * whole so stray writes outside the target show up too.
+ */
+static
+void
+check(void)
+{
+	size_t len;
+	unsigned so, dof;
+
+	for (len = 0; len <= CHECKLEN; len++) {
+		for (so = 0; so < ALIGN; so++) {
+			for (dof = 0; dof < ALIGN; dof++) {
+				fill(bufa, sizeof(ref), len);
+				fill(bufb, sizeof(ref), so * ALIGN + dof);
+				memcpy(ref, bufb, sizeof(ref));
+				bytecopy(ref + dof, bufa + so, len);
+				memcpy(bufb + dof, bufa + so, len);
+				compare("memcpy", len, so, dof);
+
+				/* down, then up, over itself */
+				bytecopy(ref + dof, ref + ALIGN + so, len);
+				memmove(bufb + dof, bufb + ALIGN + so, len);
+				compare("memmove down", len, so, dof);
+				bytecopy(ref + ALIGN + dof, ref + so, len);
+				memmove(bufb + ALIGN + dof, bufb + so, len);
+				compare("memmove up", len, so, dof);
+
+				byteset(ref + dof, 0, len);
+				byteset(ref + dof, (int)(so + 0xf0), len / 2);
+				bzero(bufb + dof, len);
+				memset(bufb + dof, (int)(so + 0xf0), len / 2);
+				compare("memset/bzero", len, so, dof);
+			}
+		}
+	}
+	printf("  all lengths to %u, all alignments: ok\n", CHECKLEN);
+}
+
+/*
+ * Run one function on one size and alignment over TOTAL bytes.
+ */
+static
+void
+bench(int which, size_t size, unsigned so, unsigned dof, size_t total)
+{
+	unsigned long t, us;
+	size_t done;
+
+	t = now_us();
+	for (done = 0; done < total; done += size) {
+		switch (which) {
+		    case 0:
+			memcpy(bufb + dof, bufa + so, size);
+			break;
+		    case 1:
+			memmove(bufa + ALIGN + dof, bufa + so, size);
+			break;
+		    default:
+			memset(bufb + dof, (int)done, size);
+			break;
+		}
+	}
+	us = now_us() - t;
+	if (us == 0) {
+		us = 1;
+	}
+	printf(" %6lu", (unsigned long)(total / us));
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const char *const names[] = { "memcpy", "memmove", "memset" };
+	size_t total = DEFAULT_KB * 1024UL;
+	unsigned w, s, a;
+
+	if (argc == 3 && !strcmp(argv[1], "-k")) {
+		total = atoi(argv[2]) * 1024UL;
+	}
+	else if (argc != 1) {
+		usage();
+	}
+	if (total == 0) {
+		usage();
+	}
+
+	printf("membench: %zuK per test\n", total / 1024);
+	check();
+
+	for (w = 0; w < 3; w++) {
+		printf("  %-8s MB/s at src+dst offsets:\n  %8s", names[w],
+		       "size");
+		for (a = 0; a < NALIGNS; a++) {
+			printf("    %u+%u", aligns[a].src, aligns[a].dst);
+		}
+		printf("\n");
+		for (s = 0; s < NSIZES; s++) {
+			printf("  %8zu", sizes[s]);
+			for (a = 0; a < NALIGNS; a++) {
+				bench(w, sizes[s], aligns[a].src,
+				      aligns[a].dst, total);
+			}
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
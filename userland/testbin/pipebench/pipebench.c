@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipebench - check pipe semantics and measure pipe throughput.
+ *
+ * Usage: pipebench [-k kilobytes]
+ *
+ * First checks end of file, EPIPE, and that data comes out in order.
+ * Then forks a writer that pushes the given amount of data (default
+ * 1024K) through a pipe to the parent, using several write sizes,
+ * and reports how long each took.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_KB	1024
+#define MAXCHUNK	(64*1024)
+
+static char wbuf[MAXCHUNK], rbuf[MAXCHUNK];
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: pipebench [-k kilobytes]");
+}
+
+static
+unsigned long
+now_us(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000000UL + ns / 1000;
+}
+
+static
+char
+pattern(unsigned long pos)
+{
+	return (char)(pos * 7 + pos / 4096);
+}
+
+static
+void
+waitchild(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "writer failed");
+	}
+}
+
+/*
+ * Reading an empty pipe with no writer gives EOF; writing to a pipe
+ * with no reader gives EPIPE.
+ */
+static
+void
+test_ends(void)
+{
+	int fds[2];
+	char c = 'x';
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	if (write(fds[1], &c, 1) != 1) {
+		err(1, "write");
+	}
+	close(fds[1]);
+	c = 0;
+	if (read(fds[0], &c, 1) != 1 || c != 'x') {
+		errx(1, "read back failed");
+	}
+	if (read(fds[0], &c, 1) != 0) {
+		errx(1, "expected end of file");
+	}
+	if (write(fds[0], &c, 1) != -1 || errno != EBADF) {
+		errx(1, "write on read end: expected EBADF");
+	}
+	if (lseek(fds[0], 0, SEEK_SET) != -1 || errno != ESPIPE) {
+		errx(1, "lseek: expected ESPIPE");
+	}
+	close(fds[0]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	if (write(fds[1], &c, 1) != -1 || errno != EPIPE) {
+		errx(1, "write with no reader: expected EPIPE");
+	}
+	close(fds[1]);
+
+	printf("  ends: ok\n");
+}
+
+/*
+ * Child: write TOTAL bytes in CHUNK-sized writes, then exit.
+ */
+static
+void
+writer(int fd, unsigned long total, size_t chunk)
+{
+	unsigned long pos;
+	size_t len, i;
+	ssize_t r;
+
+	for (pos = 0; pos < total; pos += len) {
+		len = total - pos < chunk ? total - pos : chunk;
+		for (i = 0; i < len; i++) {
+			wbuf[i] = pattern(pos + i);
+		}
+		r = write(fd, wbuf, len);
+		if (r != (ssize_t)len) {
+			warn("write returned %ld", (long)r);
+			_exit(1);
+		}
+	}
+	_exit(0);
+}
+
+/*
+ * Push TOTAL bytes through a pipe in CHUNK-sized writes and check
+ * them as they come out. Returns microseconds taken.
+ */
+static
+unsigned long
+run(unsigned long total, size_t chunk)
+{
+	unsigned long pos, t;
+	ssize_t r, i;
+	pid_t pid;
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	t = now_us();
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1], total, chunk);
+	}
+	close(fds[1]);
+
+	pos = 0;
+	while ((r = read(fds[0], rbuf, MAXCHUNK)) > 0) {
+		for (i = 0; i < r; i++) {
+			if (rbuf[i] != pattern(pos + i)) {
+				errx(1, "wrong data at offset %lu", pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	t = now_us() - t;
+
+	close(fds[0]);
+	waitchild(pid);
+	if (pos != total) {
+		errx(1, "got %lu bytes, expected %lu", pos, total);
+	}
+	return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t chunks[] = { 512, 4096, 16384, MAXCHUNK };
+	unsigned kb = DEFAULT_KB;
+	unsigned long us;
+	unsigned i;
+
+	if (argc == 3 && !strcmp(argv[1], "-k")) {
+		kb = atoi(argv[2]);
+	}
+	else if (argc != 1) {
+		usage();
+	}
+	if (kb == 0) {
+		usage();
+	}
+
+	printf("pipebench:\n");
+	test_ends();
+
+	printf("moving %uK:\n", kb);
+	for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+		us = run(kb * 1024UL, chunks[i]);
+		if (us == 0) {
+			us = 1;
+		}
+		printf("  %6lu-byte writes %8lu us  %6lu KB/s\n",
+		       (unsigned long)chunks[i], us,
+		       (unsigned long)kb * 1000000UL / us);
+	}
+	return 0;
+}
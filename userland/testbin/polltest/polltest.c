@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * polltest - check poll() on pipes.
+ *
+ * Usage: polltest
+ *
+ * Checks readiness of both pipe ends as data comes and goes and as
+ * ends close, that bad file handles give POLLNVAL, that a timeout
+ * expires, and that a sleeping poll is woken by a write from another
+ * process.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <err.h>
+
+#define TIMEOUT_MS	200
+
+static
+unsigned long
+now_ms(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000UL + ns / 1000000;
+}
+
+/*
+ * Poll one file handle without waiting; return its revents.
+ */
+static
+int
+pollone(int fd, int events)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	r = poll(&pfd, 1, 0);
+	if (r < 0) {
+		err(1, "poll");
+	}
+	if (r != (pfd.revents != 0)) {
+		errx(1, "poll returned %d with revents 0x%x", r, pfd.revents);
+	}
+	return pfd.revents;
+}
+
+static
+void
+expect(const char *what, int got, int want)
+{
+	if (got != want) {
+		errx(1, "%s: revents 0x%x, expected 0x%x", what, got, want);
+	}
+}
+
+/*
+ * Readiness of both ends as data comes and goes.
+ */
+static
+void
+test_ready(void)
+{
+	int fds[2];
+	char c = 'x';
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	expect("empty, read end", pollone(fds[0], POLLIN), 0);
+	expect("empty, write end", pollone(fds[1], POLLOUT), POLLOUT);
+	expect("read end, not asked", pollone(fds[0], 0), 0);
+
+	if (write(fds[1], &c, 1) != 1) {
+		err(1, "write");
+	}
+	expect("data, read end", pollone(fds[0], POLLIN | POLLOUT), POLLIN);
+	if (read(fds[0], &c, 1) != 1) {
+		err(1, "read");
+	}
+	expect("drained, read end", pollone(fds[0], POLLIN), 0);
+
+	close(fds[0]);
+	expect("no reader", pollone(fds[1], POLLOUT), POLLERR);
+	close(fds[1]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[1]);
+	expect("no writer", pollone(fds[0], POLLIN), POLLHUP);
+	close(fds[0]);
+
+	printf("  ready: ok\n");
+}
+
+/*
+ * Negative file handles are skipped; closed ones give POLLNVAL.
+ */
+static
+void
+test_badfd(void)
+{
+	struct pollfd pfds[2];
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	close(fds[1]);
+
+	pfds[0].fd = -1;
+	pfds[0].events = POLLIN;
+	pfds[0].revents = POLLIN;
+	pfds[1].fd = fds[0];
+	pfds[1].events = POLLIN;
+	pfds[1].revents = 0;
+	if (poll(pfds, 2, 0) != 1) {
+		errx(1, "badfd: expected 1 ready");
+	}
+	expect("negative fd", pfds[0].revents, 0);
+	expect("closed fd", pfds[1].revents, POLLNVAL);
+
+	printf("  badfd: ok\n");
+}
+
+/*
+ * Nothing happens; poll should give up after the timeout.
+ */
+static
+void
+test_timeout(void)
+{
+	struct pollfd pfd;
+	unsigned long start, elapsed;
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	start = now_ms();
+	if (poll(&pfd, 1, TIMEOUT_MS) != 0) {
+		errx(1, "timeout: expected nothing ready");
+	}
+	elapsed = now_ms() - start;
+	if (elapsed < TIMEOUT_MS) {
+		errx(1, "timeout: returned after %lu ms", elapsed);
+	}
+	close(fds[0]);
+	close(fds[1]);
+
+	printf("  timeout: ok (%lu ms)\n", elapsed);
+}
+
+/*
+ * Block in poll until a child writes to the pipe.
+ */
+static
+void
+test_wakeup(void)
+{
+	struct timespec ts;
+	struct pollfd pfd;
+	int fds[2], status;
+	char c = 'x';
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		ts.tv_sec = 0;
+		ts.tv_nsec = 100 * 1000000;
+		nanosleep(&ts, NULL);
+		if (write(fds[1], &c, 1) != 1) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, -1) != 1) {
+		errx(1, "wakeup: expected 1 ready");
+	}
+	expect("wakeup", pfd.revents, POLLIN);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "wakeup: writer failed");
+	}
+	close(fds[0]);
+
+	printf("  wakeup: ok\n");
+}
+
+int
+main(void)
+{
+	printf("polltest:\n");
+	test_ready();
+	test_badfd();
+	test_timeout();
+	test_wakeup();
+	printf("polltest: passed\n");
+	return 0;
+}
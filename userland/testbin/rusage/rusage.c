@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * rusage - exercise getrusage.
+ *
+ * Burns some CPU, touches some memory, and writes to null:, then does
+ * the same in a child and waits for it, checking that the byte counts
+ * come out right and printing the rest.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define NPAGES		32
+#define PAGESIZE	4096
+#define NWRITES		64
+#define SPINS		2000000
+
+static char buf[512];
+
+static
+void
+work(void)
+{
+	volatile unsigned x;
+	char *mem;
+	unsigned i;
+	int fd;
+
+	for (x = 0; x < SPINS; x++) {
+		/* burn user time */
+	}
+
+	mem = malloc(NPAGES * PAGESIZE);
+	if (mem == NULL) {
+		errx(1, "malloc failed");
+	}
+	for (i = 0; i < NPAGES; i++) {
+		mem[i * PAGESIZE] = 1;
+	}
+	free(mem);
+
+	fd = open("null:", O_WRONLY);
+	if (fd < 0) {
+		err(1, "null:");
+	}
+	memset(buf, 'x', sizeof(buf));
+	for (i = 0; i < NWRITES; i++) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			err(1, "null: write");
+		}
+	}
+	close(fd);
+}
+
+static
+void
+show(const char *what, int who, unsigned long long minout)
+{
+	struct rusage ru;
+
+	if (getrusage(who, &ru) < 0) {
+		err(1, "getrusage");
+	}
+	printf("%s:\n", what);
+	printf("  user %lu.%06lu sys %lu.%06lu\n",
+	       (unsigned long)ru.ru_utime.tv_sec,
+	       (unsigned long)ru.ru_utime.tv_usec,
+	       (unsigned long)ru.ru_stime.tv_sec,
+	       (unsigned long)ru.ru_stime.tv_usec);
+	printf("  csw %llu voluntary, %llu involuntary\n",
+	       ru.ru_nvcsw, ru.ru_nivcsw);
+	printf("  faults %llu minor (%llu cow), %llu major, "
+	       "%llu tlb refills\n",
+	       ru.ru_minflt, ru.ru_cowflt, ru.ru_majflt, ru.ru_tlbrefill);
+	printf("  bytes %llu in, %llu out\n", ru.ru_inbytes, ru.ru_outbytes);
+
+	if (ru.ru_outbytes < minout) {
+		errx(1, "%s: expected at least %llu bytes out", what, minout);
+	}
+}
+
+int
+main(void)
+{
+	pid_t pid;
+	int status;
+
+	if (getrusage(12345, NULL) != -1) {
+		errx(1, "getrusage accepted a bad who");
+	}
+
+	work();
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		work();
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+
+	show("self", RUSAGE_SELF, NWRITES * sizeof(buf));
+	show("children", RUSAGE_CHILDREN, NWRITES * sizeof(buf));
+
+	printf("rusage: passed\n");
+	return 0;
+}
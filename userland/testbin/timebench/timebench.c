@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * timebench - check the time page and compare time() through it with
+ * the __time system call.
+ *
+ * Usage: timebench [-n calls]
+ *
+ * Checks that the page is there, agrees with __time, keeps ticking,
+ * and can't be written. Then times the given number of calls
+ * (default 100000) of each.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <kern/timepage.h>
+
+#define DEFAULT_CALLS	100000
+
+/* Set by crt0. */
+extern const volatile struct timepage *__timepage;
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: timebench [-n calls]");
+}
+
+static
+unsigned long
+now_us(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	return s * 1000000UL + ns / 1000;
+}
+
+/*
+ * The page agrees with the clock, ticks, and is read-only.
+ */
+static
+void
+test_page(void)
+{
+	struct timespec ts;
+	unsigned ticks;
+	time_t a, b, c;
+	unsigned long ns;
+	int status;
+	pid_t pid;
+
+	a = time(NULL);
+	__time(&b, &ns);
+	c = time(NULL);
+	if (b < a || c < a || c - a > 1) {
+		errx(1, "time() and __time disagree: %ld, %ld, %ld",
+		     (long)a, (long)b, (long)c);
+	}
+
+	ticks = __timepage->tp_ticks;
+	ts.tv_sec = 0;
+	ts.tv_nsec = 200 * 1000000;
+	nanosleep(&ts, NULL);
+	if (__timepage->tp_ticks - ticks < __timepage->tp_hz / 10) {
+		errx(1, "only %u ticks in 200 ms at %u Hz",
+		     __timepage->tp_ticks - ticks, __timepage->tp_hz);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		/* this should kill us */
+		((struct timepage *)__timepage)->tp_sec = 0;
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+		errx(1, "wrote to the time page");
+	}
+	if (time(NULL) < c) {
+		errx(1, "time went backwards after the write");
+	}
+
+	printf("  page: ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long t, us;
+	unsigned ncalls = DEFAULT_CALLS;
+	unsigned i;
+	time_t s;
+
+	if (argc == 3 && !strcmp(argv[1], "-n")) {
+		ncalls = atoi(argv[2]);
+	}
+	else if (argc != 1) {
+		usage();
+	}
+	if (ncalls == 0) {
+		usage();
+	}
+
+	if (__timepage == NULL) {
+		errx(1, "no time page");
+	}
+
+	printf("timebench: %u calls\n", ncalls);
+	test_page();
+
+	t = now_us();
+	for (i = 0; i < ncalls; i++) {
+		time(&s);
+	}
+	us = now_us() - t;
+	printf("  %-16s %8lu us  %6lu ns/call\n", "time()", us,
+	       us * 1000UL / ncalls);
+
+	t = now_us();
+	for (i = 0; i < ncalls; i++) {
+		__time(&s, NULL);
+	}
+	us = now_us() - t;
+	printf("  %-16s %8lu us  %6lu ns/call\n", "__time()", us,
+	       us * 1000UL / ncalls);
+
+	return 0;
+}